@@ -0,0 +1,70 @@
+#pragma once
+
+#include "factory.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Binarny format struktury: nagłówek, tablice rekordów stałej długości (rampy, robotnicy,
+// magazyny) i sekcja połączeń w formacie CSR - nadawca wskazuje swój zakres [first_link,
+// first_link + link_count), a połączenie wskazuje odbiorcę indeksem w jego tablicy.
+// Połączenia nadawcy zapisane są w kolejności raportu razem z prawdopodobieństwem
+// (tablica routingu), więc wczytanie nie wymaga parsowania ani wyszukiwania po ID.
+// Prawdopodobieństwa są odtwarzane bez normalizacji - także nierówne, których format
+// tekstowy nie zapisuje.
+// Liczby w kolejności bajtów maszyny; wszystkie sekcje wyrównane do 8 bajtów.
+constexpr std::uint32_t BINARY_STRUCTURE_MAGIC = 0x5342534E;  // "NSBS"
+constexpr std::uint32_t BINARY_STRUCTURE_VERSION = 1;
+
+struct BinaryStructureHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t ramp_count;
+    std::uint32_t worker_count;
+    std::uint32_t storehouse_count;
+    std::uint32_t link_count;
+    std::uint64_t ramps_offset;
+    std::uint64_t workers_offset;
+    std::uint64_t storehouses_offset;
+    std::uint64_t links_offset;
+    std::uint64_t total_size;
+};
+
+struct BinaryRamp {
+    std::int32_t id;
+    std::int32_t delivery_interval;
+    std::uint32_t first_link;
+    std::uint32_t link_count;
+};
+
+struct BinaryWorker {
+    std::int32_t id;
+    std::int32_t processing_time;
+    std::uint32_t queue_type;  // 0 - FIFO, 1 - LIFO
+    std::uint32_t queue_capacity;
+    std::uint32_t first_link;
+    std::uint32_t link_count;
+};
+
+struct BinaryStorehouse {
+    std::int32_t id;
+    std::uint32_t reserved;
+};
+
+struct BinaryLink {
+    std::uint32_t target_type;  // 0 - robotnik, 1 - magazyn
+    std::uint32_t target_index;
+    double probability;
+};
+
+void save_binary_structure(const Factory& factory, std::ostream& os);
+
+// Buduje fabrykę z obrazu w pamięci (data wyrównane co najmniej do 8 bajtów)
+Factory load_binary_structure(const void* data, std::size_t size);
+
+// Mapuje plik tylko do odczytu i wczytuje go bez kopiowania
+Factory map_binary_structure(const std::string& path);
+
+bool is_binary_structure(const void* data, std::size_t size);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "factory.hpp"
+
+#include <cstddef>
+#include <ostream>
+
+// Generator samodzielnego symulatora C++ wyspecjalizowanego dla jednej struktury.
+// Topologia, czasy przetwarzania, interwały dostaw i tablice routingu (kolejność
+// ReceiverPreferences::sorted_receivers()) trafiają do tablic constexpr, a tura to
+// osobna pętla dla każdego typu węzła - do unroll_limit węzłów rozwinięta w czasie
+// kompilacji, więc indeksy i parametry są stałymi.
+//
+// Program wynikowy: <symulator> <tury> [ziarno] [co ile tur raport]
+// Wypisuje to samo co generate_simulation_report() dla simulate() po
+// Factory::seed_routing(ziarno) w świeżym procesie (ID paczek od 1).
+struct CodegenOptions {
+    std::size_t unroll_limit = 64;
+};
+
+// Rzuca std::logic_error dla niespójnej fabryki
+void generate_simulator_source(const Factory& factory, std::ostream& os, const CodegenOptions& options = {});
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "simulate.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+enum class MetricKind {
+    STOREHOUSE_THROUGHPUT,   // liczba paczek przyjętych przez magazyn w turze
+    WORKER_QUEUE_LENGTH      // długość kolejki robotnika na koniec tury
+};
+
+struct MetricTarget {
+    MetricKind kind;
+    ElementID id;
+};
+
+struct ConvergenceOptions {
+    // Puste - śledzimy wszystkie magazyny i wszystkich robotników
+    std::vector<MetricTarget> targets;
+    // Docelowa (pełna) szerokość przedziału ufności; przy relative - względem |średniej|
+    double ci_width = 0.1;
+    bool relative = false;
+    double confidence = 0.95;
+    TimeOffset batch_size = 50;
+    std::size_t min_batches = 10;
+    TimeOffset max_turns = 1000000;
+};
+
+// Estymator metodą średnich z partii (batch means) z wykrywaniem rozbiegu (MSER)
+class BatchMeansEstimator {
+public:
+    explicit BatchMeansEstimator(TimeOffset batch_size) : batch_size_(batch_size) {}
+
+    void add(double x);
+
+    std::size_t batch_count() const { return batch_means_.size(); }
+    const std::vector<double>& batch_means() const { return batch_means_; }
+
+    // Liczba początkowych partii do odrzucenia (reguła MSER na średnich z partii)
+    std::size_t warmup_batches() const;
+
+    // Średnia i połowa szerokości przedziału ufności z partii [first_batch, koniec)
+    double mean(std::size_t first_batch) const;
+    double half_width(std::size_t first_batch, double confidence) const;
+
+private:
+    TimeOffset batch_size_;
+    TimeOffset in_batch_ = 0;
+    double batch_sum_ = 0.0;
+    std::vector<double> batch_means_;
+};
+
+struct MetricEstimate {
+    MetricTarget target;
+    double mean;
+    double half_width;
+    bool converged;
+};
+
+struct ConvergenceResult {
+    Time turns = 0;          // liczba wykonanych tur
+    Time warmup = 0;         // wykryta długość rozbiegu (w turach)
+    bool converged = false;
+    std::vector<MetricEstimate> estimates;
+};
+
+// Metryka z węzłem wyszukanym raz, przed pętlą tur (find_*_by_id jest liniowe).
+// Węzeł nie może zostać usunięty z fabryki w trakcie pomiaru.
+class MetricProbe {
+public:
+    // Rzuca std::invalid_argument, gdy węzła nie ma w fabryce
+    MetricProbe(const Factory& factory, const MetricTarget& target);
+
+    // Wartość metryki w bieżącej turze (przepustowość liczona od poprzedniego wywołania
+    // albo od utworzenia)
+    double observe();
+
+private:
+    const Worker* worker_ = nullptr;
+    const Storehouse* storehouse_ = nullptr;
+    std::size_t last_stock_ = 0;
+};
+
+// Kwantyl rozkładu t-Studenta (przybliżenie Cornisha-Fishera)
+double student_t_quantile(double p, double dof);
+
+// Symuluje aż wszystkie metryki się ustabilizują albo minie max_turns
+ConvergenceResult simulate_until_converged(Factory& factory,
+                                           const ConvergenceOptions& options,
+                                           const std::function<void(Factory&, TimeOffset)>& rf = nullptr);
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "result_cache.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Rezydentny serwer symulacji (netsimd). Wczytane struktury trzymane są jako gotowe
+// obrazy formatu binarnego, więc przebieg nie parsuje tekstu - wczytanie obrazu to
+// kilka alokacji. Każde żądanie RUN buduje z obrazu własną fabrykę (stan przebiegu nie
+// jest współdzielony). Wątek przyjmujący obsługuje wszystkie połączenia jedną pętlą
+// poll() na gniazdach nieblokujących: czyta żądania, kolejkuje pojedyncze żądania do
+// puli wątków i wysyła gotowe odpowiedzi, więc bezczynne połączenie nie zajmuje wątku,
+// a kolejne żądania jednego połączenia mogą liczyć się równolegle. Odpowiedzi wracają
+// w kolejności żądań połączenia. Klient, który nie odbiera odpowiedzi, nie blokuje
+// żadnego wątku - przy zbyt wielu żądaniach bez odpowiedzi albo zbyt dużym buforze
+// odpowiedzi połączenie przestaje być czytane. Za długi wiersz żądania kończy czytanie
+// połączenia odpowiedzią ERR.
+//
+// Protokół tekstowy, żądanie to jeden wiersz (LOAD dodatkowo treść struktury):
+//   LOAD <nazwa> <bajty>\n<struktura tekstowa albo binarna>
+//   RUN <nazwa> turns=<N> [seed=<S>] [interval=<K>] [at=<t1,t2,...>] [output=reports|metrics]
+//   DROP <nazwa>
+//   LIST
+//   STATS
+// Odpowiedź: "OK <bajty>\n<treść>" albo "ERR <komunikat>\n". LOAD zwraca skrót
+// struktury (structure_hash, szesnastkowo), RUN raporty albo metryki jak CachedRun.
+struct DaemonOptions {
+    std::string socket_path;
+    std::size_t threads = 0;   // 0 - std::thread::hardware_concurrency()
+};
+
+class SimulationDaemon {
+public:
+    explicit SimulationDaemon(const DaemonOptions& options);
+    ~SimulationDaemon();
+
+    SimulationDaemon(const SimulationDaemon&) = delete;
+    SimulationDaemon& operator=(const SimulationDaemon&) = delete;
+
+    // Kończy przyjmowanie połączeń i żądań, czeka na wątki (kolejkowane żądania są
+    // kończone, odpowiedzi wysyłane, o ile klient je odbiera bez czekania)
+    void stop();
+
+    // Obsługa jednego żądania bez gniazda; body - treść po wierszu LOAD
+    std::string handle(const std::string& request, const std::string& body = "");
+
+    std::size_t thread_count() const { return pool_.size(); }
+    std::uint64_t runs() const { return runs_.load(std::memory_order_relaxed); }
+
+private:
+    struct Template {
+        std::vector<std::uint64_t> image;   // obraz binarny wyrównany do 8 bajtów
+        std::size_t size = 0;
+        std::uint64_t hash = 0;
+    };
+
+    // Gniazdo zamykane razem z ostatnim odwołaniem (pętla poll() i żądania w kolejce)
+    struct Connection {
+        explicit Connection(int fd) : fd(fd) {}
+        ~Connection();
+
+        int fd;
+        std::string input;                  // tylko pętla poll()
+        bool reading = true;                // tylko pętla poll()
+
+        std::mutex mutex;
+        std::uint64_t next_request = 0;     // zapis tylko w pętli poll()
+        std::uint64_t next_response = 0;
+        std::map<std::uint64_t, std::string> ready;   // odpowiedzi czekające na wcześniejsze
+        std::string output;                 // odpowiedzi w kolejności żądań, jeszcze niewysłane
+        bool broken = false;
+    };
+
+    struct Request {
+        std::shared_ptr<Connection> connection;
+        std::uint64_t sequence = 0;
+        std::string line;
+        std::string body;
+    };
+
+    void accept_loop();
+    void worker_loop();
+    void wake();
+    void receive(Connection& connection);
+    // Wysyła z bufora tyle, ile gniazdo przyjmie bez blokowania
+    void flush(Connection& connection);
+    // Wydziela z bufora połączenia kompletne żądania i kolejkuje je (najwyżej
+    // MAX_PENDING_REQUESTS bez odpowiedzi); false - dalsze czytanie bez sensu
+    bool queue_requests(const std::shared_ptr<Connection>& connection);
+    // Dopisuje odpowiedź o numerze sequence i wszystkie gotowe po niej do bufora
+    // wyjściowego, w kolejności żądań; wysyła pętla poll()
+    void respond(Connection& connection, std::uint64_t sequence, std::string response);
+
+    std::string load(const std::string& name, const std::string& structure);
+    std::string run(const std::string& name, const std::vector<std::string>& args);
+
+    std::string socket_path_;
+    int listen_fd_ = -1;
+    int wake_fds_[2] = {-1, -1};   // potok budzący pętlę poll() po nowej odpowiedzi
+
+    mutable std::shared_mutex templates_mutex_;
+    std::map<std::string, std::shared_ptr<const Template>> templates_;
+
+    std::mutex queue_mutex_;
+    std::condition_variable queue_ready_;
+    std::deque<Request> pending_;
+
+    std::atomic<bool> stop_{false};
+    std::atomic<std::uint64_t> runs_{0};
+    std::atomic<std::uint64_t> turns_{0};
+    std::thread acceptor_;
+    std::vector<std::thread> pool_;
+};
+
+// Klient jednego połączenia z netsimd
+class DaemonClient {
+public:
+    explicit DaemonClient(const std::string& socket_path);
+    ~DaemonClient();
+
+    DaemonClient(const DaemonClient&) = delete;
+    DaemonClient& operator=(const DaemonClient&) = delete;
+
+    // Treść odpowiedzi OK; odpowiedź ERR rzuca std::runtime_error
+    std::string request(const std::string& line, const std::string& body = "");
+
+    // Skrót wczytanej struktury
+    std::string load(const std::string& name, const std::string& structure);
+
+private:
+    bool read_line(std::string& line);
+
+    int fd_ = -1;
+    std::string buffer_;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "snapshot.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Testy różnicowe: alternatywny silnik symulacji musi dawać stan identyczny z simulate()
+// po Factory::seed_routing(seed). Stan porównywany po turze to cały FactorySnapshot
+// (kolejki, bufory i blokady robotników, zapasy magazynów, bufory i blokady ramp).
+// Silnik, który zgłasza całą fabrykę, jest porównywany także co do kolejności paczek
+// w kolejkach - po ID paczek, powtarzalnych, bo każdy przebieg dostaje własny rejestr ID.
+
+// ID paczek w kolejkach robotników (robotnicy po ID, paczki w kolejności kolejki)
+using QueueContents = std::vector<std::vector<ElementID>>;
+
+QueueContents capture_queue_contents(const Factory& factory);
+
+// Odbiorca stanu po turze: same liczniki (silniki bez tożsamości paczek - zagregowany,
+// pasy, podzielony) albo cała fabryka
+class TurnObserver {
+public:
+    using Callback = std::function<void(const FactorySnapshot&, const QueueContents*)>;
+
+    explicit TurnObserver(Callback callback) : callback_(std::move(callback)) {}
+
+    void operator()(const FactorySnapshot& snapshot) const { callback_(snapshot, nullptr); }
+    void operator()(const Factory& factory, Time t) const;
+
+private:
+    Callback callback_;
+};
+
+// Silnik wykonuje d tur na świeżo wczytanej fabryce i przekazuje observe() stan po
+// wybranych turach (rosnąco); każda zgłoszona tura jest porównywana z referencją.
+using SimulationEngine = std::function<void(Factory& factory, TimeOffset d, std::uint64_t seed,
+                                            const TurnObserver& observe)>;
+
+// simulate() po seed_routing(seed), stan po każdej turze
+void reference_engine(Factory& factory, TimeOffset d, std::uint64_t seed, const TurnObserver& observe);
+
+// Gotowe silniki alternatywne z tego drzewa
+SimulationEngine replay_engine();                    // record_simulation() na kopii, potem replay_simulation()
+SimulationEngine binary_structure_engine();          // struktura przepuszczona przez format binarny
+SimulationEngine partitioned_engine(int shard_count); // simulate_partitioned(), tylko stan końcowy
+
+struct RandomStructureOptions {
+    int max_ramps = 3;
+    int max_workers = 6;
+    int max_storehouses = 2;
+    TimeOffset max_delivery_interval = 4;
+    TimeOffset max_processing_time = 4;
+    double extra_link_probability = 0.3;
+    double queue_capacity_probability = 0.2;
+};
+
+// Losowa, spójna struktura w formacie tekstowym: każdy robotnik ma łącze do robotnika
+// o wyższym ID albo do magazynu, więc z każdej rampy da się dojść do magazynu. Łącza
+// prowadzą tylko "w przód" - Factory::is_consistent() odrzuca część struktur z cyklami
+// (krawędź do węzła w trakcie sprawdzania nie liczy się jako droga do magazynu).
+std::string generate_random_structure(std::mt19937_64& rng, const RandomStructureOptions& options = {});
+
+struct DifferentialMismatch {
+    std::string structure;
+    std::uint64_t seed = 0;
+    Time turn = 0;             // pierwsza tura z różnicą
+    FactorySnapshot expected;
+    FactorySnapshot actual;
+    QueueContents expected_queues;
+    QueueContents actual_queues;   // puste, gdy silnik zgłasza same liczniki
+    std::string error;         // wyjątek silnika albo brak zgłoszonych tur
+};
+
+// Pierwsza różnica w ciągu d tur albo nullopt, gdy silniki są zgodne
+std::optional<DifferentialMismatch> compare_engines(const std::string& structure, std::uint64_t seed,
+                                                    TimeOffset d, const SimulationEngine& engine);
+
+// Usuwa węzły i łącza oraz upraszcza parametry, dopóki różnica nadal występuje
+// (najpóźniej w turze mismatch.turn); zwraca różnicę dla minimalnej struktury.
+DifferentialMismatch shrink_mismatch(const DifferentialMismatch& mismatch, const SimulationEngine& engine);
+
+struct DifferentialOptions {
+    std::size_t cases = 100;
+    TimeOffset turns = 200;
+    std::uint64_t seed = 1;   // ziarno generatora struktur; przypadek i dostaje ziarno routingu seed + i
+    RandomStructureOptions structure;
+    bool shrink = true;
+};
+
+// Pierwsza (zmniejszona) różnica albo nullopt, gdy wszystkie przypadki są zgodne
+std::optional<DifferentialMismatch> run_differential(const SimulationEngine& engine,
+                                                     const DifferentialOptions& options = {});
+
+void generate_mismatch_report(const DifferentialMismatch& mismatch, std::ostream& os);
@@ -8,11 +8,46 @@
 #include<string>
 #include<iostream>
 #include<map>
+#include<set>
 #include<fstream>
 #include<sstream>
+#include<vector>
 
 enum class NodeColor {NOT_VISITED, VISITED, VERIFIED};
 
+// Odległości połączeń liczone w pozycjach kolejności obsługi (rampy, robotnicy, magazyny)
+struct LocalityReport {
+    std::size_t links = 0;
+    double mean_distance_before = 0.0;
+    double mean_distance_after = 0.0;
+    double forward_links_before = 0.0;   // odsetek połączeń "w przód" względem kolejności
+    double forward_links_after = 0.0;
+};
+
+// Szacunkowe zużycie pamięci: rozmiary węzłów kontenerów i obiektów, bez narzutu alokatora
+struct MemoryComponent {
+    std::size_t objects = 0;
+    std::size_t bytes = 0;
+};
+
+struct MemoryUsage {
+    MemoryComponent ramps;                 // węzły list NodeCollection
+    MemoryComponent workers;
+    MemoryComponent storehouses;
+    MemoryComponent worker_queues;         // paczki w kolejkach (+ obiekty kolejek)
+    MemoryComponent storehouse_stock;      // paczki w magazynach (+ obiekty magazynów)
+    MemoryComponent receiver_preferences;  // połączenia: węzły map i kolejność raportu
+    MemoryComponent routing_generators;    // stan generatorów losowania odbiorcy (RoutingStream nadawców)
+    MemoryComponent package_ids;           // zbiory ID rejestru paczek fabryki (globalny - wspólny dla fabryk)
+    MemoryComponent factory_indexes;       // indeks po ID i zbiór aktywnych robotników
+
+    // Przyrost pamięci na każdą paczkę w kolejce lub magazynie (do prognozy szczytu)
+    std::size_t bytes_per_queued_package = 0;
+
+    std::vector<std::pair<const char*, MemoryComponent>> components() const;
+    std::size_t total_bytes() const;
+};
+
 template <typename Node>
 class NodeCollection {
 public:
@@ -50,6 +85,36 @@ public:
         }
     }
 
+    // Przenosi węzły do nowych, kolejno alokowanych elementów listy w zadanej kolejności
+    // (węzły spoza order zostają na końcu). on_move(stary, nowy) jest wołane, póki oba
+    // obiekty żyją; zwracana jest stara lista, żeby można było przepiąć wskaźniki przed jej zniszczeniem.
+    template <typename OnMove>
+    container_t relocate(const std::vector<ElementID>& order, OnMove&& on_move) {
+        std::map<ElementID, iterator> by_id;
+        for (auto it = nodes_.begin(); it != nodes_.end(); ++it) {
+            by_id.emplace(it->get_id(), it);
+        }
+        std::set<const Node*> taken;
+        container_t reordered;
+        auto take = [&](iterator it) {
+            if (taken.insert(&*it).second) {
+                reordered.push_back(std::move(*it));
+                on_move(*it, reordered.back());
+            }
+        };
+        for (ElementID id : order) {
+            auto found = by_id.find(id);
+            if (found != by_id.end()) {
+                take(found->second);
+            }
+        }
+        for (auto it = nodes_.begin(); it != nodes_.end(); ++it) {
+            take(it);
+        }
+        nodes_.swap(reordered);
+        return reordered;
+    }
+
     // Iteratory
     iterator begin() { return nodes_.begin(); }
     iterator end() { return nodes_.end(); }
@@ -66,6 +131,8 @@ class Factory {
 public:
 // ---------------- RAMPY (Ramp) ----------------
     void add_ramp(Ramp&& r) {
+        r.set_tracer(tracer_, LineageNode::RAMP, r.get_id());
+        r.set_package_id_allocator(*package_ids_);
         ramps_.add(std::move(r));
     }
 
@@ -81,6 +148,9 @@ public:
         return ramps_.find_by_id(id);
     }
 
+    NodeCollection<Ramp>::iterator ramp_begin() { return ramps_.begin(); }
+    NodeCollection<Ramp>::iterator ramp_end() { return ramps_.end(); }
+
     NodeCollection<Ramp>::const_iterator ramp_cbegin() const {
         return ramps_.cbegin();
     }
@@ -91,10 +161,17 @@ public:
 
     // ---------------- ROBOTNICY (Worker) ----------------
     void add_worker(Worker&& w) {
+        w.set_tracer(tracer_, LineageNode::WORKER, w.get_id());
         workers_.add(std::move(w));
+        workers_by_id_valid_ = false;
+        active_workers_valid_ = false;
     }
 
-    void remove_worker(ElementID id) { remove_receiver(workers_, id); }
+    void remove_worker(ElementID id) {
+        remove_receiver(workers_, id);
+        workers_by_id_valid_ = false;
+        active_workers_valid_ = false;
+    }
 
     NodeCollection<Worker>::iterator find_worker_by_id(ElementID id) {
         return workers_.find_by_id(id);
@@ -104,6 +181,9 @@ public:
         return workers_.find_by_id(id);
     }
 
+    NodeCollection<Worker>::iterator worker_begin() { return workers_.begin(); }
+    NodeCollection<Worker>::iterator worker_end() { return workers_.end(); }
+
     NodeCollection<Worker>::const_iterator worker_cbegin() const {
         return workers_.cbegin();
     }
@@ -112,8 +192,15 @@ public:
         return workers_.cend();
     }
 
+    // Robotnicy posortowani po ID (do raportów) - przeliczane tylko po zmianie struktury
+    const std::vector<const Worker*>& workers_by_id() const;
+
+    // Koszt O(liczba węzłów) - liczności kontenerów są pamiętane, nic nie jest przeglądane
+    MemoryUsage memory_usage() const;
+
     // ---------------- MAGAZYNY (Storehouse) ----------------
     void add_storehouse(Storehouse&& s) {
+        s.set_tracer(tracer_);
         storehouses_.add(std::move(s));
     }
 
@@ -127,6 +214,9 @@ public:
         return storehouses_.find_by_id(id);
     }
 
+    NodeCollection<Storehouse>::iterator storehouse_begin() { return storehouses_.begin(); }
+    NodeCollection<Storehouse>::iterator storehouse_end() { return storehouses_.end(); }
+
     NodeCollection<Storehouse>::const_iterator storehouse_cbegin() const {
         return storehouses_.cbegin();
     }
@@ -137,29 +227,60 @@ public:
 
     bool is_consistent() const;
 
+    // Każdy nadawca dostaje własny strumień losowań wyprowadzony z (seed, typ, ID),
+    // więc decyzje routingu nie zależą od kolejności obsługi pozostałych węzłów.
+    // Odbiorcy wybierani są w kolejności ReceiverOrder, więc dwa warianty struktury z tym
+    // samym ziarnem dzielą decyzje (wspólne liczby losowe); antithetic odbija strumienie.
+    void seed_routing(std::uint64_t seed, bool antithetic = false);
+
+    // Układa robotników i magazyny w kolejności przepływu (BFS od ramp) w świeżo
+    // zaalokowanych węzłach list, tak by nadawcy i odbiorcy leżeli blisko siebie
+    // i byli obsługiwani po kolei. Zmienia kolejność obsługi węzłów (i raportów struktury).
+    LocalityReport reorder_for_locality();
+
+    // Podpina (nullptr - odpina) śledzenie próbki paczek we wszystkich węzłach,
+    // także dodawanych później. Fabryka nie przejmuje własności.
+    void set_lineage_tracer(LineageTracer* tracer);
+    LineageTracer* lineage_tracer() const { return tracer_; }
+
+    // Rejestr ID paczek tworzonych przez rampy, także dodawane później (domyślnie
+    // globalny). Przebieg z własnym rejestrem dostaje ID jak w świeżym procesie.
+    // Fabryka nie przejmuje własności: rejestr musi przeżyć fabrykę i wszystkie paczki
+    // z niej wyjęte - zmienną rejestru deklaruje się przed fabryką.
+    void set_package_id_allocator(PackageIdAllocator& ids);
+    PackageIdAllocator& package_id_allocator() const { return *package_ids_; }
+
     void do_deliveries(Time t){
+        if (tracer_ != nullptr) {
+            tracer_->set_turn(t);
+        }
         for (auto& ramp : ramps_) {
             ramp.deliver_goods(t);
         }
     }
 
+    // Robotnicy bezczynni (pusta kolejka i bufory) są pomijani - koszt tury zależy
+    // od liczby aktywnych, a kolejność obsługi pozostaje kolejnością kolekcji.
     void do_package_passing(){
         for (auto& ramp : ramps_) {
             ramp.send_package();
         }
 
-        for (auto& worker : workers_) {
-            worker.send_package();
+        for (std::size_t slot : active_workers().slots()) {
+            worker_slots_[slot]->send_package();
         }
     }
 
     void do_work(Time t){
-        for (auto& worker : workers_) {
-            worker.do_work(t);
+        ActiveWorkerSet& active = active_workers();
+        for (std::size_t slot : active.slots()) {
+            worker_slots_[slot]->do_work(t);
         }
+        active.deactivate_if([this](std::size_t slot) { return worker_slots_[slot]->is_idle(); });
     }
 
-    
+    std::size_t active_worker_count() const;
+
     friend Factory load_factory_structure(std::istream& is);
     friend void save_factory_structure(const Factory& f, std::ostream& os);
     template <typename Node>
@@ -188,6 +309,18 @@ private:
     NodeCollection<Ramp> ramps_;
     NodeCollection<Worker> workers_;
     NodeCollection<Storehouse> storehouses_;
+
+    mutable std::vector<const Worker*> workers_by_id_;
+    mutable bool workers_by_id_valid_ = false;
+
+    // Przebudowywany po każdej zmianie zbioru robotników
+    ActiveWorkerSet& active_workers();
+    std::unique_ptr<ActiveWorkerSet> active_workers_ = std::make_unique<ActiveWorkerSet>();
+    std::vector<Worker*> worker_slots_;
+    bool active_workers_valid_ = false;
+
+    LineageTracer* tracer_ = nullptr;
+    PackageIdAllocator* package_ids_ = &PackageIdAllocator::global();
 };
 
 
@@ -198,6 +331,19 @@ enum class ElementType {
     LINK
 };
 
+// Identyfikacja węzła niezależna od adresu w pamięci
+struct NodeKey {
+    ElementType type;
+    ElementID id;
+
+    bool operator<(const NodeKey& other) const {
+        return type != other.type ? type < other.type : id < other.id;
+    }
+    bool operator==(const NodeKey& other) const {
+        return type == other.type && id == other.id;
+    }
+};
+
 const std::map<ElementType, std::string> ElementTypeTags = {
     {ElementType::RAMP, "LOADING_RAMP"},
     {ElementType::WORKER, "WORKER"},
@@ -218,6 +364,32 @@ std::map<std::string, std::string> parse_line(const std::string& line);
 
 std::pair<std::string, int> decode_node_id(const std::string& raw_id);
 
+struct LoadOptions {
+    // Po wczytaniu wywołaj Factory::reorder_for_locality()
+    bool reorder_for_locality = false;
+};
+
+enum class StructureFormat {
+    TEXT,
+    BINARY   // patrz binary_structure.hpp
+};
+
+// Format wejścia rozpoznawany automatycznie
 Factory load_factory_structure(std::istream& is);
+Factory load_factory_structure(std::istream& is, const LoadOptions& options);
+void save_factory_structure(const Factory& f, std::ostream& os);
+void save_factory_structure(const Factory& f, std::ostream& os, StructureFormat format);
 void generate_structure_report(const Factory& f, std::ostream& os);
-void generate_simulation_report(const Factory& f, std::ostream& os, Time turn);
\ No newline at end of file
+void generate_simulation_report(const Factory& f, std::ostream& os, Time turn);
+
+// Fragmenty raportu symulacji dla pojedynczych węzłów i raport złożony z fragmentów
+// (np. przygotowanych w osobnych procesach) - ten sam tekst co generate_simulation_report(),
+// gdy robotnicy są podani po ID, magazyny w kolejności kolekcji, a rampy tylko wtedy,
+// gdy któraś była zablokowana (pusty wektor - bez sekcji ramp)
+void generate_ramp_state(const Ramp& r, std::ostream& os);
+void generate_worker_state(const Worker& w, std::ostream& os, Time turn);
+void generate_storehouse_state(const Storehouse& s, std::ostream& os);
+void assemble_simulation_report(std::ostream& os, Time turn, const std::vector<std::string>& ramps,
+                                const std::vector<std::string>& workers, const std::vector<std::string>& storehouses);
+void generate_locality_report(const LocalityReport& report, std::ostream& os);
+void generate_memory_report(const MemoryUsage& usage, std::ostream& os);
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "factory.hpp"
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+// Analityczny bilans przepływów (bez symulacji): rampa dostarcza 1/delivery-interval
+// paczek na turę, robotnik obsługuje 1/processing-time, a strumień wyjściowy robotnika
+// (min(napływ, wydajność)) rozdziela się według ReceiverPreferences.
+struct WorkerFlow {
+    ElementID id;
+    double arrival_rate;     // oczekiwany napływ paczek na turę
+    double service_rate;     // maksymalna przepustowość
+    double utilization;      // napływ / przepustowość
+    bool unstable;           // kolejka będzie rosła bez końca
+};
+
+struct StorehouseFlow {
+    ElementID id;
+    double arrival_rate;
+};
+
+struct FlowAnalysis {
+    std::vector<WorkerFlow> workers;          // posortowane po ID
+    std::vector<StorehouseFlow> storehouses;  // posortowane po ID
+    std::size_t iterations = 0;
+    double residual = 0.0;
+    bool converged = false;
+};
+
+struct FlowAnalysisOptions {
+    double tolerance = 1e-10;
+    std::size_t max_iterations = 10000;
+};
+
+// Rozwiązuje układ bilansu (z cyklami, w tym pętlami robotnika na siebie) iteracją
+// Gaussa-Seidla po rzadkiej macierzy połączeń wchodzących.
+FlowAnalysis analyze_flow(const Factory& factory, const FlowAnalysisOptions& options = FlowAnalysisOptions());
+
+void generate_flow_report(const FlowAnalysis& analysis, std::ostream& os);
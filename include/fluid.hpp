@@ -0,0 +1,123 @@
+#pragma once
+
+#include "factory.hpp"
+#include "helpers.hpp"
+#include "snapshot.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <random>
+#include <vector>
+
+// Tryb zagregowany ("płynny"): rampy, kolejki i magazyny przechowują liczności
+// identycznych paczek zamiast obiektów Package. Rampa dostarcza partię batch_size
+// paczek, robotnik pobiera z kolejki do batch_size paczek na jeden cykl przetwarzania,
+// a nadawca dzieli zawartość bufora między odbiorców losując z rozkładu
+// wielomianowego po ReceiverPreferences (kolejność sorted_receivers()).
+//
+// Przy batch_size = 1 liczności są identyczne z simulate() po Factory::seed_routing(seed)
+// - te same strumienie losowe i ta sama kolejność obsługi. Jak w Worker::do_work partia
+// nie kończy przetwarzania, dopóki bufor wysyłkowy nie jest pusty.
+
+struct FluidOptions {
+    std::uint64_t batch_size = 1;
+    std::uint64_t seed = 1;
+};
+
+// Paczki, które trafiły do kolejki w tej samej turze - kolejność kolejki zachowana
+// na poziomie kohort (FIFO pobiera najstarsze, LIFO najnowsze)
+struct FluidCohort {
+    Time arrival;
+    std::uint64_t count;
+};
+
+struct FluidLink {
+    bool store;
+    std::size_t index;
+    double probability;
+};
+
+struct FluidSender {
+    ElementID id = 0;
+    std::size_t first_link = 0;
+    std::size_t link_count = 0;
+    std::uint64_t buffer = 0;
+    std::uint64_t blocked_turns = 0;
+    RoutingStream engine;   // jak make_probability_generator(seed, strumień nadawcy)
+};
+
+struct FluidRamp : FluidSender {
+    TimeOffset delivery_interval = 1;
+};
+
+struct FluidWorker : FluidSender {
+    TimeOffset processing_duration = 1;
+    PackageQueueType queue_type = PackageQueueType::FIFO;
+    std::uint64_t queue_capacity = 0;   // 0 - bez limitu
+
+    std::deque<FluidCohort> queue;
+    std::uint64_t queued = 0;
+    std::uint64_t processing = 0;
+    Time processing_start = 0;
+
+    // Statystyki czasu oczekiwania w kolejce
+    std::uint64_t started = 0;
+    double total_wait = 0.0;
+
+    double mean_wait() const { return started == 0 ? 0.0 : total_wait / static_cast<double>(started); }
+};
+
+struct FluidStorehouse {
+    ElementID id = 0;
+    std::uint64_t stock = 0;
+};
+
+class FluidFactory {
+public:
+    // Fabryka musi być spójna (rzuca std::logic_error); jej stan nie jest kopiowany
+    explicit FluidFactory(const Factory& factory, const FluidOptions& options = {});
+
+    void do_deliveries(Time t);
+    void do_package_passing();
+    void do_work(Time t);
+
+    // Nowe ziarno dla wszystkich nadawców (strumienie węzłów jak w konstruktorze) -
+    // kopia stanu może dalej biec niezależnie od oryginału
+    void reseed(std::uint64_t seed);
+
+    // Wykonuje d kolejnych tur; rf (opcjonalnie) po każdej turze
+    void run(TimeOffset d, const std::function<void(const FluidFactory&, Time)>& rf = nullptr);
+
+    Time current_turn() const { return turn_; }
+    std::uint64_t batch_size() const { return batch_size_; }
+
+    const std::vector<FluidRamp>& ramps() const { return ramps_; }
+    const std::vector<FluidWorker>& workers() const { return workers_; }   // kolejność kolekcji
+    const std::vector<FluidStorehouse>& storehouses() const { return storehouses_; }
+    // Indeksy robotników w kolejności ID (jak w raportach)
+    const std::vector<std::size_t>& workers_by_id() const { return workers_by_id_; }
+
+    std::uint64_t delivered() const { return delivered_; }
+    // Paczki w buforach ramp i u robotników
+    std::uint64_t in_flight() const;
+
+    // Liczności w układzie capture_snapshot() (robotnicy po ID); liczniki obcinane do 32 bitów
+    FactorySnapshot snapshot() const;
+
+private:
+    std::uint64_t route(FluidSender& sender);
+    std::uint64_t accept(const FluidLink& link, std::uint64_t count);
+
+    std::uint64_t batch_size_;
+    Time turn_ = 0;
+    std::uint64_t delivered_ = 0;
+    std::vector<FluidRamp> ramps_;
+    std::vector<FluidWorker> workers_;
+    std::vector<FluidStorehouse> storehouses_;
+    std::vector<FluidLink> links_;
+    std::vector<std::size_t> workers_by_id_;
+};
+
+void generate_fluid_report(const FluidFactory& factory, std::ostream& os);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <random>
 
@@ -10,4 +11,41 @@ extern std::mt19937 rng;
 
 extern ProbabilityGenerator probability_generator;
 
+// Licznikowy strumień losowy nadawcy (splitmix64): 8 bajtów stanu zamiast ~5 KB
+// std::mt19937, bez alokacji i kosztownego ziarnowania. Stan startowy wyznacza para
+// (ziarno, numer strumienia), każde losowanie przesuwa licznik o stałą. Liczby z [0, 1)
+// liczone z bitów ręcznie - wynik nie zależy od implementacji biblioteki standardowej.
+class RoutingStream {
+public:
+    using result_type = std::uint64_t;
 
+    // Numer algorytmu (mieszanie ziarna, krok, konwersja na [0, 1)) - każda zmiana,
+    // po której strumień daje inne liczby, wymaga nowego numeru
+    static constexpr std::uint64_t ALGORITHM = 1;
+
+    RoutingStream() = default;
+    RoutingStream(std::uint64_t seed, std::uint64_t stream) : state_(mix(seed) ^ mix(stream ^ STREAM_KEY)) {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~result_type{0}; }
+
+    result_type operator()() { return mix(state_ += INCREMENT); }
+
+    double uniform() { return static_cast<double>((*this)() >> 11) * 0x1.0p-53; }
+
+private:
+    static constexpr std::uint64_t INCREMENT = 0x9E3779B97F4A7C15ULL;
+    static constexpr std::uint64_t STREAM_KEY = 0xD1B54A32D192ED03ULL;
+
+    static std::uint64_t mix(std::uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    std::uint64_t state_ = 0;
+};
+
+// Niezależny, powtarzalny strumień liczb losowych dla pary (ziarno, numer strumienia).
+// antithetic - ten sam strumień odbity (1 - u), do par zmiennych antytetycznych.
+ProbabilityGenerator make_probability_generator(std::uint64_t seed, std::uint64_t stream, bool antithetic = false);
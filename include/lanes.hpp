@@ -0,0 +1,86 @@
+#pragma once
+
+#include "factory.hpp"
+#include "snapshot.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Silnik replikacji "w pasach": LANE_WIDTH niezależnych replikacji jednej struktury
+// biegnie krok w krok. Stan każdego węzła to tablice liczników po jednej wartości na pas
+// (długość kolejki, zajętość, czas startu, bufor wysyłkowy, blokady, stan magazynu),
+// a każda faza tury to pętla po węzłach z wewnętrzną pętlą po pasach bez rozgałęzień -
+// kompilator zamienia ją na instrukcje wektorowe. Tożsamość paczek nie jest
+// przechowywana, więc dostępne są tylko metryki liczbowe (FactorySnapshot).
+//
+// Każdy pas ma własny generator xorshift128 (też w tablicach po pasach). Nie są to
+// strumienie Factory::seed_routing(), więc pojedyncza replikacja nie powtarza simulate()
+// - zgodne są rozkłady wyników. Dla struktur bez losowania (każdy nadawca ma jednego
+// odbiorcę) każdy pas daje dokładnie stan simulate(). Semantyka tury jak w simulate(),
+// łącznie z blokadami ramp i robotników przed pełnymi kolejkami.
+constexpr std::size_t LANE_WIDTH = 16;
+
+class LaneFactory {
+public:
+    // Pas l symuluje replikację first_replication + l; strumień losowy z (seed, replikacja).
+    // Fabryka musi być spójna (rzuca std::logic_error); jej stan nie jest kopiowany.
+    explicit LaneFactory(const Factory& factory, std::uint64_t seed = 1, std::uint64_t first_replication = 0);
+
+    // Jedna tura we wszystkich pasach
+    void step();
+    void run(TimeOffset d);
+
+    Time current_turn() const { return turn_; }
+
+    // Stan pasa w układzie capture_snapshot() (robotnicy po ID, magazyny i rampy w kolejności kolekcji)
+    FactorySnapshot snapshot(std::size_t lane) const;
+    std::uint64_t delivered(std::size_t lane) const { return delivered_[lane]; }
+
+private:
+    struct Link {
+        bool store;
+        std::uint32_t index;
+        float cumulative;   // suma prawdopodobieństw do tego łącza włącznie
+    };
+
+    struct Sender {
+        std::uint32_t first_link = 0;
+        std::uint32_t link_count = 0;
+    };
+
+    void draw(std::uint32_t* target, const Sender& sender);
+    void route(const Sender& sender, std::uint32_t* buffer, std::uint32_t* blocked);
+
+    Time turn_ = 0;
+
+    std::vector<Link> links_;
+    std::vector<Sender> ramp_senders_;
+    std::vector<TimeOffset> delivery_intervals_;
+    std::vector<Sender> worker_senders_;
+    std::vector<std::uint32_t> processing_durations_;
+    std::vector<std::uint32_t> queue_capacities_;   // 0 - bez limitu
+    std::vector<ElementID> worker_ids_;
+    std::vector<std::size_t> workers_by_id_;
+    std::vector<ElementID> storehouse_ids_;
+    std::vector<ElementID> ramp_ids_;
+
+    // Tablice [węzeł * LANE_WIDTH + pas]
+    std::vector<std::uint32_t> ramp_buffer_;
+    std::vector<std::uint32_t> ramp_blocked_;
+    std::vector<std::uint32_t> queue_;
+    std::vector<std::uint32_t> busy_;
+    std::vector<std::uint32_t> start_;
+    std::vector<std::uint32_t> sending_;
+    std::vector<std::uint32_t> blocked_;
+    std::vector<std::uint32_t> stock_;
+
+    // Stan xorshift128 i liczba dostarczonych paczek - po jednym na pas
+    std::uint32_t x_[LANE_WIDTH], y_[LANE_WIDTH], z_[LANE_WIDTH], w_[LANE_WIDTH];
+    std::uint64_t delivered_[LANE_WIDTH] = {};
+};
+
+// Stan końcowy replications replikacji po d turach (replikacja r w pasie r % LANE_WIDTH
+// partii r / LANE_WIDTH)
+std::vector<FactorySnapshot> simulate_lane_replications(const Factory& factory, TimeOffset d,
+                                                        std::size_t replications, std::uint64_t seed = 1);
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "package.hpp"
+#include "types.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+enum class LineageNode : std::uint8_t {
+    RAMP,
+    WORKER,
+    STOREHOUSE
+};
+
+enum class LineageEvent : std::uint8_t {
+    CREATED,   // paczka powstała na rampie
+    ENQUEUED,  // trafiła do kolejki robotnika
+    STARTED,   // robotnik zaczął ją przetwarzać
+    SENT,      // opuściła bufor wysyłkowy nadawcy
+    STORED     // dotarła do magazynu
+};
+
+// Jeden przeskok śledzonej paczki
+struct LineageRecord {
+    std::uint32_t trace_id;
+    ElementID package_id;
+    Time turn;
+    ElementID node_id;
+    LineageNode node;
+    LineageEvent event;
+};
+
+// Bufor cykliczny jeden producent / jeden konsument bez blokad. Symulacja dopisuje,
+// eksport może czytać z innego wątku. Przy pełnym buforze rekord jest odrzucany.
+class LineageRing {
+public:
+    // Pojemność zaokrąglana w górę do potęgi dwójki
+    explicit LineageRing(std::size_t capacity);
+
+    bool try_push(const LineageRecord& record) {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == slots_.size()) {
+            return false;
+        }
+        slots_[head & mask_] = record;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(LineageRecord& record) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        record = slots_[tail & mask_];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t capacity() const { return slots_.size(); }
+
+private:
+    std::vector<LineageRecord> slots_;
+    std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+// Śledzi co sample_every-tą paczkę utworzoną na rampach (0 - żadnej) i zapisuje
+// jej przeskoki. Numery śledzenia trzyma gęsta tablica indeksowana ID paczki (ID są
+// przydzielane od najmniejszego wolnego, więc rozmiar ogranicza szczyt żywych paczek),
+// a Package nie rośnie. Bez podpiętego śledzenia przeskok kosztuje jedno porównanie
+// wskaźnika, z podpiętym - sprawdzenie zakresu i odczyt z tablicy, bez haszowania.
+class LineageTracer {
+public:
+    explicit LineageTracer(std::uint32_t sample_every, std::size_t ring_capacity = std::size_t{1} << 16);
+
+    void set_turn(Time t) { turn_ = t; }
+    Time get_turn() const { return turn_; }
+
+    void on_created(const Package& p, ElementID ramp_id) {
+        if (sample_every_ == 0 || created_++ % sample_every_ != 0) {
+            if (p.get_id() < trace_by_id_.size()) {
+                trace_by_id_[p.get_id()] = 0;   // ID zwolnionej paczki użyte ponownie
+            }
+            return;
+        }
+        slot(p.get_id()) = ++last_trace_id_;
+        record(p, LineageEvent::CREATED, LineageNode::RAMP, ramp_id);
+    }
+
+    // Numer śledzenia paczki (0 - paczka nieśledzona). W przeciwieństwie do ID nie jest
+    // używany ponownie.
+    std::uint32_t trace_id(const Package& p) const {
+        return p.get_id() < trace_by_id_.size() ? trace_by_id_[p.get_id()] : 0;
+    }
+
+    // Paczka odtworzona poza rampą (np. przekazana z innego procesu) przejmuje numer
+    void adopt(const Package& p, std::uint32_t trace_id) {
+        if (trace_id != 0) {
+            slot(p.get_id()) = trace_id;
+        } else if (p.get_id() < trace_by_id_.size()) {
+            trace_by_id_[p.get_id()] = 0;
+        }
+    }
+
+    // Zapisuje przeskok, jeśli paczka jest śledzona
+    void record(const Package& p, LineageEvent event, LineageNode node, ElementID node_id) {
+        const std::uint32_t trace = trace_id(p);
+        if (trace == 0) {
+            return;
+        }
+        if (!ring_.try_push(LineageRecord{trace, p.get_id(), turn_, node_id, node, event})) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Strona konsumenta: przenosi zebrane rekordy na koniec out, zwraca ich liczbę
+    std::size_t drain(std::vector<LineageRecord>& out);
+
+    // Opróżnia bufor i wypisuje trasy zebrane od poprzedniego eksportu jako CSV,
+    // pogrupowane po numerze śledzenia (przeskoki w kolejności wystąpienia). Wypisane
+    // rekordy są zwalniane - tracer nie trzyma historii całego przebiegu.
+    void export_routes(std::ostream& os);
+
+    std::uint32_t traced_count() const { return last_trace_id_; }
+    std::uint32_t sample_every() const { return sample_every_; }
+    std::uint64_t created_count() const { return created_; }
+
+    // Ustawia pozycję w globalnym ciągu utworzeń paczek (shard symulacji podzielonej
+    // widzi tylko swoje rampy) - próbkowanie i numery śledzenia jak w jednym procesie
+    void skip_to(std::uint64_t created);
+
+    // Dołącza rekordy zebrane przez inny tracer (np. w procesie shardu) po rekordach
+    // z własnego bufora, do najbliższego eksportu; created i dropped - stan tamtego tracera
+    void merge(const std::vector<LineageRecord>& records, std::uint64_t created, std::uint64_t dropped);
+    std::uint64_t dropped_count() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    std::uint32_t& slot(ElementID id) {
+        if (id >= trace_by_id_.size()) {
+            trace_by_id_.resize(id + 1, 0);
+        }
+        return trace_by_id_[id];
+    }
+
+    std::uint32_t sample_every_;
+    std::uint64_t created_ = 0;
+    std::uint32_t last_trace_id_ = 0;
+    std::vector<std::uint32_t> trace_by_id_;   // ID paczki -> numer śledzenia (0 - brak)
+    Time turn_ = 0;
+    LineageRing ring_;
+    std::atomic<std::uint64_t> dropped_{0};
+    std::vector<LineageRecord> history_;
+};
+
+const char* to_string(LineageEvent event);
+const char* to_string(LineageNode node);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+// Gniazda strumieniowe na lokalnej maszynie (eksporter metryk, netsimd). Błędy
+// otwarcia zgłaszane jako std::runtime_error.
+
+// Nasłuch na gnieździe uniksowym (istniejący plik gniazda jest usuwany)
+int open_unix_socket(const std::string& path);
+
+// Nasłuch na 127.0.0.1; port 0 - dowolny wolny, numer zwracany przez port
+int open_tcp_socket(int& port);
+
+int connect_unix_socket(const std::string& path);
+
+// Wysyła całość (false, gdy druga strona zamknęła połączenie)
+bool write_all(int fd, const std::string& data);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "factory.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Eksporter metryk w formacie tekstowym Prometheusa. Symulacja zapisuje wartości
+// do atomików (memory_order_relaxed), a osobny wątek obsługuje zapytania HTTP na
+// gnieździe - odczyt nigdy nie wstrzymuje pętli tur. Szacunek pamięci przechodzi
+// wszystkie węzły, więc update() liczy go tylko po zapytaniu HTTP - zapytanie
+// dostaje wartości z pierwszej aktualizacji po poprzednim zapytaniu.
+// address: "unix:<ścieżka>" albo "tcp:<port>" (tylko 127.0.0.1; port 0 - dowolny wolny)
+class MetricsExporter {
+public:
+    // interval - co ile tur odświeżać stan robotników i magazynów (numer tury zawsze)
+    MetricsExporter(const std::string& address, const Factory& factory, TimeOffset interval = 1);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // Struktura fabryki nie może się zmieniać od utworzenia eksportera
+    void update(const Factory& factory, Time t);
+
+    void update_if_due(const Factory& factory, Time t) {
+        if (interval_ != 0 && t % interval_ == 0) {
+            update(factory, t);
+        } else {
+            turn_.store(t, std::memory_order_relaxed);
+        }
+    }
+
+    // Aktualne metryki w formacie ekspozycji Prometheusa
+    std::string render() const;
+
+    // Port TCP, na którym nasłuchuje eksporter (0 dla gniazda uniksowego)
+    int port() const { return port_; }
+
+private:
+    void serve();
+
+    TimeOffset interval_;
+    std::vector<ElementID> worker_ids_;      // po ID, jak w raportach
+    std::vector<ElementID> storehouse_ids_;  // w kolejności kolekcji
+    std::vector<ElementID> ramp_ids_;        // w kolejności kolekcji
+
+    std::atomic<Time> turn_{0};
+    std::atomic<std::uint64_t> packages_in_flight_{0};
+    std::unique_ptr<std::atomic<std::uint32_t>[]> queue_lengths_;
+    std::unique_ptr<std::atomic<std::uint8_t>[]> busy_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> worker_blocked_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> stock_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> ramp_blocked_;
+    std::vector<const char*> memory_components_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> memory_bytes_;
+    std::atomic<bool> memory_requested_{true};
+    std::chrono::steady_clock::time_point started_;
+
+    std::string unix_path_;
+    int port_ = 0;
+    int listen_fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread server_;
+};
@@ -3,6 +3,7 @@
 #include "types.hpp"
 #include "helpers.hpp"
 #include "package.hpp"
+#include "lineage.hpp"
 
 #include <map>
 #include <utility>
@@ -10,6 +11,8 @@
 #include <algorithm>
 #include <memory>
 #include <optional>
+#include <stdexcept>
+#include <vector>
 
 enum class ReceiverType {
     STOREHOUSE,
@@ -28,14 +31,30 @@ class IPackageReceiver {
 
         virtual ReceiverType get_receiver_type() const { return ReceiverType::WORKER; }
 
+        // false - odbiorca jest pełny i nadawca musi zatrzymać paczkę u siebie
+        virtual bool can_receive() const { return true; }
+
         virtual ~IPackageReceiver() = default;
     };
   
 
 
+// Kolejność odbiorców: magazyny, potem robotnicy; rosnąco po ID. Nie zależy od adresów
+// w pamięci, więc routing z tym samym ziarnem jest powtarzalny między procesami.
+struct ReceiverOrder {
+    bool operator()(const IPackageReceiver* a, const IPackageReceiver* b) const {
+        bool a_store = a->get_receiver_type() == ReceiverType::STOREHOUSE;
+        bool b_store = b->get_receiver_type() == ReceiverType::STOREHOUSE;
+        if (a_store != b_store) {
+            return a_store;
+        }
+        return a->get_id() < b->get_id();
+    }
+};
+
 class ReceiverPreferences {
     public:
-        using preferences_t = std::map<IPackageReceiver*, double>;
+        using preferences_t = std::map<IPackageReceiver*, double, ReceiverOrder>;
         using const_iterator = preferences_t::const_iterator;
 
         ReceiverPreferences(ProbabilityGenerator pg = probability_generator) : preferences_(), generate_probability_(std::move(pg)) {}
@@ -43,18 +62,58 @@ class ReceiverPreferences {
         void add_receiver(IPackageReceiver* r);
         void remove_receiver(IPackageReceiver* r);
 
+        // Wersje hurtowe - prawdopodobieństwa przeliczane raz, po całym zakresie
+        template <typename InputIt>
+        void add_receivers(InputIt first, InputIt last) {
+            for (; first != last; ++first) {
+                preferences_[*first] = 0.0;
+            }
+            normalize();
+        }
+        template <typename Range>
+        void add_receivers(const Range& receivers) { add_receivers(std::begin(receivers), std::end(receivers)); }
+
+        template <typename InputIt>
+        void remove_receivers(InputIt first, InputIt last) {
+            for (; first != last; ++first) {
+                preferences_.erase(*first);
+            }
+            normalize();
+        }
+        template <typename Range>
+        void remove_receivers(const Range& receivers) { remove_receivers(std::begin(receivers), std::end(receivers)); }
+        // Zastępuje odbiorców podanymi parami (odbiorca, prawdopodobieństwo) bez normalizacji,
+        // np. przy odtwarzaniu zapisanej tablicy routingu
+        void set_receivers(const std::vector<std::pair<IPackageReceiver*, double>>& weighted);
+        // Podmienia odbiorcę, zachowując jego prawdopodobieństwo (np. po przeniesieniu węzła)
+        void replace_receiver(IPackageReceiver* old_r, IPackageReceiver* new_r);
+
         IPackageReceiver* choose_receiver() const;
 
+        void set_probability_generator(ProbabilityGenerator pg) { generate_probability_ = std::move(pg); }
+        const ProbabilityGenerator& get_probability_generator() const { return generate_probability_; }
+
         const preferences_t& get_preferences() const { return preferences_; }
 
+        // Odbiorcy w kolejności ReceiverOrder jako wektor (np. do indeksowania w logu routingu).
+        // Wynik jest pamiętany do najbliższej zmiany listy odbiorców.
+        const std::vector<IPackageReceiver*>& sorted_receivers() const;
+        std::size_t sorted_receivers_capacity() const { return sorted_receivers_.capacity(); }
+
         const_iterator cbegin() const  { return preferences_.cbegin(); }
         const_iterator cend() const  { return preferences_.cend(); }
         const_iterator begin() const  { return preferences_.begin(); }
         const_iterator end() const  { return preferences_.end(); }
 
     private:
+        // Równe prawdopodobieństwa dla wszystkich odbiorców
+        void normalize();
+
         preferences_t preferences_;
         ProbabilityGenerator generate_probability_;
+
+        mutable std::vector<IPackageReceiver*> sorted_receivers_;
+        mutable bool sorted_receivers_valid_ = false;
 };
 
 
@@ -64,6 +123,9 @@ class Storehouse : public IPackageReceiver {
     Storehouse(ElementID id, std::unique_ptr<IPackageStockpile> d = std::make_unique<PackageQueue>(PackageQueueType::FIFO));
     
     void receive_package(Package&& p) override {
+        if (tracer_ != nullptr) {
+            tracer_->record(p, LineageEvent::STORED, LineageNode::STOREHOUSE, id_);
+        }
         d_->push(std::move(p));
     }
     ElementID get_id() const override {
@@ -81,11 +143,16 @@ class Storehouse : public IPackageReceiver {
     IPackageStockpile::const_iterator end() const override {
         return d_->end();
     }
+    std::size_t size() const {
+        return d_->size();
+    }
     
     ReceiverType get_receiver_type() const override {
         return ReceiverType::STOREHOUSE;
     }
 
+    void set_tracer(LineageTracer* tracer) { tracer_ = tracer; }
+
     ~Storehouse() override = default;
 
     Storehouse(Storehouse&&) = default;
@@ -94,6 +161,7 @@ class Storehouse : public IPackageReceiver {
   private:
     ElementID id_;
     std::unique_ptr<IPackageStockpile> d_;
+    LineageTracer* tracer_ = nullptr;
 };
 
 
@@ -104,14 +172,47 @@ class PackageSender {
         PackageSender(PackageSender&& p) = default;
         
         void send_package();
+
+        // Wysyła do wskazanego odbiorcy; gdy ten jest pełny, paczka zostaje w buforze
+        // (tura liczy się jako zablokowana). Zwraca true, jeśli paczka wyszła.
+        bool send_package_to(IPackageReceiver* receiver);
     
         const std::optional<Package>& get_sending_buffer() const { return buffer_; };
+
+        std::size_t get_blocked_turns() const { return blocked_turns_; }
+
+        // Zabiera paczkę z bufora bez wysyłania (np. do przekazania poza proces)
+        Package release_package();
+
+        // node i id opisują nadawcę w zapisanych przeskokach
+        void set_tracer(LineageTracer* tracer, LineageNode node, ElementID id) {
+            tracer_ = tracer;
+            trace_node_ = node;
+            trace_node_id_ = id;
+        }
     
         ReceiverPreferences receiver_preferences_;
     protected:
-        void push_package(Package&& p) { buffer_ = std::move(p); }
+        // Pełnego bufora nie wolno nadpisać - nadawca czeka, aż paczka wyjdzie
+        void push_package(Package&& p) {
+            if (buffer_) {
+                throw std::logic_error("Sending buffer is full");
+            }
+            buffer_ = std::move(p);
+        }
+
+        void trace(const Package& p, LineageEvent event) const {
+            if (tracer_ != nullptr) {
+                tracer_->record(p, event, trace_node_, trace_node_id_);
+            }
+        }
     
         std::optional<Package> buffer_ = std::nullopt;
+        std::size_t blocked_turns_ = 0;
+
+        LineageTracer* tracer_ = nullptr;
+        LineageNode trace_node_ = LineageNode::RAMP;
+        ElementID trace_node_id_ = 0;
     };
 
 class Ramp : public PackageSender {
@@ -121,8 +222,15 @@ class Ramp : public PackageSender {
     
         ElementID get_id() const { return id_; }
         TimeOffset get_delivery_interval() const { return delivery_interval_; }
+        void set_delivery_interval(TimeOffset di) { delivery_interval_ = di; }
 
         void deliver_goods(Time t);
+
+        // Liczba paczek wprowadzonych do fabryki przez rampę
+        std::size_t get_delivered_count() const { return delivered_; }
+
+        // Rejestr ID nowych paczek (domyślnie globalny)
+        void set_package_id_allocator(PackageIdAllocator& ids) { ids_ = &ids; }
     
         ~Ramp() = default;
 
@@ -131,23 +239,104 @@ class Ramp : public PackageSender {
     private:
         ElementID id_;
         TimeOffset delivery_interval_;
+        std::size_t delivered_ = 0;
+        PackageIdAllocator* ids_ = &PackageIdAllocator::global();
     };
 
+// Zbiór robotników, którzy mają coś do zrobienia (kolejka, przetwarzanie albo pełny
+// bufor wysyłkowy). Sloty odpowiadają kolejności robotników w fabryce, a slots()
+// zwraca je rosnąco, więc obsługa aktywnych zachowuje kolejność pełnego przeglądu.
+class ActiveWorkerSet {
+public:
+    void reset(std::size_t slot_count) {
+        flags_.assign(slot_count, 0);
+        active_.clear();
+        pending_.clear();
+    }
+
+    void activate(std::size_t slot) {
+        if (!flags_[slot]) {
+            flags_[slot] = 1;
+            pending_.push_back(slot);
+        }
+    }
+
+    // Aktywne sloty w kolejności rosnącej (dołącza aktywowanych od ostatniego wywołania)
+    const std::vector<std::size_t>& slots() {
+        if (!pending_.empty()) {
+            std::sort(pending_.begin(), pending_.end());
+            auto middle = static_cast<std::ptrdiff_t>(active_.size());
+            active_.insert(active_.end(), pending_.begin(), pending_.end());
+            std::inplace_merge(active_.begin(), active_.begin() + middle, active_.end());
+            pending_.clear();
+        }
+        return active_;
+    }
+
+    template <typename IsIdle>
+    void deactivate_if(IsIdle&& is_idle) {
+        slots();
+        active_.erase(std::remove_if(active_.begin(), active_.end(), [&](std::size_t slot) {
+                          if (is_idle(slot)) {
+                              flags_[slot] = 0;
+                              return true;
+                          }
+                          return false;
+                      }),
+                      active_.end());
+    }
+
+    std::size_t size() const { return active_.size() + pending_.size(); }
+
+    std::size_t memory_bytes() const {
+        return flags_.capacity() + (active_.capacity() + pending_.capacity()) * sizeof(std::size_t);
+    }
+
+private:
+    std::vector<char> flags_;
+    std::vector<std::size_t> active_;
+    std::vector<std::size_t> pending_;
+};
+
 class Worker : public PackageSender, public IPackageReceiver {
 public:
-    Worker(ElementID id, TimeOffset pd, std::unique_ptr<IPackageQueue> q)
-        : id_(id), pd_(pd), queue_(std::move(q)) {}
+    // queue_capacity == 0 - kolejka bez limitu
+    Worker(ElementID id, TimeOffset pd, std::unique_ptr<IPackageQueue> q, std::size_t queue_capacity = 0)
+        : id_(id), pd_(pd), queue_(std::move(q)), queue_capacity_(queue_capacity) {}
 
     ElementID get_id() const override { return id_; }
 
-    void receive_package(Package&& p) override { queue_->push(std::move(p)); }
+    void receive_package(Package&& p) override {
+        trace(p, LineageEvent::ENQUEUED);
+        queue_->push(std::move(p));
+        if (activity_ != nullptr) {
+            activity_->activate(activity_slot_);
+        }
+    }
+
+    // Podpięcie pod zbiór aktywnych robotników fabryki
+    void attach_activity(ActiveWorkerSet* activity, std::size_t slot) {
+        activity_ = activity;
+        activity_slot_ = slot;
+    }
+
+    bool is_idle() const { return !processing_buffer_ && !buffer_ && queue_->empty(); }
+
+    bool can_receive() const override { return queue_capacity_ == 0 || queue_->size() < queue_capacity_; }
+    std::size_t get_queue_capacity() const { return queue_capacity_; }
+    void set_queue_capacity(std::size_t capacity) { queue_capacity_ = capacity; }
 
     void do_work(Time t);
 
+    // Zabiera wszystkie paczki robotnika: przetwarzaną, z kolejki i z bufora wysyłkowego
+    std::vector<Package> release_all_packages();
+
     IPackageQueue* get_queue() const { return queue_.get(); }
 
     const std::optional<Package>& get_processing_buffer() const { return processing_buffer_; }
     TimeOffset get_processing_duration() const { return pd_; }
+    // Paczka w trakcie przetwarzania kończy się według nowego czasu (lub od razu, gdy już go przekroczyła)
+    void set_processing_duration(TimeOffset pd) { pd_ = pd; }
     Time get_package_processing_start_time() const { return t_; }
 
     IPackageStockpile::const_iterator cbegin() const override { return queue_->cbegin(); }
@@ -161,8 +350,12 @@ private:
     ElementID id_;
     TimeOffset pd_;
     std::unique_ptr<IPackageQueue> queue_;
+    std::size_t queue_capacity_;
 
     Time t_{0};
     std::optional<Package> processing_buffer_ = std::nullopt;
+
+    ActiveWorkerSet* activity_ = nullptr;
+    std::size_t activity_slot_ = 0;
 };
 
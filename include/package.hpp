@@ -1,33 +1,88 @@
 #pragma once
 
 #include "types.hpp"
+#include <cstdint>
 #include <utility>
 #include <set>
 
-class Package {
+// Rejestr ID paczek: przydziela najmniejsze zwolnione ID, a gdy takich nie ma - o jeden
+// większe od największego zajętego. Domyślny rejestr global() jest wspólny dla procesu;
+// przebieg, który ma dostać ID jak w świeżym procesie (netsimd, run_uncached()), używa
+// własnego rejestru podpiętego przez Factory::set_package_id_allocator().
+// Rejestr musi przeżyć swoje paczki (sprawdzane asercją w destruktorze - numer rejestru
+// po zniszczeniu dostaje kolejny rejestr) i nie jest bezpieczny wątkowo - jeden przebieg
+// korzysta z niego w jednym wątku naraz.
+class PackageIdAllocator {
 public:
-    Package(ElementID id) : id_(id) {
-        assigned_IDs.insert(id_);
-        if (freed_IDs.count(id_)) {
-            freed_IDs.erase(id_);
-        }
-    }
+    PackageIdAllocator();
+    ~PackageIdAllocator();
 
-    Package() {
-        if (freed_IDs.empty()) {
-            if (assigned_IDs.empty()) {
-                id_ = 1;
-            } else {
-                id_ = *assigned_IDs.rbegin() + 1;
-            }
+    PackageIdAllocator(const PackageIdAllocator&) = delete;
+    PackageIdAllocator& operator=(const PackageIdAllocator&) = delete;
+
+    static PackageIdAllocator& global();
+
+    ElementID allocate() {
+        ElementID id;
+        if (next_ != -1) {
+            id = next_;
+            next_ = -1;
+            freed_IDs.erase(id);
+        } else if (freed_IDs.empty()) {
+            id = assigned_IDs.empty() ? 1 : *assigned_IDs.rbegin() + 1;
         } else {
-            id_ = *freed_IDs.begin();
-            freed_IDs.erase(id_);
+            id = *freed_IDs.begin();
+            freed_IDs.erase(freed_IDs.begin());
         }
-        assigned_IDs.insert(id_);
+        assigned_IDs.insert(id);
+        return id;
+    }
+
+    void reserve(ElementID id) {
+        assigned_IDs.insert(id);
+        freed_IDs.erase(id);
+    }
+
+    void release(ElementID id) {
+        assigned_IDs.erase(id);
+        freed_IDs.insert(id);
     }
 
-    Package(Package&& other) noexcept : id_(other.id_) {
+    // Następne allocate() zwraca id - ID z zewnętrznego harmonogramu (np. globalna
+    // numeracja w shardzie symulacji podzielonej); id nie może być zajęte
+    void advance_to(ElementID id) { next_ = id; }
+
+    // Liczności zbiorów ID (do szacowania pamięci)
+    std::size_t assigned_count() const { return assigned_IDs.size(); }
+    std::size_t freed_count() const { return freed_IDs.size(); }
+
+    // Paczka pamięta rejestr jako 32-bitowy numer, nie wskaźnik
+    std::uint32_t handle() const { return handle_; }
+    static PackageIdAllocator& from_handle(std::uint32_t handle);
+
+private:
+    struct GlobalTag {};
+    explicit PackageIdAllocator(GlobalTag) : handle_(0) {}
+
+    std::set<ElementID> assigned_IDs;
+    std::set<ElementID> freed_IDs;
+    ElementID next_ = -1;
+    std::uint32_t handle_;
+};
+
+class Package {
+public:
+    Package(ElementID id) : Package(id, PackageIdAllocator::global()) {}
+
+    Package(ElementID id, PackageIdAllocator& ids) : id_(id), ids_(ids.handle()) {
+        ids.reserve(id_);
+    }
+
+    Package() : Package(PackageIdAllocator::global()) {}
+
+    explicit Package(PackageIdAllocator& ids) : id_(ids.allocate()), ids_(ids.handle()) {}
+
+    Package(Package&& other) noexcept : id_(other.id_), ids_(other.ids_) {
         other.id_ = -1;
     }
 
@@ -35,12 +90,12 @@ public:
         if (this != &other) {
 
             if (id_ != -1) {
-                assigned_IDs.erase(id_);
-                freed_IDs.insert(id_);
+                PackageIdAllocator::from_handle(ids_).release(id_);
             }
-            
+
             id_ = other.id_;
-            
+            ids_ = other.ids_;
+
             other.id_ = -1;
         }
         return *this;
@@ -61,16 +116,18 @@ public:
         return id_;
     }
 
+    // Liczności zbiorów ID rejestru globalnego (do szacowania pamięci)
+    static std::size_t assigned_id_count() { return PackageIdAllocator::global().assigned_count(); }
+    static std::size_t freed_id_count() { return PackageIdAllocator::global().freed_count(); }
+
     ~Package() {
- 
-        if (id_ != -1) { 
-            assigned_IDs.erase(id_);
-            freed_IDs.insert(id_);
+
+        if (id_ != -1) {
+            PackageIdAllocator::from_handle(ids_).release(id_);
         }
     }
 
 private:
     ElementID id_ = -1;
-    inline static std::set<ElementID> assigned_IDs;
-    inline static std::set<ElementID> freed_IDs; 
+    std::uint32_t ids_ = 0;   // PackageIdAllocator::handle()
 };
\ No newline at end of file
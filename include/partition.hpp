@@ -0,0 +1,49 @@
+#pragma once
+
+#include "factory.hpp"
+#include "snapshot.hpp"
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <string>
+
+// Przydział węzłów (ramp, robotników, magazynów) do shardów
+using ShardAssignment = std::map<NodeKey, int>;
+
+// Dzieli fabrykę na shard_count kawałków: węzły w kolejności przepływu (BFS od ramp)
+// trafiają do kolejnych, równolicznych shardów, więc sąsiedzi zwykle lądują razem.
+ShardAssignment partition_factory(const Factory& factory, int shard_count);
+// To samo wprost z tekstowego pliku struktury - bez budowania fabryki
+ShardAssignment partition_structure(std::istream& structure, int shard_count);
+
+struct PartitionedRun {
+    FactorySnapshot snapshot;   // stan po ostatniej turze
+    std::string report;         // generate_simulation_report() po ostatniej turze
+};
+
+// Symulacja podzielona na procesy: każdy shard (program netsim_shard uruchamiany przez
+// fork() i exec(), więc wywołujący może mieć inne wątki) dostaje przez gniazdo plan
+// ze swoimi węzłami i buduje z niego własną fabrykę - odbiorcy z innych shardów
+// są w niej tylko zastępcami o tym samym typie i ID. Paczki przechodzące między shardami
+// są wymieniane raz na turę przez gniazda uniksowe (koordynatorem jest proces wywołujący).
+// Routing korzysta z Factory::seed_routing(seed), a paczki trafiają do odbiorców
+// w kolejności nadawców. ID paczek wynikają z globalnego harmonogramu dostaw ramp, więc
+// stan i raport są identyczne jak w simulate() po seed_routing(seed) na pustej fabryce
+// z własnym PackageIdAllocator. Przebieg zaczyna od pustego stanu (tylko struktura).
+// Trasy paczek trafiają do LineageTracer podpiętego do fabryki (numeracja jak w jednym
+// procesie); poza tym fabryka wywołującego nie jest modyfikowana.
+// Program shardu: zmienna środowiskowa NETSIM_SHARD albo netsim_shard w katalogu
+// bieżącego programu.
+PartitionedRun simulate_partitioned(const Factory& factory, TimeOffset d,
+                                    const ShardAssignment& assignment, std::uint64_t seed);
+
+// Jak wyżej, ale plany shardów powstają wiersz po wierszu z tekstowego pliku struktury -
+// koordynator nie buduje fabryki, a każdy shard dostaje tylko swoje węzły. Trasy paczek
+// trafiają do tracer (nullptr - bez śledzenia).
+PartitionedRun simulate_partitioned(std::istream& structure, TimeOffset d, const ShardAssignment& assignment,
+                                    std::uint64_t seed, LineageTracer* tracer = nullptr);
+
+// Strona shardu (main programu netsim_shard): plan, d tur wymiany paczek i stan końcowy
+// przez gniazdo fd. Zwraca kod wyjścia procesu.
+int run_shard(int fd);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "fluid.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Prawdopodobieństwo, że kolejka robotnika osiągnie próg w ciągu horyzontu, metodą
+// podziału wielopoziomowego ze stałym nakładem (fixed effort): na każdym poziomie
+// pośrednim biegnie effort trajektorii startujących z losowo (ze zwracaniem) wybranych
+// stanów, w których poprzedni poziom został przekroczony. Stan to kopia FluidFactory
+// z paczkami pojedynczymi (batch_size = 1, liczności jak w simulate() dla kolejek bez
+// limitu), a każda gałąź dostaje własne ziarno (FluidFactory::reseed).
+// Estymata to iloczyn częstości warunkowych - nieobciążona; przedział ufności z
+// replications niezależnych powtórzeń całego estymatora.
+struct SplittingOptions {
+    ElementID worker = 1;
+    std::size_t threshold = 10;        // zdarzenie: długość kolejki >= threshold na koniec tury
+    TimeOffset horizon = 480;
+    // Rosnące poziomy pośrednie poniżej threshold; puste - level_count poziomów co threshold / level_count
+    std::vector<std::size_t> levels;
+    std::size_t level_count = 4;
+    std::size_t effort = 200;          // trajektorie na poziom
+    std::size_t replications = 10;
+    std::uint64_t seed = 1;
+    double confidence = 0.95;
+};
+
+struct RareEventEstimate {
+    double probability = 0.0;
+    double half_width = 0.0;
+    std::size_t replications = 0;
+    // Średnie częstości przejścia na kolejne poziomy (ostatni - do threshold)
+    std::vector<double> level_probabilities;
+    std::uint64_t simulated_turns = 0;   // łączny koszt wszystkich trajektorii
+};
+
+RareEventEstimate estimate_overflow_probability(const Factory& factory, const SplittingOptions& options);
+
+// Zwykłe powtórzenia (runs przebiegów) - do porównania kosztu i poprawności
+RareEventEstimate estimate_overflow_brute_force(const Factory& factory, const SplittingOptions& options,
+                                                std::size_t runs);
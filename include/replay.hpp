@@ -0,0 +1,47 @@
+#pragma once
+
+#include "factory.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// Zapis decyzji routingu: dla każdej tury i każdego nadawcy z pełnym buforem indeks
+// wybranego odbiorcy (w kolejności ReceiverPreferences::sorted_receivers()) na
+// ceil(log2 k) bitach oraz po jednym bicie "dostawa" dla każdej rampy.
+class RoutingLog {
+public:
+    void write(std::uint32_t value, unsigned bits);
+    std::uint32_t read(std::uint64_t& cursor, unsigned bits) const;
+
+    std::uint64_t bit_count() const { return bit_count_; }
+    std::size_t byte_size() const { return (bit_count_ + 7) / 8; }
+
+    TimeOffset turns() const { return turns_; }
+    std::uint64_t structure_hash() const { return structure_hash_; }
+
+    void save(std::ostream& os) const;
+    static RoutingLog load(std::istream& is);
+
+private:
+    friend RoutingLog record_simulation(Factory&, TimeOffset, const std::function<void(Factory&, TimeOffset)>&);
+
+    std::vector<std::uint64_t> words_;
+    std::uint64_t bit_count_ = 0;
+    TimeOffset turns_ = 0;
+    std::uint64_t structure_hash_ = 0;
+};
+
+// Skrót struktury (kolejność nadawców i ich odbiorców, interwały dostaw, czasy
+// przetwarzania, typy i pojemności kolejek) - log pasuje tylko do tej samej struktury
+std::uint64_t routing_structure_hash(const Factory& factory);
+
+// Zwykła symulacja (jak simulate()), która dodatkowo zapisuje każdą decyzję routingu
+RoutingLog record_simulation(Factory& factory, TimeOffset d,
+                             const std::function<void(Factory&, TimeOffset)>& rf);
+
+// Odtwarza symulację z logu bez losowania; rzuca std::runtime_error, gdy stan się rozjedzie
+void replay_simulation(Factory& factory, const RoutingLog& log,
+                       const std::function<void(Factory&, TimeOffset)>& rf);
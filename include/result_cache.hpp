@@ -0,0 +1,72 @@
+#pragma once
+
+#include "factory.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <string>
+
+// Pamięć podręczna wyników symulacji adresowana treścią. Klucz to skrót FNV-1a (64 bity)
+// z kanonicznego opisu struktury i parametrów przebiegu; liczby podawane są bajt po
+// bajcie (little-endian, prawdopodobieństwa jako bity IEEE-754), więc klucz nie zależy
+// od adresów w pamięci, procesu ani kompilacji. Losowania routingu pochodzą z
+// RoutingStream, który nie korzysta z rozkładów biblioteki standardowej, a jego numer
+// algorytmu wchodzi do klucza przebiegu. Zmiana semantyki symulacji wymaga
+// podbicia RESULT_CACHE_VERSION - stare wpisy przestają wtedy pasować.
+constexpr std::uint32_t RESULT_CACHE_VERSION = 3;
+
+// Skrót struktury: węzły w kolejności kolekcji (kolejność obsługi wpływa na wynik) z
+// parametrami, połączenia w kolejności ReceiverOrder z prawdopodobieństwami
+std::uint64_t structure_hash(const Factory& factory);
+
+struct RunParameters {
+    std::uint64_t seed = 1;              // Factory::seed_routing(seed)
+    TimeOffset horizon = 0;              // liczba tur
+    TimeOffset report_interval = 0;      // raport co tyle tur (0 - brak)
+    std::set<Time> report_turns;         // dodatkowe tury z raportem
+};
+
+std::uint64_t run_key(std::uint64_t structure_hash, const RunParameters& params);
+
+struct CachedRun {
+    std::string reports;   // generate_simulation_report() w kolejnych turach raportu
+    std::string metrics;   // stan końcowy w CSV: robotnicy, potem magazyny (po ID)
+    std::uint64_t key = 0;
+    bool hit = false;
+};
+
+// Przebieg zawsze zaczyna od pustej kopii struktury (stan paczek w fabryce wywołującego
+// jest pomijany) z własnym rejestrem ID paczek, więc ID są takie jak w świeżym procesie. Wynik trafia do pliku
+// <klucz>.nsr w katalogu (zapis przez plik tymczasowy i rename, więc równoległe procesy
+// nie widzą połowy wpisu); uszkodzony albo niepasujący plik traktowany jest jak brak wpisu.
+class ResultCache {
+public:
+    // Katalog tworzony w razie potrzeby
+    explicit ResultCache(std::string directory);
+
+    CachedRun run(const Factory& factory, const RunParameters& params);
+
+    std::optional<CachedRun> lookup(std::uint64_t key) const;
+
+    std::string path_for(std::uint64_t key) const;
+    const std::string& directory() const { return directory_; }
+
+    std::size_t hits() const { return hits_; }
+    std::size_t misses() const { return misses_; }
+
+private:
+    void store(const CachedRun& run) const;
+
+    std::string directory_;
+    std::size_t hits_ = 0;
+    std::size_t misses_ = 0;
+};
+
+// Przebieg bez pamięci podręcznej - to, co ResultCache::run() zapisuje przy braku wpisu
+CachedRun run_uncached(const Factory& factory, const RunParameters& params);
+
+// Jak run_uncached(), ale na podanej fabryce (świeżo wczytanej, bez paczek) - bez kopiowania.
+// ID paczek jak w świeżym procesie, jeśli fabryka ma własny, pusty rejestr ID.
+CachedRun simulate_run(Factory& factory, const RunParameters& params);
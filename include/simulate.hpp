@@ -3,8 +3,13 @@
 #include "factory.hpp"
 
 #include <functional>
+#include <limits>
 #include <set>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+constexpr Time NO_REPORT_TURN = std::numeric_limits<Time>::max();
 
 class IntervalReportNotifier {
 public:
@@ -14,6 +19,9 @@ public:
         return report_interval_ != 0 && (t % report_interval_ == 0);
     }
 
+    // Najbliższa tura >= t z raportem (NO_REPORT_TURN, gdy żadnej nie będzie)
+    Time next_report_turn(Time t) const;
+
 private:
     TimeOffset report_interval_;
 };
@@ -26,21 +34,133 @@ public:
         return report_turns_.count(t) > 0;
     }
 
+    Time next_report_turn(Time t) const;
+
 private:
     std::set<Time> report_turns_;
 };
 
+inline Time IntervalReportNotifier::next_report_turn(Time t) const {
+    if (report_interval_ == 0) {
+        return NO_REPORT_TURN;
+    }
+    Time remainder = t % report_interval_;
+    if (remainder == 0) {
+        return t;
+    }
+    return t > NO_REPORT_TURN - report_interval_ ? NO_REPORT_TURN : t + (report_interval_ - remainder);
+}
+
+inline Time SpecificTurnsReportNotifier::next_report_turn(Time t) const {
+    auto it = report_turns_.lower_bound(t);
+    return it == report_turns_.end() ? NO_REPORT_TURN : *it;
+}
+
+// Notyfikator dla szablonowego simulate(): Time next_report_turn(Time t) const
+template <typename Notifier, typename = void>
+struct is_report_notifier : std::false_type {};
+
+template <typename Notifier>
+struct is_report_notifier<Notifier, std::void_t<decltype(std::declval<const Notifier&>().next_report_turn(Time{}))>>
+    : std::is_convertible<decltype(std::declval<const Notifier&>().next_report_turn(Time{})), Time> {};
+
+// Symulacja krokowa - wywołujący sam decyduje, kiedy wykonać kolejną turę
+// (można przeplatać kilka symulacji albo przerwać po spełnieniu warunku).
+class SimulationRun {
+public:
+    explicit SimulationRun(Factory& factory, TimeOffset d = std::numeric_limits<TimeOffset>::max())
+        : factory_(factory), d_(d) {
+        if (!factory_.is_consistent()) {
+            throw std::logic_error("Non-consistent factory");
+        }
+    }
+
+    bool done() const { return t_ >= d_; }
+
+    // Numer ostatnio wykonanej tury (0 - jeszcze nic nie wykonano)
+    Time current_turn() const { return t_; }
+    TimeOffset duration() const { return d_; }
+
+    Factory& factory() { return factory_; }
+    const Factory& factory() const { return factory_; }
+
+    // Wykonuje jedną turę i zwraca jej numer
+    Time step() {
+        if (done()) {
+            throw std::logic_error("Simulation already finished");
+        }
+        ++t_;
+        factory_.do_deliveries(t_);
+        factory_.do_package_passing();
+        factory_.do_work(t_);
+        return t_;
+    }
+
+    // Wykonuje tury aż pred(factory, t) zwróci true albo skończy się czas symulacji.
+    // Zwraca numer ostatniej wykonanej tury.
+    template <typename Predicate>
+    Time run_until(Predicate&& pred) {
+        while (!done()) {
+            Time t = step();
+            if (pred(static_cast<const Factory&>(factory_), t)) {
+                break;
+            }
+        }
+        return t_;
+    }
+
+    // Wykonuje co najwyżej n kolejnych tur
+    Time run_for(TimeOffset n) {
+        for (TimeOffset i = 0; i < n && !done(); ++i) {
+            step();
+        }
+        return t_;
+    }
+
+private:
+    Factory& factory_;
+    TimeOffset d_;
+    Time t_{0};
+};
+
 inline void simulate(Factory& factory,
                      TimeOffset d,
                      const std::function<void(Factory&, TimeOffset)>& rf) {
-    if (!factory.is_consistent()) {
-        throw std::logic_error("Non-consistent factory");
+    SimulationRun run(factory, d);
+    while (!run.done()) {
+        Time t = run.step();
+        rf(factory, t);
+    }
+}
+
+// Dowolny obiekt wywoływalny zamiast std::function - wywołanie może zostać rozwinięte w miejscu
+template <typename ReportFunction,
+          typename = std::enable_if_t<std::is_invocable_v<ReportFunction&, Factory&, TimeOffset>>>
+void simulate(Factory& factory, TimeOffset d, ReportFunction&& rf) {
+    SimulationRun run(factory, d);
+    while (!run.done()) {
+        Time t = run.step();
+        rf(factory, t);
     }
+}
 
-    for (Time t = 1; t <= d; ++t) {
-        factory.do_deliveries(t);
-        factory.do_package_passing();
-        factory.do_work(t);
+// rf wywoływane tylko w turach wskazanych przez notyfikator; tury pomiędzy
+// wykonywane są jednym ciągiem, bez żadnych sprawdzeń po stronie raportowania.
+template <typename ReportFunction, typename Notifier>
+void simulate(Factory& factory, TimeOffset d, ReportFunction&& rf, const Notifier& notifier) {
+    static_assert(is_report_notifier<Notifier>::value, "Notifier must provide Time next_report_turn(Time) const");
+    SimulationRun run(factory, d);
+    Time next = notifier.next_report_turn(1);
+    while (!run.done()) {
+        if (next > run.current_turn() + 1) {
+            run.run_for(next == NO_REPORT_TURN ? run.duration() - run.current_turn() : next - run.current_turn() - 1);
+            continue;
+        }
+        Time t = run.step();
         rf(factory, t);
+        if (run.done()) {
+            break;
+        }
+        next = notifier.next_report_turn(t + 1);
     }
-}
\ No newline at end of file
+}
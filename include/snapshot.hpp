@@ -0,0 +1,129 @@
+#pragma once
+
+#include "factory.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Układ segmentu pamięci współdzielonej: nagłówek, tablica robotników, tablica magazynów,
+// tablica ramp.
+// Zapis chroniony seqlockiem - nieparzysty licznik oznacza zapis w toku.
+struct SnapshotHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::atomic<std::uint64_t> sequence;
+    std::int32_t turn;
+    std::uint32_t worker_capacity;
+    std::uint32_t storehouse_capacity;
+    std::uint32_t worker_count;
+    std::uint32_t storehouse_count;
+    std::uint32_t ramp_capacity;
+    std::uint32_t ramp_count;
+};
+
+struct WorkerSnapshot {
+    std::int32_t id;
+    std::uint32_t queue_length;
+    std::uint8_t busy;
+    std::uint8_t sending;
+    std::uint8_t padding[2];
+    std::uint32_t blocked_turns;
+};
+
+struct StorehouseSnapshot {
+    std::int32_t id;
+    std::uint32_t stock;
+};
+
+struct RampSnapshot {
+    std::int32_t id;
+    std::uint8_t loaded;   // paczka czeka w buforze rampy
+    std::uint8_t padding[3];
+    std::uint32_t blocked_turns;
+};
+
+constexpr std::uint32_t SNAPSHOT_MAGIC = 0x4E53494D;  // "NSIM"
+constexpr std::uint32_t SNAPSHOT_VERSION = 3;
+
+// Odczytany, spójny stan fabryki
+struct FactorySnapshot {
+    Time turn = 0;
+    std::vector<WorkerSnapshot> workers;
+    std::vector<StorehouseSnapshot> storehouses;
+    std::vector<RampSnapshot> ramps;   // w kolejności kolekcji
+};
+
+inline WorkerSnapshot make_worker_snapshot(const Worker& w) {
+    return WorkerSnapshot{w.get_id(), static_cast<std::uint32_t>(w.get_queue()->size()),
+                          static_cast<std::uint8_t>(w.get_processing_buffer().has_value()),
+                          static_cast<std::uint8_t>(w.get_sending_buffer().has_value()), {0, 0},
+                          static_cast<std::uint32_t>(w.get_blocked_turns())};
+}
+
+inline StorehouseSnapshot make_storehouse_snapshot(const Storehouse& s) {
+    return StorehouseSnapshot{s.get_id(), static_cast<std::uint32_t>(s.size())};
+}
+
+inline RampSnapshot make_ramp_snapshot(const Ramp& r) {
+    return RampSnapshot{r.get_id(), static_cast<std::uint8_t>(r.get_sending_buffer().has_value()), {0, 0, 0},
+                        static_cast<std::uint32_t>(r.get_blocked_turns())};
+}
+
+inline bool operator==(const WorkerSnapshot& a, const WorkerSnapshot& b) {
+    return a.id == b.id && a.queue_length == b.queue_length && a.busy == b.busy && a.sending == b.sending
+           && a.blocked_turns == b.blocked_turns;
+}
+
+inline bool operator==(const StorehouseSnapshot& a, const StorehouseSnapshot& b) {
+    return a.id == b.id && a.stock == b.stock;
+}
+
+inline bool operator==(const RampSnapshot& a, const RampSnapshot& b) {
+    return a.id == b.id && a.loaded == b.loaded && a.blocked_turns == b.blocked_turns;
+}
+
+// Stan fabryki w tym samym układzie co w segmencie (robotnicy po ID, magazyny i rampy w kolejności kolekcji)
+FactorySnapshot capture_snapshot(const Factory& factory, Time t);
+
+class SnapshotPublisher {
+public:
+    // name - nazwa segmentu dla shm_open (np. "/netsim"); interval - co ile tur publikować
+    SnapshotPublisher(const std::string& name, const Factory& factory, TimeOffset interval = 1);
+    ~SnapshotPublisher();
+
+    SnapshotPublisher(const SnapshotPublisher&) = delete;
+    SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+    void publish(const Factory& factory, Time t);
+
+    void publish_if_due(const Factory& factory, Time t) {
+        if (interval_ != 0 && t % interval_ == 0) {
+            publish(factory, t);
+        }
+    }
+
+private:
+    std::string name_;
+    TimeOffset interval_;
+    std::size_t size_ = 0;
+    void* mapping_ = nullptr;
+};
+
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const std::string& name);
+    ~SnapshotReader();
+
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+    // Zwraca false, jeśli nic jeszcze nie opublikowano
+    bool read(FactorySnapshot& out) const;
+
+private:
+    std::size_t size_ = 0;
+    const void* mapping_ = nullptr;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "factory.hpp"
+
+#include <cstddef>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Zmiana struktury działającej fabryki, np.:
+//   ADD WORKER id=4 processing-time=2 queue-type=FIFO
+//   ADD LINK src=worker-4 dest=store-1
+//   REMOVE LINK src=ramp-1 dest=worker-1
+//   REMOVE WORKER id=2
+//   SET WORKER id=1 processing-time=3 queue-capacity=5
+//   SET LOADING_RAMP id=1 delivery-interval=4
+// Operacje wykonywane są po kolei; węzeł nie może być w jednej zmianie usunięty i dodany ponownie.
+enum class DiffAction {
+    ADD,
+    REMOVE,
+    SET
+};
+
+struct DiffOperation {
+    DiffAction action;
+    ElementType type;
+    std::map<std::string, std::string> params;
+};
+
+struct StructureDiff {
+    std::vector<DiffOperation> operations;
+};
+
+StructureDiff load_structure_diff(std::istream& is);
+
+// Co zrobić z paczkami z usuwanych ramp i robotników (zawartość magazynów zawsze przepada)
+enum class RemovedPackagePolicy {
+    DRAIN,    // paczki znikają
+    REROUTE   // paczki trafiają po kolei do pozostałych odbiorców usuniętego węzła, z pominięciem
+              // pełnych kolejek; gdy się nie mieszczą, zmiana jest odrzucana (std::logic_error)
+};
+
+struct DiffResult {
+    std::size_t operations = 0;
+    std::size_t rerouted = 0;
+    std::size_t drained = 0;
+    std::size_t checked_senders = 0;  // wielkość sprawdzonego obszaru
+};
+
+// Nakłada zmianę między turami symulacji; kolejki i bufory pozostałych węzłów zostają.
+// Spójność sprawdzana jest przed modyfikacją i tylko dla nadawców, których zmiana
+// dotyczy (nowych, tracących połączenie lub odbiorcę) - przy błędzie fabryka
+// pozostaje nietknięta, a funkcja rzuca std::logic_error.
+DiffResult apply_structure_diff(Factory& factory, const StructureDiff& diff,
+                                RemovedPackagePolicy policy = RemovedPackagePolicy::REROUTE);
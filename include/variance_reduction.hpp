@@ -0,0 +1,44 @@
+#pragma once
+
+#include "convergence.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Replikacje niezależnych przebiegów i porównania wariantów struktury z redukcją wariancji.
+// Każda replikacja buduje świeżą fabrykę i ustawia Factory::seed_routing(base_seed + r).
+struct ReplicationOptions {
+    // Mierzona wielkość: średnia z tur po rozbiegu
+    MetricTarget target{MetricKind::STOREHOUSE_THROUGHPUT, 1};
+    std::size_t replications = 20;
+    TimeOffset turns = 1000;
+    TimeOffset warmup = 0;
+    std::uint64_t base_seed = 1;
+    double confidence = 0.95;
+
+    // Porównanie: oba warianty w replikacji r dostają to samo ziarno (inaczej - niezależne)
+    bool common_random_numbers = true;
+    // Replikacje w parach: strumień u i odbity 1 - u; obserwacją jest średnia pary
+    bool antithetic = false;
+    // Zmienna kontrolna: suma (u - 1/2) po losowaniach routingu na rampach, o znanej
+    // średniej 0 - odpowiada za to, ile wejścia z ramp trafiło do "wcześniejszych" odbiorców
+    bool control_variate = false;
+};
+
+struct ReplicationEstimate {
+    double mean = 0.0;
+    double half_width = 0.0;
+    std::size_t observations = 0;      // niezależne obserwacje (pary przy antithetic)
+    double control_coefficient = 0.0;  // beta zmiennej kontrolnej
+    // Wariancja bez zmiennej kontrolnej / wariancja z nią (1 bez zmiennej kontrolnej)
+    double variance_ratio = 1.0;
+};
+
+using FactoryBuilder = std::function<Factory()>;
+
+ReplicationEstimate run_replications(const FactoryBuilder& make_factory, const ReplicationOptions& options);
+
+// Estymata różnicy wariant_a - wariant_b
+ReplicationEstimate compare_variants(const FactoryBuilder& make_a, const FactoryBuilder& make_b,
+                                     const ReplicationOptions& options);
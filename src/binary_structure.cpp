@@ -0,0 +1,199 @@
+#include "binary_structure.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+template <typename Record>
+void write_records(std::ostream& os, const std::vector<Record>& records) {
+    os.write(reinterpret_cast<const char*>(records.data()),
+             static_cast<std::streamsize>(records.size() * sizeof(Record)));
+}
+
+template <typename Record>
+const Record* section(const unsigned char* base, std::size_t size, std::uint64_t offset, std::uint32_t count) {
+    if (offset % alignof(Record) != 0 || offset > size || (size - offset) / sizeof(Record) < count) {
+        throw std::logic_error("Invalid binary structure");
+    }
+    return reinterpret_cast<const Record*>(base + offset);
+}
+
+} // namespace
+
+bool is_binary_structure(const void* data, std::size_t size) {
+    std::uint32_t magic = 0;
+    if (size < sizeof(magic)) {
+        return false;
+    }
+    std::memcpy(&magic, data, sizeof(magic));
+    return magic == BINARY_STRUCTURE_MAGIC;
+}
+
+void save_binary_structure(const Factory& factory, std::ostream& os) {
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> worker_index;
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> storehouse_index;
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        worker_index.emplace(&*it, static_cast<std::uint32_t>(worker_index.size()));
+    }
+    std::vector<BinaryStorehouse> storehouses;
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        storehouse_index.emplace(&*it, static_cast<std::uint32_t>(storehouses.size()));
+        storehouses.push_back(BinaryStorehouse{it->get_id(), 0});
+    }
+
+    std::vector<BinaryLink> links;
+    auto add_links = [&](const PackageSender& sender, std::uint32_t& first, std::uint32_t& count) {
+        first = static_cast<std::uint32_t>(links.size());
+        const auto& prefs = sender.receiver_preferences_.get_preferences();
+        for (IPackageReceiver* receiver : sender.receiver_preferences_.sorted_receivers()) {
+            bool store = receiver->get_receiver_type() == ReceiverType::STOREHOUSE;
+            std::uint32_t index = store ? storehouse_index.at(receiver) : worker_index.at(receiver);
+            links.push_back(BinaryLink{store ? 1u : 0u, index, prefs.at(receiver)});
+        }
+        count = static_cast<std::uint32_t>(links.size()) - first;
+    };
+
+    std::vector<BinaryRamp> ramps;
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        BinaryRamp record{it->get_id(), it->get_delivery_interval(), 0, 0};
+        add_links(*it, record.first_link, record.link_count);
+        ramps.push_back(record);
+    }
+    std::vector<BinaryWorker> workers;
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        BinaryWorker record{it->get_id(), it->get_processing_duration(),
+                            it->get_queue()->get_queue_type() == PackageQueueType::FIFO ? 0u : 1u,
+                            static_cast<std::uint32_t>(it->get_queue_capacity()), 0, 0};
+        add_links(*it, record.first_link, record.link_count);
+        workers.push_back(record);
+    }
+
+    BinaryStructureHeader header{};
+    header.magic = BINARY_STRUCTURE_MAGIC;
+    header.version = BINARY_STRUCTURE_VERSION;
+    header.ramp_count = static_cast<std::uint32_t>(ramps.size());
+    header.worker_count = static_cast<std::uint32_t>(workers.size());
+    header.storehouse_count = static_cast<std::uint32_t>(storehouses.size());
+    header.link_count = static_cast<std::uint32_t>(links.size());
+    header.ramps_offset = sizeof(BinaryStructureHeader);
+    header.workers_offset = header.ramps_offset + ramps.size() * sizeof(BinaryRamp);
+    header.storehouses_offset = header.workers_offset + workers.size() * sizeof(BinaryWorker);
+    header.links_offset = header.storehouses_offset + storehouses.size() * sizeof(BinaryStorehouse);
+    header.total_size = header.links_offset + links.size() * sizeof(BinaryLink);
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_records(os, ramps);
+    write_records(os, workers);
+    write_records(os, storehouses);
+    write_records(os, links);
+    os.flush();
+}
+
+Factory load_binary_structure(const void* data, std::size_t size) {
+    const auto* base = static_cast<const unsigned char*>(data);
+    if (size < sizeof(BinaryStructureHeader) || !is_binary_structure(data, size)) {
+        throw std::logic_error("Invalid binary structure");
+    }
+    const auto& header = *reinterpret_cast<const BinaryStructureHeader*>(base);
+    if (header.version != BINARY_STRUCTURE_VERSION || header.total_size > size) {
+        throw std::logic_error("Invalid binary structure");
+    }
+    const auto* ramps = section<BinaryRamp>(base, size, header.ramps_offset, header.ramp_count);
+    const auto* workers = section<BinaryWorker>(base, size, header.workers_offset, header.worker_count);
+    const auto* storehouses = section<BinaryStorehouse>(base, size, header.storehouses_offset, header.storehouse_count);
+    const auto* links = section<BinaryLink>(base, size, header.links_offset, header.link_count);
+
+    Factory factory;
+    std::vector<Ramp*> ramp_nodes;
+    std::vector<Worker*> worker_nodes;
+    std::vector<IPackageReceiver*> storehouse_nodes;
+    ramp_nodes.reserve(header.ramp_count);
+    worker_nodes.reserve(header.worker_count);
+    storehouse_nodes.reserve(header.storehouse_count);
+
+    for (std::uint32_t i = 0; i < header.ramp_count; ++i) {
+        factory.add_ramp(Ramp(ramps[i].id, ramps[i].delivery_interval));
+        ramp_nodes.push_back(&*std::prev(factory.ramp_end()));
+    }
+    for (std::uint32_t i = 0; i < header.worker_count; ++i) {
+        const BinaryWorker& w = workers[i];
+        PackageQueueType qt = w.queue_type == 0 ? PackageQueueType::FIFO : PackageQueueType::LIFO;
+        factory.add_worker(Worker(w.id, w.processing_time, std::make_unique<PackageQueue>(qt), w.queue_capacity));
+        worker_nodes.push_back(&*std::prev(factory.worker_end()));
+    }
+    for (std::uint32_t i = 0; i < header.storehouse_count; ++i) {
+        factory.add_storehouse(Storehouse(storehouses[i].id));
+        storehouse_nodes.push_back(&*std::prev(factory.storehouse_end()));
+    }
+
+    // Zapisane prawdopodobieństwa odtwarzane wprost - muszą tworzyć rozkład
+    std::vector<std::pair<IPackageReceiver*, double>> receivers;
+    auto link_sender = [&](PackageSender& sender, std::uint32_t first, std::uint32_t count) {
+        if (first > header.link_count || header.link_count - first < count) {
+            throw std::logic_error("Invalid binary structure");
+        }
+        receivers.clear();
+        double total = 0.0;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            const BinaryLink& link = links[i];
+            if (!(link.probability >= 0.0 && link.probability <= 1.0)) {
+                throw std::logic_error("Invalid binary structure");
+            }
+            total += link.probability;
+            if (link.target_type == 0 && link.target_index < worker_nodes.size()) {
+                receivers.emplace_back(worker_nodes[link.target_index], link.probability);
+            } else if (link.target_type == 1 && link.target_index < storehouse_nodes.size()) {
+                receivers.emplace_back(storehouse_nodes[link.target_index], link.probability);
+            } else {
+                throw std::logic_error("Invalid binary structure");
+            }
+        }
+        if (count != 0 && std::abs(total - 1.0) > 1e-9) {
+            throw std::logic_error("Invalid binary structure");
+        }
+        sender.receiver_preferences_.set_receivers(receivers);
+    };
+    for (std::uint32_t i = 0; i < header.ramp_count; ++i) {
+        link_sender(*ramp_nodes[i], ramps[i].first_link, ramps[i].link_count);
+    }
+    for (std::uint32_t i = 0; i < header.worker_count; ++i) {
+        link_sender(*worker_nodes[i], workers[i].first_link, workers[i].link_count);
+    }
+    return factory;
+}
+
+Factory map_binary_structure(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open structure file: " + path);
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot read structure file: " + path);
+    }
+    const auto size = static_cast<std::size_t>(st.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Cannot map structure file: " + path);
+    }
+    try {
+        Factory factory = load_binary_structure(data, size);
+        ::munmap(data, size);
+        return factory;
+    }
+    catch (...) {
+        ::munmap(data, size);
+        throw;
+    }
+}
@@ -0,0 +1,335 @@
+#include "codegen.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+// Dokładna wartość double jako literał szesnastkowy (C++17)
+std::string exact(double value) {
+    std::ostringstream os;
+    os << std::hexfloat << value;
+    return os.str();
+}
+
+std::uint64_t stream_base(ElementType type) {
+    return static_cast<std::uint64_t>(type) << 32;
+}
+
+const char* const PROLOGUE = R"(// Wygenerowane przez netsim_codegen - nie edytować ręcznie.
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Link {
+    bool store;
+    std::uint32_t index;
+    double probability;
+};
+
+struct RampSpec {
+    int id;
+    int delivery_interval;
+    std::uint32_t first_link;
+    std::uint32_t link_count;
+};
+
+struct WorkerSpec {
+    int id;
+    int processing_time;
+    bool lifo;
+    std::size_t queue_capacity;
+    std::uint32_t first_link;
+    std::uint32_t link_count;
+};
+
+)";
+
+const char* const ENGINE = R"(
+template <typename F, std::size_t... I>
+void unroll(F& f, std::index_sequence<I...>) {
+    (f(std::integral_constant<std::size_t, I>{}), ...);
+}
+
+// Do UNROLL_LIMIT węzłów pętla rozwijana w czasie kompilacji (indeks jest stałą)
+template <std::size_t Count, typename F>
+void for_each_node(F&& f) {
+    if constexpr (Count <= UNROLL_LIMIT) {
+        unroll(f, std::make_index_sequence<Count>{});
+    } else {
+        for (std::size_t i = 0; i < Count; ++i) {
+            f(i);
+        }
+    }
+}
+
+// Jak make_probability_generator() w helpers.cpp
+class Router {
+public:
+    Router(std::uint64_t seed, std::uint64_t stream) : state_(mix(seed) ^ mix(stream ^ 0xD1B54A32D192ED03ULL)) {}
+
+    double operator()() { return static_cast<double>(mix(state_ += 0x9E3779B97F4A7C15ULL) >> 11) * 0x1.0p-53; }
+
+private:
+    static std::uint64_t mix(std::uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    std::uint64_t state_;
+};
+
+void write_packages(std::string& out, const std::deque<int>& packages) {
+    if (packages.empty()) {
+        out += "(empty)\n";
+        return;
+    }
+    for (std::size_t k = 0; k < packages.size(); ++k) {
+        out += k == 0 ? "#" : ", #";
+        out += std::to_string(packages[k]);
+    }
+    out += '\n';
+}
+
+// Paczka to jej ID (0 - pusty bufor); przydział ID jak w klasie Package
+class Simulator {
+public:
+    explicit Simulator(std::uint64_t seed)
+        : ramp_buffer_(RAMP_COUNT), ramp_blocked_(RAMP_COUNT), queue_(WORKER_COUNT), processing_(WORKER_COUNT),
+          started_(WORKER_COUNT), sending_(WORKER_COUNT), blocked_(WORKER_COUNT), stock_(STOREHOUSE_COUNT) {
+        for (std::size_t i = 0; i < RAMP_COUNT; ++i) {
+            ramp_routers_.emplace_back(seed, RAMP_STREAM | static_cast<std::uint32_t>(RAMPS[i].id));
+        }
+        for (std::size_t i = 0; i < WORKER_COUNT; ++i) {
+            worker_routers_.emplace_back(seed, WORKER_STREAM | static_cast<std::uint32_t>(WORKERS[i].id));
+        }
+    }
+
+    void tick(int t) {
+        for_each_node<RAMP_COUNT>([&](auto i) {
+            if (ramp_buffer_[i] == 0 && (t - 1) % RAMPS[i].delivery_interval == 0) {
+                ramp_buffer_[i] = allocate_package();
+            }
+        });
+
+        for_each_node<RAMP_COUNT>([&](auto i) {
+            if (!send(ramp_buffer_[i], ramp_routers_[i], RAMPS[i].first_link, RAMPS[i].link_count)) {
+                ++ramp_blocked_[i];
+            }
+        });
+        for_each_node<WORKER_COUNT>([&](auto i) {
+            if (!send(sending_[i], worker_routers_[i], WORKERS[i].first_link, WORKERS[i].link_count)) {
+                ++blocked_[i];
+            }
+        });
+
+        for_each_node<WORKER_COUNT>([&](auto i) {
+            if (processing_[i] == 0 && !queue_[i].empty()) {
+                if (WORKERS[i].lifo) {
+                    processing_[i] = queue_[i].back();
+                    queue_[i].pop_back();
+                } else {
+                    processing_[i] = queue_[i].front();
+                    queue_[i].pop_front();
+                }
+                started_[i] = t;
+            }
+            // Pełny bufor wysyłkowy wstrzymuje zakończenie przetwarzania (jak Worker::do_work)
+            if (processing_[i] != 0 && sending_[i] == 0 && t - started_[i] + 1 >= WORKERS[i].processing_time) {
+                sending_[i] = processing_[i];
+                processing_[i] = 0;
+            }
+        });
+    }
+
+    // Format generate_simulation_report()
+    void report(int t, std::string& out) const {
+        out += "=== [ Turn: " + std::to_string(t) + " ] ===\n";
+        bool ramps_blocked = false;
+        for (std::size_t i = 0; i < RAMP_COUNT; ++i) {
+            ramps_blocked = ramps_blocked || ramp_blocked_[i] != 0;
+        }
+        if (ramps_blocked) {
+            out += "\n== LOADING RAMPS == \n";
+            for (std::size_t i = 0; i < RAMP_COUNT; ++i) {
+                out += "LOADING_RAMP #" + std::to_string(RAMPS[i].id) + '\n';
+                out += "  Blocked turns: " + std::to_string(ramp_blocked_[i]) + "\n\n";
+            }
+        }
+        out += "\n== WORKERS == \n";
+        for (std::size_t k = 0; k < WORKER_COUNT; ++k) {
+            const std::size_t i = WORKERS_BY_ID[k];
+            out += "WORKER #" + std::to_string(WORKERS[i].id) + '\n';
+            out += "  PBuffer: ";
+            if (processing_[i] != 0) {
+                out += '#' + std::to_string(processing_[i]) + " (pt = " + std::to_string(t - started_[i] + 1) + ")\n";
+            } else {
+                out += "(empty)\n";
+            }
+            out += "  Queue: ";
+            write_packages(out, queue_[i]);
+            out += "  SBuffer: ";
+            out += sending_[i] != 0 ? '#' + std::to_string(sending_[i]) + '\n' : std::string("(empty)\n");
+            if (blocked_[i] != 0) {
+                out += "  Blocked turns: " + std::to_string(blocked_[i]) + '\n';
+            }
+            out += '\n';
+        }
+        out += "\n== STOREHOUSES == \n\n";
+        for (std::size_t s = 0; s < STOREHOUSE_COUNT; ++s) {
+            out += "STOREHOUSE #" + std::to_string(STOREHOUSE_IDS[s]) + '\n';
+            out += "  Stock: ";
+            write_packages(out, stock_[s]);
+        }
+        out += '\n';
+    }
+
+private:
+    // false - odbiorca nie przyjął paczki (zablokowanie)
+    bool send(int& buffer, Router& router, std::uint32_t first, std::uint32_t count) {
+        if (buffer == 0 || count == 0) {
+            return true;
+        }
+        const double p = router();
+        const Link* target = &LINKS[first + count - 1];
+        double distribution = 0.0;
+        for (std::uint32_t k = first; k < first + count; ++k) {
+            distribution += LINKS[k].probability;
+            if (p <= distribution) {
+                target = &LINKS[k];
+                break;
+            }
+        }
+        if (target->store) {
+            stock_[target->index].push_back(buffer);
+        } else {
+            const std::size_t capacity = WORKERS[target->index].queue_capacity;
+            if (capacity != 0 && queue_[target->index].size() >= capacity) {
+                return false;
+            }
+            queue_[target->index].push_back(buffer);
+        }
+        buffer = 0;
+        return true;
+    }
+
+    // Paczki nie giną w trakcie przebiegu, więc ID rosną od 1 bez luk
+    int allocate_package() { return ++highest_id_; }
+
+    std::vector<int> ramp_buffer_;
+    std::vector<std::size_t> ramp_blocked_;
+    std::vector<std::deque<int>> queue_;
+    std::vector<int> processing_;
+    std::vector<int> started_;
+    std::vector<int> sending_;
+    std::vector<std::size_t> blocked_;
+    std::vector<std::deque<int>> stock_;
+    std::vector<Router> ramp_routers_;
+    std::vector<Router> worker_routers_;
+    int highest_id_ = 0;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <turns> [seed] [report interval]\n", argv[0]);
+        return 1;
+    }
+    const long turns = std::strtol(argv[1], nullptr, 10);
+    const std::uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+    const long interval = argc > 3 ? std::strtol(argv[3], nullptr, 10) : 1;
+
+    Simulator simulator(seed);
+    std::string out;
+    for (int t = 1; t <= turns; ++t) {
+        simulator.tick(t);
+        if (interval != 0 && t % interval == 0) {
+            simulator.report(t, out);
+            if (out.size() >= (1u << 16)) {
+                std::fwrite(out.data(), 1, out.size(), stdout);
+                out.clear();
+            }
+        }
+    }
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    return 0;
+}
+)";
+
+} // namespace
+
+void generate_simulator_source(const Factory& factory, std::ostream& os, const CodegenOptions& options) {
+    if (!factory.is_consistent()) {
+        throw std::logic_error("Non-consistent factory");
+    }
+
+    std::unordered_map<const IPackageReceiver*, std::size_t> worker_index;
+    std::unordered_map<const IPackageReceiver*, std::size_t> storehouse_index;
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        worker_index.emplace(&*it, worker_index.size());
+    }
+    std::ostringstream storehouses;
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        storehouse_index.emplace(&*it, storehouse_index.size());
+        storehouses << "    " << it->get_id() << ",\n";
+    }
+
+    // Tablica routingu nadawcy: odbiorcy w kolejności kanonicznej z prawdopodobieństwami
+    std::ostringstream links;
+    std::size_t link_count = 0;
+    auto add_links = [&](const PackageSender& sender) {
+        const std::size_t first = link_count;
+        const auto& prefs = sender.receiver_preferences_.get_preferences();
+        for (IPackageReceiver* receiver : sender.receiver_preferences_.sorted_receivers()) {
+            bool store = receiver->get_receiver_type() == ReceiverType::STOREHOUSE;
+            links << "    {" << (store ? "true" : "false") << ", "
+                  << (store ? storehouse_index.at(receiver) : worker_index.at(receiver)) << ", "
+                  << exact(prefs.at(receiver)) << "},\n";
+            ++link_count;
+        }
+        return std::to_string(first) + ", " + std::to_string(link_count - first);
+    };
+
+    std::ostringstream ramps;
+    std::size_t ramp_count = 0;
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it, ++ramp_count) {
+        ramps << "    {" << it->get_id() << ", " << it->get_delivery_interval() << ", " << add_links(*it) << "},\n";
+    }
+    std::ostringstream workers;
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        bool lifo = it->get_queue()->get_queue_type() == PackageQueueType::LIFO;
+        workers << "    {" << it->get_id() << ", " << it->get_processing_duration() << ", "
+                << (lifo ? "true" : "false") << ", " << it->get_queue_capacity() << ", " << add_links(*it) << "},\n";
+    }
+    std::ostringstream workers_by_id;
+    for (const Worker* w : factory.workers_by_id()) {
+        workers_by_id << "    " << worker_index.at(w) << ",\n";
+    }
+
+    os << PROLOGUE;
+    os << "constexpr std::size_t RAMP_COUNT = " << ramp_count << ";\n";
+    os << "constexpr std::size_t WORKER_COUNT = " << worker_index.size() << ";\n";
+    os << "constexpr std::size_t STOREHOUSE_COUNT = " << storehouse_index.size() << ";\n";
+    os << "constexpr std::size_t LINK_COUNT = " << link_count << ";\n";
+    os << "constexpr std::size_t UNROLL_LIMIT = " << options.unroll_limit << ";\n";
+    os << "constexpr std::uint64_t RAMP_STREAM = " << stream_base(ElementType::RAMP) << "ULL;\n";
+    os << "constexpr std::uint64_t WORKER_STREAM = " << stream_base(ElementType::WORKER) << "ULL;\n\n";
+    os << "// Ostatni element każdej tablicy to wypełnienie - tablice nie mogą być puste\n";
+    os << "constexpr RampSpec RAMPS[RAMP_COUNT + 1] = {\n" << ramps.str() << "    {}};\n\n";
+    os << "constexpr WorkerSpec WORKERS[WORKER_COUNT + 1] = {\n" << workers.str() << "    {}};\n\n";
+    os << "constexpr int STOREHOUSE_IDS[STOREHOUSE_COUNT + 1] = {\n" << storehouses.str() << "    0};\n\n";
+    os << "constexpr Link LINKS[LINK_COUNT + 1] = {\n" << links.str() << "    {}};\n\n";
+    os << "// Kolejność robotników w raporcie (po ID)\n";
+    os << "constexpr std::size_t WORKERS_BY_ID[WORKER_COUNT + 1] = {\n" << workers_by_id.str() << "    0};\n";
+    os << ENGINE;
+}
@@ -0,0 +1,203 @@
+#include "convergence.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+void BatchMeansEstimator::add(double x) {
+    batch_sum_ += x;
+    if (++in_batch_ == batch_size_) {
+        batch_means_.push_back(batch_sum_ / batch_size_);
+        batch_sum_ = 0.0;
+        in_batch_ = 0;
+    }
+}
+
+std::size_t BatchMeansEstimator::warmup_batches() const {
+    const std::size_t n = batch_means_.size();
+    if (n < 2) {
+        return 0;
+    }
+
+    // Sumy od końca - każdy punkt odcięcia liczony w O(1)
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    std::vector<double> statistic(n, 0.0);
+    for (std::size_t i = n; i-- > 0;) {
+        sum += batch_means_[i];
+        sum_sq += batch_means_[i] * batch_means_[i];
+        const double m = static_cast<double>(n - i);
+        statistic[i] = (sum_sq - sum * sum / m) / (m * m);
+    }
+
+    std::size_t best = 0;
+    for (std::size_t d = 1; d <= n / 2; ++d) {
+        if (statistic[d] < statistic[best]) {
+            best = d;
+        }
+    }
+    return best;
+}
+
+double BatchMeansEstimator::mean(std::size_t first_batch) const {
+    if (first_batch >= batch_means_.size()) {
+        return 0.0;
+    }
+    double sum = 0.0;
+    for (std::size_t i = first_batch; i < batch_means_.size(); ++i) {
+        sum += batch_means_[i];
+    }
+    return sum / static_cast<double>(batch_means_.size() - first_batch);
+}
+
+double BatchMeansEstimator::half_width(std::size_t first_batch, double confidence) const {
+    if (first_batch + 2 > batch_means_.size()) {
+        return INFINITY;
+    }
+    const double k = static_cast<double>(batch_means_.size() - first_batch);
+    const double m = mean(first_batch);
+    double ss = 0.0;
+    for (std::size_t i = first_batch; i < batch_means_.size(); ++i) {
+        ss += (batch_means_[i] - m) * (batch_means_[i] - m);
+    }
+    const double s = std::sqrt(ss / (k - 1.0));
+    return student_t_quantile(0.5 + confidence / 2.0, k - 1.0) * s / std::sqrt(k);
+}
+
+namespace {
+
+// Kwantyl rozkładu normalnego (Abramowitz & Stegun 26.2.23)
+double normal_quantile(double p) {
+    if (p <= 0.0 || p >= 1.0) {
+        throw std::invalid_argument("Probability out of range");
+    }
+    const double q = p < 0.5 ? p : 1.0 - p;
+    const double t = std::sqrt(-2.0 * std::log(q));
+    const double z = t - (2.515517 + 0.802853 * t + 0.010328 * t * t)
+                         / (1.0 + 1.432788 * t + 0.189269 * t * t + 0.001308 * t * t * t);
+    return p < 0.5 ? -z : z;
+}
+
+} // namespace
+
+MetricProbe::MetricProbe(const Factory& factory, const MetricTarget& target) {
+    if (target.kind == MetricKind::WORKER_QUEUE_LENGTH) {
+        auto it = factory.find_worker_by_id(target.id);
+        if (it == factory.worker_cend()) {
+            throw std::invalid_argument("Unknown metric target: worker " + std::to_string(target.id));
+        }
+        worker_ = &*it;
+    } else {
+        auto it = factory.find_storehouse_by_id(target.id);
+        if (it == factory.storehouse_cend()) {
+            throw std::invalid_argument("Unknown metric target: storehouse " + std::to_string(target.id));
+        }
+        storehouse_ = &*it;
+        last_stock_ = storehouse_->size();
+    }
+}
+
+double MetricProbe::observe() {
+    if (worker_ != nullptr) {
+        return static_cast<double>(worker_->get_queue()->size());
+    }
+    const std::size_t stock = storehouse_->size();
+    const double delivered = static_cast<double>(stock) - static_cast<double>(last_stock_);
+    last_stock_ = stock;
+    return delivered;
+}
+
+double student_t_quantile(double p, double dof) {
+    const double z = normal_quantile(p);
+    const double z3 = z * z * z;
+    const double z5 = z3 * z * z;
+    return z + (z3 + z) / (4.0 * dof)
+             + (5.0 * z5 + 16.0 * z3 + 3.0 * z) / (96.0 * dof * dof);
+}
+
+ConvergenceResult simulate_until_converged(Factory& factory,
+                                           const ConvergenceOptions& options,
+                                           const std::function<void(Factory&, TimeOffset)>& rf) {
+    if (options.batch_size <= 0 || options.min_batches < 2) {
+        throw std::invalid_argument("Invalid convergence options");
+    }
+
+    std::vector<MetricTarget> targets = options.targets;
+    if (targets.empty()) {
+        for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+            targets.push_back({MetricKind::STOREHOUSE_THROUGHPUT, it->get_id()});
+        }
+        for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+            targets.push_back({MetricKind::WORKER_QUEUE_LENGTH, it->get_id()});
+        }
+    }
+    std::vector<MetricProbe> probes;
+    probes.reserve(targets.size());
+    for (const auto& target : targets) {
+        probes.emplace_back(factory, target);
+    }
+
+    std::vector<BatchMeansEstimator> estimators(targets.size(), BatchMeansEstimator(options.batch_size));
+
+    ConvergenceResult result;
+    SimulationRun run(factory, options.max_turns);
+    // Sprawdzamy zbieżność co ~10% przyrostu liczby partii, żeby nie płacić O(k) w każdej partii
+    std::size_t next_check = options.min_batches;
+
+    while (!run.done()) {
+        Time t = run.step();
+        if (rf) {
+            rf(factory, t);
+        }
+        for (std::size_t i = 0; i < targets.size(); ++i) {
+            estimators[i].add(probes[i].observe());
+        }
+
+        const std::size_t batches = estimators.empty() ? 0 : estimators.front().batch_count();
+        if (batches < next_check) {
+            continue;
+        }
+        next_check = std::max(batches + 1, batches + batches / 10);
+
+        std::size_t warmup = 0;
+        for (const auto& estimator : estimators) {
+            warmup = std::max(warmup, estimator.warmup_batches());
+        }
+        if (batches - warmup < options.min_batches) {
+            continue;
+        }
+
+        bool all_converged = true;
+        result.estimates.clear();
+        for (std::size_t i = 0; i < targets.size(); ++i) {
+            double m = estimators[i].mean(warmup);
+            double hw = estimators[i].half_width(warmup, options.confidence);
+            double limit = options.relative ? options.ci_width * std::abs(m) : options.ci_width;
+            bool ok = 2.0 * hw <= limit;
+            all_converged = all_converged && ok;
+            result.estimates.push_back({targets[i], m, hw, ok});
+        }
+        result.warmup = static_cast<Time>(warmup) * options.batch_size;
+        if (all_converged) {
+            result.converged = true;
+            break;
+        }
+    }
+
+    result.turns = run.current_turn();
+    if (!result.converged) {
+        // Końcowe oszacowania z tego, co udało się zebrać
+        std::size_t warmup = 0;
+        for (const auto& estimator : estimators) {
+            warmup = std::max(warmup, estimator.warmup_batches());
+        }
+        result.warmup = static_cast<Time>(warmup) * options.batch_size;
+        result.estimates.clear();
+        for (std::size_t i = 0; i < targets.size(); ++i) {
+            result.estimates.push_back({targets[i], estimators[i].mean(warmup),
+                                        estimators[i].half_width(warmup, options.confidence), false});
+        }
+    }
+    return result;
+}
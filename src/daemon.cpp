@@ -0,0 +1,497 @@
+#include "daemon.hpp"
+
+#include "binary_structure.hpp"
+#include "local_socket.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t MAX_STRUCTURE_SIZE = std::size_t{256} << 20;
+constexpr std::size_t MAX_REQUEST_LINE = 64 << 10;
+constexpr std::uint64_t MAX_PENDING_REQUESTS = 64;               // na połączenie
+constexpr std::size_t MAX_BUFFERED_OUTPUT = std::size_t{16} << 20;   // na połączenie
+
+void set_nonblocking(int fd) {
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Dokłada do bufora kolejne bajty z gniazda; false - koniec połączenia
+bool fill(int fd, std::string& buffer) {
+    char chunk[4096];
+    ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+        return false;
+    }
+    buffer.append(chunk, static_cast<std::size_t>(n));
+    return true;
+}
+
+bool read_line(int fd, std::string& buffer, std::string& line) {
+    std::size_t end;
+    while ((end = buffer.find('\n')) == std::string::npos) {
+        if (!fill(fd, buffer)) {
+            return false;
+        }
+    }
+    line = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    return true;
+}
+
+bool read_exact(int fd, std::string& buffer, std::size_t size, std::string& out) {
+    while (buffer.size() < size) {
+        if (!fill(fd, buffer)) {
+            return false;
+        }
+    }
+    out = buffer.substr(0, size);
+    buffer.erase(0, size);
+    return true;
+}
+
+std::vector<std::string> split_words(const std::string& line) {
+    std::vector<std::string> words;
+    std::istringstream iss(line);
+    std::string word;
+    while (iss >> word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+std::string ok(const std::string& payload) {
+    return "OK " + std::to_string(payload.size()) + "\n" + payload;
+}
+
+std::string hex(std::uint64_t value) {
+    std::ostringstream os;
+    os << std::hex << std::setw(16) << std::setfill('0') << value;
+    return os.str();
+}
+
+std::size_t parse_size(const std::string& text) {
+    std::size_t pos = 0;
+    unsigned long long value = std::stoull(text, &pos);
+    if (pos != text.size()) {
+        throw std::invalid_argument("Invalid number: " + text);
+    }
+    return static_cast<std::size_t>(value);
+}
+
+} // namespace
+
+SimulationDaemon::SimulationDaemon(const DaemonOptions& options) : socket_path_(options.socket_path) {
+    std::size_t threads = options.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    listen_fd_ = open_unix_socket(socket_path_);
+    if (::pipe(wake_fds_) != 0) {
+        ::close(listen_fd_);
+        throw std::runtime_error("Cannot create wake pipe");
+    }
+    set_nonblocking(wake_fds_[0]);
+    set_nonblocking(wake_fds_[1]);
+    for (std::size_t i = 0; i < threads; ++i) {
+        pool_.emplace_back([this] { worker_loop(); });
+    }
+    acceptor_ = std::thread([this] { accept_loop(); });
+}
+
+SimulationDaemon::~SimulationDaemon() {
+    stop();
+}
+
+void SimulationDaemon::stop() {
+    if (stop_.exchange(true)) {
+        return;
+    }
+    queue_ready_.notify_all();
+    wake();
+    if (acceptor_.joinable()) {
+        acceptor_.join();
+    }
+    for (auto& thread : pool_) {
+        thread.join();
+    }
+    ::close(wake_fds_[0]);
+    ::close(wake_fds_[1]);
+    ::close(listen_fd_);
+    ::unlink(socket_path_.c_str());
+}
+
+SimulationDaemon::Connection::~Connection() {
+    ::close(fd);
+}
+
+void SimulationDaemon::wake() {
+    char byte = 0;
+    [[maybe_unused]] ssize_t n = ::write(wake_fds_[1], &byte, 1);   // pełny potok - pętla i tak się obudzi
+}
+
+// Jedna pętla poll() dla gniazda nasłuchującego i wszystkich połączeń (gniazda
+// nieblokujące). Pętla czyta żądania i wysyła gotowe odpowiedzi, wątki puli dostają
+// pojedyncze, kompletne żądania i tylko dopisują odpowiedzi do bufora połączenia.
+void SimulationDaemon::accept_loop() {
+    std::vector<std::shared_ptr<Connection>> connections;
+    std::vector<pollfd> fds;
+    while (true) {
+        // Po stop() bez nowych połączeń i żądań - pętla czeka tylko na odpowiedzi trwających
+        const bool stopping = stop_.load();
+        bool answering = false;
+        std::vector<std::shared_ptr<Connection>> open;
+        for (auto& connection : connections) {
+            if (stopping) {
+                connection->reading = false;
+            }
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (connection->broken) {
+                continue;
+            }
+            const bool unanswered = connection->next_response != connection->next_request;
+            answering = answering || unanswered;
+            if (connection->reading || unanswered || !connection->output.empty()) {
+                open.push_back(std::move(connection));
+            }
+        }
+        connections = std::move(open);
+        if (stopping && !answering) {
+            // Ostatnia próba wysłania; reszta przepada razem z połączeniem
+            for (const auto& connection : connections) {
+                flush(*connection);
+            }
+            return;
+        }
+
+        fds.assign({pollfd{listen_fd_, static_cast<short>(stopping ? 0 : POLLIN), 0}, pollfd{wake_fds_[0], POLLIN, 0}});
+        for (const auto& connection : connections) {
+            short events = 0;
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                // Klient, który nie odbiera odpowiedzi albo czeka na zbyt wiele, przestaje być czytany
+                if (connection->reading && connection->output.size() < MAX_BUFFERED_OUTPUT
+                    && connection->next_request - connection->next_response < MAX_PENDING_REQUESTS) {
+                    events |= POLLIN;
+                }
+                if (!connection->output.empty()) {
+                    events |= POLLOUT;
+                }
+            }
+            fds.push_back(pollfd{connection->fd, events, 0});
+        }
+        if (::poll(fds.data(), fds.size(), 100) < 0) {
+            continue;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (::read(wake_fds_[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        for (std::size_t i = 0; i < connections.size(); ++i) {
+            Connection& connection = *connections[i];
+            const short revents = fds[i + 2].revents;
+            if (revents & (POLLOUT | POLLERR | POLLHUP)) {
+                flush(connection);
+            }
+            if ((revents & (POLLIN | POLLHUP)) && connection.reading) {
+                receive(connection);
+            }
+            // Także bez nowych danych - żądania wstrzymane limitem mogą już pójść do kolejki
+            if (connection.reading && !queue_requests(connections[i])) {
+                connection.reading = false;
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client = ::accept(listen_fd_, nullptr, nullptr);
+            if (client >= 0) {
+                set_nonblocking(client);
+                connections.push_back(std::make_shared<Connection>(client));
+            }
+        }
+    }
+}
+
+void SimulationDaemon::receive(Connection& connection) {
+    char chunk[4096];
+    ssize_t n = ::recv(connection.fd, chunk, sizeof(chunk), 0);
+    if (n > 0) {
+        connection.input.append(chunk, static_cast<std::size_t>(n));
+    } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        connection.reading = false;   // koniec żądań; odpowiedzi na kolejkowane nadal wychodzą
+    }
+}
+
+void SimulationDaemon::flush(Connection& connection) {
+    std::lock_guard<std::mutex> lock(connection.mutex);
+    while (!connection.output.empty()) {
+        ssize_t n = ::send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (n <= 0) {
+            connection.broken = true;
+            connection.output.clear();
+            return;
+        }
+        connection.output.erase(0, static_cast<std::size_t>(n));
+    }
+}
+
+bool SimulationDaemon::queue_requests(const std::shared_ptr<Connection>& connection) {
+    std::string& input = connection->input;
+    std::size_t end;
+    while ((end = input.find('\n')) != std::string::npos) {
+        {
+            // Limit żądań bez wysłanej odpowiedzi - reszta czeka w buforze
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (connection->next_request - connection->next_response >= MAX_PENDING_REQUESTS) {
+                return true;
+            }
+        }
+        std::string line = input.substr(0, end);
+        std::string body;
+        auto words = split_words(line);
+        if (!words.empty() && words[0] == "LOAD") {
+            std::size_t size = 0;
+            try {
+                size = words.size() == 3 ? parse_size(words[2]) : 0;
+            } catch (const std::exception&) {
+                size = 0;
+            }
+            if (words.size() != 3 || size > MAX_STRUCTURE_SIZE) {
+                // Bez poprawnej długości nie wiadomo, gdzie kończy się treść - koniec czytania
+                respond(*connection, connection->next_request++, "ERR Invalid LOAD header\n");
+                return false;
+            }
+            if (input.size() - (end + 1) < size) {
+                return true;   // treść jeszcze nie dotarła
+            }
+            body = input.substr(end + 1, size);
+            end += size;
+        }
+        input.erase(0, end + 1);
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            if (stop_.load()) {
+                return false;   // pula mogła już skończyć pracę
+            }
+            pending_.push_back(Request{connection, connection->next_request++, std::move(line), std::move(body)});
+        }
+        queue_ready_.notify_one();
+    }
+    if (input.size() > MAX_REQUEST_LINE) {
+        respond(*connection, connection->next_request++, "ERR Request line too long\n");
+        return false;
+    }
+    return true;
+}
+
+void SimulationDaemon::respond(Connection& connection, std::uint64_t sequence, std::string response) {
+    {
+        std::lock_guard<std::mutex> lock(connection.mutex);
+        connection.ready.emplace(sequence, std::move(response));
+        for (auto it = connection.ready.begin();
+             it != connection.ready.end() && it->first == connection.next_response;
+             it = connection.ready.erase(it)) {
+            ++connection.next_response;
+            if (!connection.broken) {
+                connection.output += it->second;
+            }
+        }
+    }
+    wake();
+}
+
+void SimulationDaemon::worker_loop() {
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_ready_.wait(lock, [this] { return stop_.load() || !pending_.empty(); });
+            if (pending_.empty()) {
+                return;
+            }
+            request = std::move(pending_.front());
+            pending_.pop_front();
+        }
+        respond(*request.connection, request.sequence, handle(request.line, request.body));
+    }
+}
+
+std::string SimulationDaemon::handle(const std::string& request, const std::string& body) {
+    try {
+        auto words = split_words(request);
+        if (words.empty()) {
+            throw std::invalid_argument("Empty request");
+        }
+        const std::string& command = words[0];
+        if (command == "LOAD" && words.size() == 3) {
+            if (parse_size(words[2]) != body.size()) {
+                throw std::invalid_argument("Structure size mismatch");
+            }
+            return ok(load(words[1], body));
+        }
+        if (command == "RUN" && words.size() >= 2) {
+            return ok(run(words[1], std::vector<std::string>(words.begin() + 2, words.end())));
+        }
+        if (command == "DROP" && words.size() == 2) {
+            std::unique_lock<std::shared_mutex> lock(templates_mutex_);
+            if (templates_.erase(words[1]) == 0) {
+                throw std::invalid_argument("Unknown structure: " + words[1]);
+            }
+            return ok("");
+        }
+        if (command == "LIST" && words.size() == 1) {
+            std::ostringstream os;
+            std::shared_lock<std::shared_mutex> lock(templates_mutex_);
+            for (const auto& [name, tmpl] : templates_) {
+                os << name << ' ' << hex(tmpl->hash) << '\n';
+            }
+            return ok(os.str());
+        }
+        if (command == "STATS" && words.size() == 1) {
+            std::ostringstream os;
+            {
+                std::shared_lock<std::shared_mutex> lock(templates_mutex_);
+                os << "structures " << templates_.size() << '\n';
+            }
+            os << "threads " << pool_.size() << '\n';
+            os << "runs " << runs_.load(std::memory_order_relaxed) << '\n';
+            os << "turns " << turns_.load(std::memory_order_relaxed) << '\n';
+            return ok(os.str());
+        }
+        throw std::invalid_argument("Invalid request: " + command);
+    } catch (const std::exception& e) {
+        std::string message = e.what();
+        for (char& c : message) {
+            if (c == '\n') {
+                c = ' ';
+            }
+        }
+        return "ERR " + message + "\n";
+    }
+}
+
+std::string SimulationDaemon::load(const std::string& name, const std::string& structure) {
+    std::istringstream iss(structure);
+    Factory factory = load_factory_structure(iss);
+    if (!factory.is_consistent()) {
+        throw std::logic_error("Non-consistent factory");
+    }
+
+    auto tmpl = std::make_shared<Template>();
+    std::ostringstream os;
+    save_binary_structure(factory, os);
+    const std::string image = os.str();
+    tmpl->size = image.size();
+    tmpl->image.resize((image.size() + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+    std::memcpy(tmpl->image.data(), image.data(), image.size());
+    tmpl->hash = structure_hash(factory);
+
+    std::unique_lock<std::shared_mutex> lock(templates_mutex_);
+    templates_[name] = tmpl;
+    return hex(tmpl->hash);
+}
+
+std::string SimulationDaemon::run(const std::string& name, const std::vector<std::string>& args) {
+    RunParameters params;
+    bool metrics = false;
+    bool has_turns = false;
+    for (const auto& arg : args) {
+        auto eq = arg.find('=');
+        if (eq == std::string::npos) {
+            throw std::invalid_argument("Invalid argument: " + arg);
+        }
+        const std::string key = arg.substr(0, eq);
+        const std::string value = arg.substr(eq + 1);
+        if (key == "turns") {
+            params.horizon = static_cast<TimeOffset>(parse_size(value));
+            has_turns = true;
+        } else if (key == "seed") {
+            params.seed = parse_size(value);
+        } else if (key == "interval") {
+            params.report_interval = static_cast<TimeOffset>(parse_size(value));
+        } else if (key == "at") {
+            std::istringstream turns(value);
+            std::string turn;
+            while (std::getline(turns, turn, ',')) {
+                params.report_turns.insert(static_cast<Time>(parse_size(turn)));
+            }
+        } else if (key == "output" && (value == "reports" || value == "metrics")) {
+            metrics = value == "metrics";
+        } else {
+            throw std::invalid_argument("Invalid argument: " + arg);
+        }
+    }
+    if (!has_turns) {
+        throw std::invalid_argument("Missing turns=");
+    }
+
+    std::shared_ptr<const Template> tmpl;
+    {
+        std::shared_lock<std::shared_mutex> lock(templates_mutex_);
+        auto it = templates_.find(name);
+        if (it == templates_.end()) {
+            throw std::invalid_argument("Unknown structure: " + name);
+        }
+        tmpl = it->second;
+    }
+
+    // Własna fabryka i rejestr ID paczek dla przebiegu; szablon może w tym czasie zostać podmieniony
+    PackageIdAllocator ids;
+    Factory factory = load_binary_structure(tmpl->image.data(), tmpl->size);
+    factory.set_package_id_allocator(ids);
+    CachedRun result = simulate_run(factory, params);
+    runs_.fetch_add(1, std::memory_order_relaxed);
+    turns_.fetch_add(static_cast<std::uint64_t>(params.horizon), std::memory_order_relaxed);
+    return metrics ? result.metrics : result.reports;
+}
+
+DaemonClient::DaemonClient(const std::string& socket_path) : fd_(connect_unix_socket(socket_path)) {}
+
+DaemonClient::~DaemonClient() {
+    ::close(fd_);
+}
+
+bool DaemonClient::read_line(std::string& line) {
+    return ::read_line(fd_, buffer_, line);
+}
+
+std::string DaemonClient::request(const std::string& line, const std::string& body) {
+    if (!write_all(fd_, line + "\n" + body)) {
+        throw std::runtime_error("Connection closed");
+    }
+    std::string header;
+    if (!read_line(header)) {
+        throw std::runtime_error("Connection closed");
+    }
+    if (header.rfind("ERR ", 0) == 0) {
+        throw std::runtime_error(header.substr(4));
+    }
+    if (header.rfind("OK ", 0) != 0) {
+        throw std::runtime_error("Invalid response: " + header);
+    }
+    std::string payload;
+    if (!read_exact(fd_, buffer_, parse_size(header.substr(3)), payload)) {
+        throw std::runtime_error("Connection closed");
+    }
+    return payload;
+}
+
+std::string DaemonClient::load(const std::string& name, const std::string& structure) {
+    return request("LOAD " + name + " " + std::to_string(structure.size()), structure);
+}
@@ -0,0 +1,411 @@
+#include "differential.hpp"
+
+#include "binary_structure.hpp"
+#include "partition.hpp"
+#include "replay.hpp"
+#include "simulate.hpp"
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+Factory load_structure(const std::string& structure) {
+    std::istringstream iss(structure);
+    return load_factory_structure(iss);
+}
+
+std::vector<std::string> split_lines(const std::string& structure) {
+    std::vector<std::string> lines;
+    std::istringstream iss(structure);
+    std::string line;
+    while (std::getline(iss, line)) {
+        if (!line.empty() && line[0] != ';') {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+std::string join_lines(const std::vector<std::string>& lines) {
+    std::string structure;
+    for (const auto& line : lines) {
+        structure += line;
+        structure += '\n';
+    }
+    return structure;
+}
+
+bool has_tag(const std::string& line, ElementType type) {
+    return line.find(ElementTypeTags.at(type)) == 0;
+}
+
+// Identyfikator węzła w formacie łączy ("ramp-1", "worker-2", "store-3"); pusty dla łącza
+std::string node_ref(const std::string& line) {
+    auto params = parse_line(line);
+    if (has_tag(line, ElementType::RAMP)) {
+        return NODE_TYPE_RAMP + "-" + params["id"];
+    }
+    if (has_tag(line, ElementType::WORKER)) {
+        return NODE_TYPE_WORKER + "-" + params["id"];
+    }
+    if (has_tag(line, ElementType::STOREHOUSE)) {
+        return NODE_TYPE_STOREHOUSE + "-" + params["id"];
+    }
+    return "";
+}
+
+// Zamienia wartość parametru "key=..." (pusta value - usuwa parametr); "" gdy go nie ma
+std::string with_param(const std::string& line, const std::string& key, const std::string& value) {
+    const std::string token = " " + key + "=";
+    std::size_t begin = line.find(token);
+    if (begin == std::string::npos) {
+        return "";
+    }
+    std::size_t end = line.find(' ', begin + token.size());
+    if (end == std::string::npos) {
+        end = line.size();
+    }
+    std::string result = line.substr(0, begin);
+    if (!value.empty()) {
+        result += token + value;
+    }
+    return result + line.substr(end);
+}
+
+// Kandydaci na mniejszą strukturę powstali przez zmianę linii i
+std::vector<std::vector<std::string>> simplifications(const std::vector<std::string>& lines, std::size_t i) {
+    std::vector<std::vector<std::string>> candidates;
+    const std::string& line = lines[i];
+
+    // Usunięcie węzła razem z jego łączami albo samego łącza
+    const std::string ref = node_ref(line);
+    std::vector<std::string> removed;
+    for (std::size_t j = 0; j < lines.size(); ++j) {
+        if (j == i) {
+            continue;
+        }
+        if (!ref.empty() && has_tag(lines[j], ElementType::LINK)) {
+            auto params = parse_line(lines[j]);
+            if (params["src"] == ref || params["dest"] == ref) {
+                continue;
+            }
+        }
+        removed.push_back(lines[j]);
+    }
+    candidates.push_back(std::move(removed));
+
+    auto replaced = [&](const std::string& key, const std::string& value) {
+        std::string simpler = with_param(line, key, value);
+        if (!simpler.empty() && simpler != line) {
+            candidates.push_back(lines);
+            candidates.back()[i] = simpler;
+        }
+    };
+    if (has_tag(line, ElementType::RAMP)) {
+        replaced("delivery-interval", "1");
+    } else if (has_tag(line, ElementType::WORKER)) {
+        replaced("processing-time", "1");
+        replaced("queue-type", "FIFO");
+        replaced("queue-capacity", "");
+    }
+    return candidates;
+}
+
+// "[3 1 2]"
+std::string format_ids(const std::vector<ElementID>& ids) {
+    std::string text = "[";
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        text += (i == 0 ? "" : " ") + std::to_string(ids[i]);
+    }
+    return text + "]";
+}
+
+template <typename T>
+T uniform(std::mt19937_64& rng, T low, T high) {
+    return std::uniform_int_distribution<T>(low, high)(rng);
+}
+
+} // namespace
+
+QueueContents capture_queue_contents(const Factory& factory) {
+    std::vector<const Worker*> workers;
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        workers.push_back(&*it);
+    }
+    std::sort(workers.begin(), workers.end(), [](const Worker* a, const Worker* b) {
+        return a->get_id() < b->get_id();
+    });
+    QueueContents queues;
+    for (const Worker* w : workers) {
+        queues.emplace_back();
+        for (const auto& package : *w->get_queue()) {
+            queues.back().push_back(package.get_id());
+        }
+    }
+    return queues;
+}
+
+void TurnObserver::operator()(const Factory& factory, Time t) const {
+    const QueueContents queues = capture_queue_contents(factory);
+    callback_(capture_snapshot(factory, t), &queues);
+}
+
+void reference_engine(Factory& factory, TimeOffset d, std::uint64_t seed, const TurnObserver& observe) {
+    factory.seed_routing(seed);
+    simulate(factory, d, [&observe](Factory& f, TimeOffset t) {
+        observe(f, t);
+    });
+}
+
+SimulationEngine replay_engine() {
+    return [](Factory& factory, TimeOffset d, std::uint64_t seed, const TurnObserver& observe) {
+        std::ostringstream structure;
+        save_factory_structure(factory, structure);
+        RoutingLog log;
+        {
+            Factory recorded = load_structure(structure.str());
+            recorded.seed_routing(seed);
+            log = record_simulation(recorded, d, nullptr);
+        }
+        replay_simulation(factory, log, [&observe](Factory& f, TimeOffset t) {
+            observe(f, t);
+        });
+    };
+}
+
+SimulationEngine binary_structure_engine() {
+    return [](Factory& factory, TimeOffset d, std::uint64_t seed, const TurnObserver& observe) {
+        std::ostringstream os;
+        save_binary_structure(factory, os);
+        const std::string data = os.str();
+        Factory loaded = load_binary_structure(data.data(), data.size());
+        loaded.set_package_id_allocator(factory.package_id_allocator());
+        reference_engine(loaded, d, seed, observe);
+    };
+}
+
+SimulationEngine partitioned_engine(int shard_count) {
+    return [shard_count](Factory& factory, TimeOffset d, std::uint64_t seed, const TurnObserver& observe) {
+        observe(simulate_partitioned(factory, d, partition_factory(factory, shard_count), seed).snapshot);
+    };
+}
+
+std::string generate_random_structure(std::mt19937_64& rng, const RandomStructureOptions& options) {
+    const int ramps = uniform(rng, 1, options.max_ramps);
+    const int workers = uniform(rng, 1, options.max_workers);
+    const int storehouses = uniform(rng, 1, options.max_storehouses);
+    std::bernoulli_distribution extra_link(options.extra_link_probability);
+    std::bernoulli_distribution limited_queue(options.queue_capacity_probability);
+    std::bernoulli_distribution lifo(0.5);
+
+    std::ostringstream os;
+    for (int r = 1; r <= ramps; ++r) {
+        os << "LOADING_RAMP id=" << r << " delivery-interval=" << uniform(rng, 1, options.max_delivery_interval)
+           << '\n';
+    }
+    for (int w = 1; w <= workers; ++w) {
+        os << "WORKER id=" << w << " processing-time=" << uniform(rng, 1, options.max_processing_time)
+           << " queue-type=" << (lifo(rng) ? "LIFO" : "FIFO");
+        if (limited_queue(rng)) {
+            os << " queue-capacity=" << uniform(rng, 1, 3);
+        }
+        os << '\n';
+    }
+    for (int s = 1; s <= storehouses; ++s) {
+        os << "STOREHOUSE id=" << s << '\n';
+    }
+
+    auto worker_ref = [](int id) { return NODE_TYPE_WORKER + "-" + std::to_string(id); };
+    auto store_ref = [](int id) { return NODE_TYPE_STOREHOUSE + "-" + std::to_string(id); };
+    auto write_links = [&os](const std::string& src, const std::set<std::string>& dests) {
+        for (const auto& dest : dests) {
+            os << "LINK src=" << src << " dest=" << dest << '\n';
+        }
+    };
+
+    for (int r = 1; r <= ramps; ++r) {
+        std::set<std::string> dests{worker_ref(uniform(rng, 1, workers))};
+        for (int w = 1; w <= workers; ++w) {
+            if (extra_link(rng)) {
+                dests.insert(worker_ref(w));
+            }
+        }
+        write_links(NODE_TYPE_RAMP + "-" + std::to_string(r), dests);
+    }
+    for (int w = 1; w <= workers; ++w) {
+        // Łącze "w przód" gwarantuje drogę do magazynu
+        int forward = uniform(rng, w + 1, workers + storehouses);
+        std::set<std::string> dests{forward <= workers ? worker_ref(forward) : store_ref(forward - workers)};
+        for (int other = w + 1; other <= workers; ++other) {
+            if (extra_link(rng)) {
+                dests.insert(worker_ref(other));
+            }
+        }
+        for (int s = 1; s <= storehouses; ++s) {
+            if (extra_link(rng)) {
+                dests.insert(store_ref(s));
+            }
+        }
+        write_links(worker_ref(w), dests);
+    }
+    return os.str();
+}
+
+std::optional<DifferentialMismatch> compare_engines(const std::string& structure, std::uint64_t seed,
+                                                    TimeOffset d, const SimulationEngine& engine) {
+    // Każdy przebieg z własnym rejestrem ID - te same ID paczek w obu silnikach
+    std::vector<FactorySnapshot> expected;
+    std::vector<QueueContents> expected_queues;
+    {
+        PackageIdAllocator ids;
+        Factory reference = load_structure(structure);
+        reference.set_package_id_allocator(ids);
+        reference_engine(reference, d, seed, TurnObserver([&](const FactorySnapshot& s, const QueueContents* queues) {
+            expected.push_back(s);
+            expected_queues.push_back(*queues);
+        }));
+    }
+
+    std::optional<DifferentialMismatch> result;
+    auto report = [&](Time turn, const FactorySnapshot& actual, const QueueContents* queues, const std::string& error) {
+        const bool known = turn >= 1 && turn <= static_cast<Time>(expected.size());
+        result = DifferentialMismatch{structure, seed, turn, known ? expected[turn - 1] : FactorySnapshot{}, actual,
+                                      known ? expected_queues[turn - 1] : QueueContents{},
+                                      queues != nullptr ? *queues : QueueContents{}, error};
+    };
+
+    Time last = 0;
+    PackageIdAllocator ids;
+    Factory alternative = load_structure(structure);
+    alternative.set_package_id_allocator(ids);
+    try {
+        engine(alternative, d, seed, TurnObserver([&](const FactorySnapshot& actual, const QueueContents* queues) {
+            if (result) {
+                return;
+            }
+            if (actual.turn <= last || actual.turn > static_cast<Time>(expected.size())) {
+                report(d, actual, queues, "Turn " + std::to_string(actual.turn) + " reported out of order");
+                return;
+            }
+            last = actual.turn;
+            const FactorySnapshot& reference = expected[actual.turn - 1];
+            if (!(reference.workers == actual.workers) || !(reference.storehouses == actual.storehouses)
+                || !(reference.ramps == actual.ramps)
+                || (queues != nullptr && *queues != expected_queues[actual.turn - 1])) {
+                report(actual.turn, actual, queues, "");
+            }
+        }));
+    }
+    catch (const std::exception& e) {
+        if (!result) {
+            report(d, FactorySnapshot{}, nullptr, e.what());
+        }
+    }
+    if (!result && last == 0 && d > 0) {
+        report(d, FactorySnapshot{}, nullptr, "Engine reported no turns");
+    }
+    return result;
+}
+
+DifferentialMismatch shrink_mismatch(const DifferentialMismatch& mismatch, const SimulationEngine& engine) {
+    DifferentialMismatch best = mismatch;
+    std::vector<std::string> lines = split_lines(mismatch.structure);
+
+    auto attempt = [&](const std::vector<std::string>& candidate) -> std::optional<DifferentialMismatch> {
+        const std::string structure = join_lines(candidate);
+        try {
+            if (!load_structure(structure).is_consistent()) {
+                return std::nullopt;
+            }
+        }
+        catch (const std::exception&) {
+            return std::nullopt;
+        }
+        return compare_engines(structure, best.seed, best.turn, engine);
+    };
+
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (std::size_t i = 0; i < lines.size() && !progress; ++i) {
+            for (auto& candidate : simplifications(lines, i)) {
+                if (auto found = attempt(candidate)) {
+                    best = std::move(*found);
+                    lines = std::move(candidate);
+                    progress = true;
+                    break;
+                }
+            }
+        }
+    }
+    best.structure = join_lines(lines);
+    return best;
+}
+
+std::optional<DifferentialMismatch> run_differential(const SimulationEngine& engine,
+                                                     const DifferentialOptions& options) {
+    std::mt19937_64 rng(options.seed);
+    for (std::size_t i = 0; i < options.cases; ++i) {
+        const std::string structure = generate_random_structure(rng, options.structure);
+        if (auto mismatch = compare_engines(structure, options.seed + i, options.turns, engine)) {
+            return options.shrink ? shrink_mismatch(*mismatch, engine) : *mismatch;
+        }
+    }
+    return std::nullopt;
+}
+
+void generate_mismatch_report(const DifferentialMismatch& mismatch, std::ostream& os) {
+    os << "== DIFFERENTIAL MISMATCH ==\n";
+    os << "  Seed: " << mismatch.seed << "\n";
+    os << "  Turn: " << mismatch.turn << "\n";
+    if (!mismatch.error.empty()) {
+        os << "  Error: " << mismatch.error << "\n";
+    }
+    const auto& expected = mismatch.expected;
+    const auto& actual = mismatch.actual;
+    if (expected.workers.size() != actual.workers.size()
+        || expected.storehouses.size() != actual.storehouses.size() || expected.ramps.size() != actual.ramps.size()) {
+        os << "  Nodes: " << expected.workers.size() << " workers, " << expected.storehouses.size()
+           << " storehouses, " << expected.ramps.size() << " ramps -> " << actual.workers.size() << " workers, "
+           << actual.storehouses.size() << " storehouses, " << actual.ramps.size() << " ramps\n";
+    } else {
+        const bool queues_known = mismatch.actual_queues.size() == expected.workers.size()
+                                  && mismatch.expected_queues.size() == expected.workers.size();
+        for (std::size_t i = 0; i < expected.workers.size(); ++i) {
+            const WorkerSnapshot& e = expected.workers[i];
+            const WorkerSnapshot& a = actual.workers[i];
+            const bool reordered = queues_known && mismatch.expected_queues[i] != mismatch.actual_queues[i];
+            if (!(e == a) || reordered) {
+                os << "  WORKER #" << e.id << ": queue " << e.queue_length << " -> " << a.queue_length << ", busy "
+                   << int(e.busy) << " -> " << int(a.busy) << ", sending " << int(e.sending) << " -> "
+                   << int(a.sending) << ", blocked " << e.blocked_turns << " -> " << a.blocked_turns;
+                if (reordered) {
+                    os << ", queue order " << format_ids(mismatch.expected_queues[i]) << " -> "
+                       << format_ids(mismatch.actual_queues[i]);
+                }
+                os << "\n";
+            }
+        }
+        for (std::size_t i = 0; i < expected.storehouses.size(); ++i) {
+            if (!(expected.storehouses[i] == actual.storehouses[i])) {
+                os << "  STOREHOUSE #" << expected.storehouses[i].id << ": stock " << expected.storehouses[i].stock
+                   << " -> " << actual.storehouses[i].stock << "\n";
+            }
+        }
+        for (std::size_t i = 0; i < expected.ramps.size(); ++i) {
+            const RampSnapshot& e = expected.ramps[i];
+            const RampSnapshot& a = actual.ramps[i];
+            if (!(e == a)) {
+                os << "  LOADING_RAMP #" << e.id << ": loaded " << int(e.loaded) << " -> " << int(a.loaded)
+                   << ", blocked " << e.blocked_turns << " -> " << a.blocked_turns << "\n";
+            }
+        }
+    }
+    os << "  Structure:\n";
+    for (const auto& line : split_lines(mismatch.structure)) {
+        os << "    " << line << "\n";
+    }
+}
@@ -1,4 +1,10 @@
 #include "factory.hpp"
+#include "binary_structure.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <iterator>
+#include <string_view>
 
 bool Factory::is_consistent() const{
     std::map<const PackageSender*, NodeColor> colors;
@@ -63,8 +69,209 @@ bool Factory::has_reachable_storehouse(const PackageSender* sender, std::map<con
     }
 }
 
+void Factory::seed_routing(std::uint64_t seed, bool antithetic) {
+    for (auto& ramp : ramps_) {
+        std::uint64_t stream = (static_cast<std::uint64_t>(ElementType::RAMP) << 32) | static_cast<std::uint32_t>(ramp.get_id());
+        ramp.receiver_preferences_.set_probability_generator(make_probability_generator(seed, stream, antithetic));
+    }
+    for (auto& worker : workers_) {
+        std::uint64_t stream = (static_cast<std::uint64_t>(ElementType::WORKER) << 32) | static_cast<std::uint32_t>(worker.get_id());
+        worker.receiver_preferences_.set_probability_generator(make_probability_generator(seed, stream, antithetic));
+    }
+}
+
+void Factory::set_lineage_tracer(LineageTracer* tracer) {
+    tracer_ = tracer;
+    for (auto& ramp : ramps_) {
+        ramp.set_tracer(tracer, LineageNode::RAMP, ramp.get_id());
+    }
+    for (auto& worker : workers_) {
+        worker.set_tracer(tracer, LineageNode::WORKER, worker.get_id());
+    }
+    for (auto& storehouse : storehouses_) {
+        storehouse.set_tracer(tracer);
+    }
+}
+
+void Factory::set_package_id_allocator(PackageIdAllocator& ids) {
+    package_ids_ = &ids;
+    for (auto& ramp : ramps_) {
+        ramp.set_package_id_allocator(ids);
+    }
+}
+
+namespace {
+
+struct LinkDistances {
+    std::size_t links = 0;
+    double mean_distance = 0.0;
+    double forward = 0.0;
+};
+
+LinkDistances measure_link_distances(const Factory& f) {
+    std::map<const void*, std::size_t> position;
+    std::size_t pos = 0;
+    for (auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
+        position[static_cast<const PackageSender*>(&*it)] = pos++;
+    }
+    for (auto it = f.worker_cbegin(); it != f.worker_cend(); ++it) {
+        position[static_cast<const PackageSender*>(&*it)] = pos;
+        position[static_cast<const IPackageReceiver*>(&*it)] = pos++;
+    }
+    for (auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) {
+        position[static_cast<const IPackageReceiver*>(&*it)] = pos++;
+    }
+
+    LinkDistances result;
+    double total = 0.0;
+    std::size_t forward = 0;
+    auto add_links = [&](const PackageSender& sender) {
+        const std::size_t from = position.at(&sender);
+        for (const auto& [receiver, prob] : sender.receiver_preferences_.get_preferences()) {
+            const std::size_t to = position.at(static_cast<const IPackageReceiver*>(receiver));
+            total += static_cast<double>(to > from ? to - from : from - to);
+            forward += to > from ? 1 : 0;
+            ++result.links;
+        }
+    };
+    std::for_each(f.ramp_cbegin(), f.ramp_cend(), add_links);
+    std::for_each(f.worker_cbegin(), f.worker_cend(), add_links);
+
+    if (result.links > 0) {
+        result.mean_distance = total / static_cast<double>(result.links);
+        result.forward = static_cast<double>(forward) / static_cast<double>(result.links);
+    }
+    return result;
+}
+
+} // namespace
+
+LocalityReport Factory::reorder_for_locality() {
+    LocalityReport report;
+    LinkDistances before = measure_link_distances(*this);
+    report.links = before.links;
+    report.mean_distance_before = before.mean_distance;
+    report.forward_links_before = before.forward;
+
+    std::vector<ElementID> worker_order;
+    std::vector<ElementID> storehouse_order;
+    std::set<const IPackageReceiver*> seen;
+    std::vector<const PackageSender*> pending;
+    for (const auto& ramp : ramps_) {
+        pending.push_back(&ramp);
+    }
+    for (std::size_t next = 0; next < pending.size(); ++next) {
+        for (IPackageReceiver* receiver : pending[next]->receiver_preferences_.sorted_receivers()) {
+            if (!seen.insert(receiver).second) {
+                continue;
+            }
+            if (receiver->get_receiver_type() == ReceiverType::WORKER) {
+                worker_order.push_back(receiver->get_id());
+                pending.push_back(static_cast<const Worker*>(receiver));
+            } else {
+                storehouse_order.push_back(receiver->get_id());
+            }
+        }
+    }
+
+    std::map<const IPackageReceiver*, IPackageReceiver*> moved;
+    auto old_workers = workers_.relocate(worker_order, [&moved](Worker& from, Worker& to) {
+        moved[&from] = &to;
+    });
+    auto old_storehouses = storehouses_.relocate(storehouse_order, [&moved](Storehouse& from, Storehouse& to) {
+        moved[&from] = &to;
+    });
+
+    auto remap = [&moved](PackageSender& sender) {
+        std::vector<IPackageReceiver*> receivers;
+        for (const auto& [receiver, prob] : sender.receiver_preferences_.get_preferences()) {
+            receivers.push_back(receiver);
+        }
+        for (IPackageReceiver* receiver : receivers) {
+            sender.receiver_preferences_.replace_receiver(receiver, moved.at(receiver));
+        }
+    };
+    std::for_each(ramps_.begin(), ramps_.end(), remap);
+    std::for_each(workers_.begin(), workers_.end(), remap);
+    workers_by_id_valid_ = false;
+    active_workers_valid_ = false;
+
+    LinkDistances after = measure_link_distances(*this);
+    report.mean_distance_after = after.mean_distance;
+    report.forward_links_after = after.forward;
+    return report;
+}
+
+ActiveWorkerSet& Factory::active_workers() {
+    if (!active_workers_) {
+        active_workers_ = std::make_unique<ActiveWorkerSet>();
+    }
+    if (!active_workers_valid_) {
+        worker_slots_.clear();
+        for (auto& worker : workers_) {
+            worker_slots_.push_back(&worker);
+        }
+        active_workers_->reset(worker_slots_.size());
+        for (std::size_t slot = 0; slot < worker_slots_.size(); ++slot) {
+            worker_slots_[slot]->attach_activity(active_workers_.get(), slot);
+            if (!worker_slots_[slot]->is_idle()) {
+                active_workers_->activate(slot);
+            }
+        }
+        active_workers_valid_ = true;
+    }
+    return *active_workers_;
+}
+
+// Nieaktualny zbiór po przebudowie zawierałby dokładnie robotników, którzy nie są bezczynni
+std::size_t Factory::active_worker_count() const {
+    if (active_workers_valid_) {
+        return active_workers_->size();
+    }
+    return static_cast<std::size_t>(std::count_if(workers_.cbegin(), workers_.cend(),
+                                                  [](const Worker& worker) { return !worker.is_idle(); }));
+}
+
+void generate_locality_report(const LocalityReport& report, std::ostream& os) {
+    os << "== LOCALITY ==\n";
+    os << "  Links: " << report.links << "\n";
+    os << "  Mean link distance: " << report.mean_distance_before << " -> " << report.mean_distance_after << "\n";
+    os << "  Forward links: " << report.forward_links_before * 100.0 << "% -> "
+       << report.forward_links_after * 100.0 << "%\n";
+}
+
+Factory load_factory_structure(std::istream& is, const LoadOptions& options) {
+    Factory factory = load_factory_structure(is);
+    if (options.reorder_for_locality) {
+        factory.reorder_for_locality();
+    }
+    return factory;
+}
+
 Factory load_factory_structure(std::istream& is) {
+    // Plik binarny zaczyna się od 'N' - żaden poprawny wiersz tekstowy tak się nie zaczyna
+    if (is.peek() == static_cast<int>(BINARY_STRUCTURE_MAGIC & 0xFF)) {
+        std::string bytes((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        std::vector<std::uint64_t> aligned((bytes.size() + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+        std::memcpy(aligned.data(), bytes.data(), bytes.size());
+        return load_binary_structure(aligned.data(), bytes.size());
+    }
+
     Factory factory;
+    // Indeksy węzłów i połączenia zbierane dla każdego nadawcy - dodawane hurtem na końcu
+    std::map<ElementID, Ramp*> ramps;
+    std::map<ElementID, Worker*> workers;
+    std::map<ElementID, Storehouse*> storehouses;
+    std::map<PackageSender*, std::vector<IPackageReceiver*>> links;
+
+    auto find_node = [](auto& index, ElementID id) {
+        auto it = index.find(id);
+        if (it == index.end()) {
+            throw std::logic_error("LINK refers to undefined node");
+        }
+        return it->second;
+    };
+
     std::string line;
     while(std::getline(is, line)) {
         if(line.empty() || line[0] == ';') {
@@ -72,57 +279,62 @@ Factory load_factory_structure(std::istream& is) {
         }
         if(line.find(ElementTypeTags.at(ElementType::RAMP)) == 0) {
             auto params = parse_line(line);
-            factory.add_ramp(Ramp(std::stoi(params["id"]), std::stoi(params["delivery-interval"])));    
+            ElementID id = std::stoi(params["id"]);
+            factory.add_ramp(Ramp(id, std::stoi(params["delivery-interval"])));
+            ramps.emplace(id, &*std::prev(factory.ramp_end()));
         }
         else if(line.find(ElementTypeTags.at(ElementType::WORKER)) == 0) {
             auto params = parse_line(line);
             ElementID id = std::stoi(params["id"]);
             TimeOffset pd = std::stoi(params["processing-time"]);
             PackageQueueType qt = (params["queue-type"] == "FIFO") ? PackageQueueType::FIFO : PackageQueueType::LIFO;
-            factory.add_worker(Worker(id, pd, std::make_unique<PackageQueue>(qt)));
+            std::size_t capacity = params.count("queue-capacity") ? std::stoul(params["queue-capacity"]) : 0;
+            factory.add_worker(Worker(id, pd, std::make_unique<PackageQueue>(qt), capacity));
+            workers.emplace(id, &*std::prev(factory.worker_end()));
         }
         else if(line.find(ElementTypeTags.at(ElementType::STOREHOUSE)) == 0) {
             auto params = parse_line(line);
             ElementID id = std::stoi(params["id"]);
             factory.add_storehouse(Storehouse(id));
+            storehouses.emplace(id, &*std::prev(factory.storehouse_end()));
         }
         else if(line.find(ElementTypeTags.at(ElementType::LINK)) == 0) {
             auto params = parse_line(line);
             auto src_data = decode_node_id(params["src"]);
             auto dest_data = decode_node_id(params["dest"]);
+            PackageSender* sender = nullptr;
             if(src_data.first == NODE_TYPE_RAMP) {
-                auto ramp_it = factory.find_ramp_by_id(src_data.second);
-                if(dest_data.first == NODE_TYPE_WORKER) {
-                    auto worker_it = factory.find_worker_by_id(dest_data.second);
-                    ramp_it->receiver_preferences_.add_receiver(&(*worker_it));
-                }
-                else if(dest_data.first == NODE_TYPE_STOREHOUSE) {
-                    auto storehouse_it = factory.find_storehouse_by_id(dest_data.second);
-                    ramp_it->receiver_preferences_.add_receiver(&(*storehouse_it));
-                }
-                else {
+                sender = find_node(ramps, src_data.second);
+                if(dest_data.first != NODE_TYPE_WORKER && dest_data.first != NODE_TYPE_STOREHOUSE) {
                     throw std::logic_error("Invalid LINK destination for RAMP");
                 }
             }
-            if(src_data.first == NODE_TYPE_WORKER) {
-                auto worker_it = factory.find_worker_by_id(src_data.second);
-                if(dest_data.first == NODE_TYPE_WORKER) {
-                    auto dest_worker_it = factory.find_worker_by_id(dest_data.second);
-                    worker_it->receiver_preferences_.add_receiver(&(*dest_worker_it));
-                }
-                else if(dest_data.first == NODE_TYPE_STOREHOUSE) {
-                    auto sh_it = factory.find_storehouse_by_id(dest_data.second);
-                    worker_it->receiver_preferences_.add_receiver(&(*sh_it));
-                }
-                else {
+            else if(src_data.first == NODE_TYPE_WORKER) {
+                sender = find_node(workers, src_data.second);
+                if(dest_data.first != NODE_TYPE_WORKER && dest_data.first != NODE_TYPE_STOREHOUSE) {
                     throw std::logic_error("Invalid LINK destination for WORKER");
                 }
             }
+            else {
+                continue;
+            }
+            IPackageReceiver* receiver = nullptr;
+            if(dest_data.first == NODE_TYPE_WORKER) {
+                receiver = find_node(workers, dest_data.second);
+            }
+            else {
+                receiver = find_node(storehouses, dest_data.second);
+            }
+            links[sender].push_back(receiver);
         }
         else {
             throw std::logic_error("Invalid structure");
         }
     }
+
+    for (auto& [sender, receivers] : links) {
+        sender->receiver_preferences_.add_receivers(receivers);
+    }
     return factory;
 }
 
@@ -148,43 +360,216 @@ std::pair<std::string, int> decode_node_id(const std::string& raw_id) {
 }
 
 
-void generate_structure_report(const Factory& f, std::ostream& os) {
-    os << "\n== LOADING RAMPS ==\n\n";
-    for(auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
-        os << "LOADING RAMP #" << it->get_id() << "\n";
-        os << "  Delivery interval: " << it->get_delivery_interval() << "\n";
-        os << "  Receivers:\n";
-        
-        const auto& prefs = it->receiver_preferences_.get_preferences();
+namespace {
 
-        std::vector<std::pair<std::string, ElementID>> sorted_receivers;
-        for(auto const& [receiver, probability] : prefs) {
-            if(dynamic_cast<const Storehouse*>(receiver)) {
-                sorted_receivers.push_back({REPORT_NODE_STOREHOUSE, receiver->get_id()});
-            }
-            else if(dynamic_cast<const Worker*>(receiver)) {
-                sorted_receivers.push_back({REPORT_NODE_WORKER, receiver->get_id()});
+// Bufor raportów: tekst składany w stałej tablicy i wypisywany do strumienia
+// dużymi blokami; liczby formatowane przez std::to_chars bez alokacji.
+class ReportBuffer {
+public:
+    explicit ReportBuffer(std::ostream& os) : os_(os) {}
+    ~ReportBuffer() { flush(); }
+
+    ReportBuffer(const ReportBuffer&) = delete;
+    ReportBuffer& operator=(const ReportBuffer&) = delete;
+
+    ReportBuffer& operator<<(std::string_view text) {
+        if (text.size() > sizeof(data_) - size_) {
+            flush();
+            if (text.size() > sizeof(data_)) {
+                os_.write(text.data(), static_cast<std::streamsize>(text.size()));
+                return *this;
             }
         }
+        std::memcpy(data_ + size_, text.data(), text.size());
+        size_ += text.size();
+        return *this;
+    }
 
-        std::sort(sorted_receivers.begin(), sorted_receivers.end(),
-                  [](const auto& a, const auto& b) {
-                      if(a.first != b.first) {
-                          return a.first < b.first;
-                      }
-                      return a.second < b.second;
-                  });
-        
-        for (const auto& receiver : sorted_receivers) {
-            os << "    " << receiver.first << " #" << receiver.second << "\n";
+    ReportBuffer& operator<<(char c) {
+        if (size_ == sizeof(data_)) {
+            flush();
+        }
+        data_[size_++] = c;
+        return *this;
+    }
+
+    ReportBuffer& operator<<(int value) {
+        if (sizeof(data_) - size_ < max_int_chars) {
+            flush();
+        }
+        auto result = std::to_chars(data_ + size_, data_ + sizeof(data_), value);
+        size_ = static_cast<std::size_t>(result.ptr - data_);
+        return *this;
+    }
+
+    ReportBuffer& operator<<(std::size_t value) {
+        if (sizeof(data_) - size_ < max_size_chars) {
+            flush();
+        }
+        auto result = std::to_chars(data_ + size_, data_ + sizeof(data_), value);
+        size_ = static_cast<std::size_t>(result.ptr - data_);
+        return *this;
+    }
+
+    void flush() {
+        if (size_ > 0) {
+            os_.write(data_, static_cast<std::streamsize>(size_));
+            size_ = 0;
         }
-        os << "\n";
+    }
+
+private:
+    static constexpr std::size_t max_int_chars = 12;
+    static constexpr std::size_t max_size_chars = 20;
+
+    std::ostream& os_;
+    std::size_t size_ = 0;
+    char data_[16384];
+};
+
+void write_receivers(ReportBuffer& out, const ReceiverPreferences& prefs) {
+    for (const IPackageReceiver* receiver : prefs.sorted_receivers()) {
+        out << "    "
+            << (receiver->get_receiver_type() == ReceiverType::STOREHOUSE ? std::string_view(REPORT_NODE_STOREHOUSE)
+                                                                          : std::string_view(REPORT_NODE_WORKER))
+            << " #" << receiver->get_id() << '\n';
+    }
+    out << '\n';
+}
+
+void write_packages(ReportBuffer& out, IPackageStockpile::const_iterator first, IPackageStockpile::const_iterator last) {
+    if (first == last) {
+        out << "(empty)\n";
+        return;
+    }
+    out << '#' << first->get_id();
+    for (++first; first != last; ++first) {
+        out << ", #" << first->get_id();
+    }
+    out << '\n';
+}
+
+} // namespace
+
+const std::vector<const Worker*>& Factory::workers_by_id() const {
+    if (!workers_by_id_valid_) {
+        workers_by_id_.clear();
+        for (const auto& worker : workers_) {
+            workers_by_id_.push_back(&worker);
+        }
+        std::sort(workers_by_id_.begin(), workers_by_id_.end(), [](const Worker* a, const Worker* b) {
+            return a->get_id() < b->get_id();
+        });
+        workers_by_id_valid_ = true;
+    }
+    return workers_by_id_;
+}
+
+namespace {
+
+// Węzeł std::list: dwa wskaźniki + wartość; węzeł drzewa std::map/std::set: kolor i trzy wskaźniki + wartość
+template <typename T>
+constexpr std::size_t list_node_bytes() {
+    return 2 * sizeof(void*) + sizeof(T);
+}
+
+template <typename T>
+constexpr std::size_t tree_node_bytes() {
+    return 4 * sizeof(void*) + sizeof(T);
+}
+
+} // namespace
+
+std::vector<std::pair<const char*, MemoryComponent>> MemoryUsage::components() const {
+    return {{"ramps", ramps},
+            {"workers", workers},
+            {"storehouses", storehouses},
+            {"worker_queues", worker_queues},
+            {"storehouse_stock", storehouse_stock},
+            {"receiver_preferences", receiver_preferences},
+            {"routing_generators", routing_generators},
+            {"package_ids", package_ids},
+            {"factory_indexes", factory_indexes}};
+}
+
+std::size_t MemoryUsage::total_bytes() const {
+    std::size_t total = 0;
+    for (const auto& [name, component] : components()) {
+        total += component.bytes;
+    }
+    return total;
+}
+
+MemoryUsage Factory::memory_usage() const {
+    using PreferenceEntry = ReceiverPreferences::preferences_t::value_type;
+    MemoryUsage usage;
+    usage.bytes_per_queued_package = list_node_bytes<Package>() + tree_node_bytes<ElementID>();
+
+    auto add_preferences = [&usage](const PackageSender& sender) {
+        const auto& prefs = sender.receiver_preferences_;
+        ++usage.routing_generators.objects;
+        usage.receiver_preferences.objects += prefs.get_preferences().size();
+        usage.receiver_preferences.bytes += prefs.get_preferences().size() * tree_node_bytes<PreferenceEntry>()
+                                            + prefs.sorted_receivers_capacity() * sizeof(IPackageReceiver*);
+    };
+
+    for (const auto& ramp : ramps_) {
+        ++usage.ramps.objects;
+        add_preferences(ramp);
+    }
+    usage.ramps.bytes = usage.ramps.objects * list_node_bytes<Ramp>();
+
+    for (const auto& worker : workers_) {
+        ++usage.workers.objects;
+        add_preferences(worker);
+        usage.worker_queues.objects += worker.get_queue()->size();
+    }
+    usage.workers.bytes = usage.workers.objects * list_node_bytes<Worker>();
+    usage.worker_queues.bytes =
+        usage.workers.objects * sizeof(PackageQueue) + usage.worker_queues.objects * list_node_bytes<Package>();
+
+    for (const auto& storehouse : storehouses_) {
+        ++usage.storehouses.objects;
+        usage.storehouse_stock.objects += storehouse.size();
+    }
+    usage.storehouses.bytes = usage.storehouses.objects * list_node_bytes<Storehouse>();
+    usage.storehouse_stock.bytes =
+        usage.storehouses.objects * sizeof(PackageQueue) + usage.storehouse_stock.objects * list_node_bytes<Package>();
+
+    usage.routing_generators.bytes = usage.routing_generators.objects * sizeof(RoutingStream);
+
+    usage.package_ids.objects = package_ids_->assigned_count() + package_ids_->freed_count();
+    usage.package_ids.bytes = usage.package_ids.objects * tree_node_bytes<ElementID>();
+
+    usage.factory_indexes.objects = workers_by_id_.size() + worker_slots_.size();
+    usage.factory_indexes.bytes = (workers_by_id_.capacity() + worker_slots_.capacity()) * sizeof(void*)
+                                  + (active_workers_ ? sizeof(ActiveWorkerSet) + active_workers_->memory_bytes() : 0);
+    return usage;
+}
+
+void generate_memory_report(const MemoryUsage& usage, std::ostream& os) {
+    os << "== MEMORY ==\n";
+    for (const auto& [name, component] : usage.components()) {
+        os << "  " << name << ": " << component.objects << " objects, " << component.bytes << " B\n";
+    }
+    os << "  Total: " << usage.total_bytes() << " B\n";
+    os << "  Per queued package: " << usage.bytes_per_queued_package << " B\n";
+}
+
+void generate_structure_report(const Factory& f, std::ostream& os) {
+    ReportBuffer out(os);
+    out << "\n== LOADING RAMPS ==\n\n";
+    for(auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
+        out << "LOADING RAMP #" << it->get_id() << '\n';
+        out << "  Delivery interval: " << it->get_delivery_interval() << '\n';
+        out << "  Receivers:\n";
+        write_receivers(out, it->receiver_preferences_);
     }
     
-    os << "\n== WORKERS ==\n\n";
+    out << "\n== WORKERS ==\n\n";
     for(auto it = f.worker_cbegin(); it != f.worker_cend(); ++it) {
         PackageQueueType qt = it->get_queue()->get_queue_type();
-        std::string sqt;
+        std::string_view sqt;
         if(qt == PackageQueueType::FIFO) {
             sqt = "FIFO";
         }
@@ -194,96 +579,128 @@ void generate_structure_report(const Factory& f, std::ostream& os) {
         else {
             throw std::logic_error("Invalid queue type");
         }
-        os << "WORKER #" << it->get_id() << "\n";
-        os << "  Processing time: " << it->get_processing_duration() << "\n";
-        os << "  Queue type: " << sqt << "\n";
-        os << "  Receivers:\n";
-        const auto& prefs = it->receiver_preferences_.get_preferences();
-
-        std::vector<std::pair<std::string, ElementID>> sorted_receivers;
-        for(auto const& [receiver, probability] : prefs) {
-            if(dynamic_cast<const Storehouse*>(receiver)) {
-                sorted_receivers.push_back({REPORT_NODE_STOREHOUSE, receiver->get_id()});
-            }
-            else if(dynamic_cast<const Worker*>(receiver)) {
-                sorted_receivers.push_back({REPORT_NODE_WORKER, receiver->get_id()});
-            }
-        }
-
-        std::sort(sorted_receivers.begin(), sorted_receivers.end(),
-                  [](const auto& a, const auto& b) {
-                      if(a.first != b.first) {
-                          return a.first < b.first;
-                      }
-                      return a.second < b.second;
-                  });
-        
-        for (const auto& receiver : sorted_receivers) {
-            os << "    " << receiver.first << " #" << receiver.second << "\n";
+        out << "WORKER #" << it->get_id() << '\n';
+        out << "  Processing time: " << it->get_processing_duration() << '\n';
+        out << "  Queue type: " << sqt << '\n';
+        if (it->get_queue_capacity() != 0) {
+            out << "  Queue capacity: " << static_cast<int>(it->get_queue_capacity()) << '\n';
         }
-        os << "\n";
+        out << "  Receivers:\n";
+        write_receivers(out, it->receiver_preferences_);
     }
 
-    os << "\n== STOREHOUSES ==\n\n";
+    out << "\n== STOREHOUSES ==\n\n";
     for(auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) {
-        os << "STOREHOUSE #" << it->get_id() << "\n";
+        out << "STOREHOUSE #" << it->get_id() << '\n';
     }
 }
 
-void generate_simulation_report(const Factory& f, std::ostream& os, Time turn) {
-    os << "=== [ Turn: " << turn << " ] ===\n";
-    //WORKERS
-    os << "\n== WORKERS == \n";
+namespace {
 
-    std::vector<const Worker*> sorted_workers;
-    for(auto it = f.worker_cbegin(); it != f.worker_cend(); ++it) {
-        sorted_workers.push_back(&(*it));
+void write_ramp_state(ReportBuffer& out, const Ramp& ramp) {
+    out << "LOADING_RAMP #" << ramp.get_id() << '\n';
+    out << "  Blocked turns: " << ramp.get_blocked_turns() << "\n\n";
+}
+
+void write_worker_state(ReportBuffer& out, const Worker& worker, Time turn) {
+    out << "WORKER #" << worker.get_id() << '\n';
+    out << "  PBuffer: ";
+    if(worker.get_processing_buffer()) {
+        Time pt = turn - worker.get_package_processing_start_time() + 1;
+        out << '#' << worker.get_processing_buffer()->get_id() << " (pt = " << pt << ")\n";
+    } else {
+        out << "(empty)\n";
     }
-    std::sort(sorted_workers.begin(), sorted_workers.end(), [](const Worker* a, const Worker* b) {
-        return a->get_id() < b->get_id();
-    });
 
-    for(const auto& worker : sorted_workers) {
-        os << "WORKER #" << worker->get_id() << "\n";
-        os << "  PBuffer: ";
-        if(worker->get_processing_buffer()) {
-            Time pt = turn - worker->get_package_processing_start_time() + 1;
-            os << "#" << worker->get_processing_buffer()->get_id() << " (pt = " << pt << ")\n"; 
-        } else {
-            os << "(empty)\n";
-        }
-        
-        os << "  Queue: ";
-        if(worker->get_queue()->empty()) {
-            os << "(empty)\n";
-        } else {
-            for (auto it = worker ->get_queue()->cbegin(); it != worker->get_queue()->cend(); ++it) {
-                os << "#" << it->get_id() << (std::next(it) == worker->get_queue()->cend() ? "\n" : ", ");
-            }
-        }
-        
-        os << "  SBuffer: ";
-        if(worker->get_sending_buffer().has_value()) {
-            os << "#" << worker->get_sending_buffer()->get_id() << "\n";
-        } else {
-            os << "(empty)\n";
-        }
-        os << "\n";
+    out << "  Queue: ";
+    write_packages(out, worker.get_queue()->cbegin(), worker.get_queue()->cend());
+
+    out << "  SBuffer: ";
+    if(worker.get_sending_buffer().has_value()) {
+        out << '#' << worker.get_sending_buffer()->get_id() << '\n';
+    } else {
+        out << "(empty)\n";
+    }
+    if(worker.get_blocked_turns() != 0) {
+        out << "  Blocked turns: " << worker.get_blocked_turns() << '\n';
     }
+    out << '\n';
+}
 
-    os << "\n== STOREHOUSES == \n\n";
-    for(auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) {
-        os << "STOREHOUSE #" << it->get_id() << "\n";
-        os << "  Stock: ";
-        if(it->cbegin() == it->cend()) {
-            os << "(empty)\n";
-        } else {
-            for (auto pkg_it = it ->cbegin(); pkg_it != it->cend(); ++pkg_it) {
-                os << "#" << pkg_it->get_id() << (std::next(pkg_it) == it->cend() ? "\n" : ", ");
-            }
-        }
+void write_storehouse_state(ReportBuffer& out, const Storehouse& storehouse) {
+    out << "STOREHOUSE #" << storehouse.get_id() << '\n';
+    out << "  Stock: ";
+    write_packages(out, storehouse.cbegin(), storehouse.cend());
+}
+
+// Układ raportu symulacji; ramps/workers/storehouses wypisują fragmenty węzłów
+// (rampy tylko gdy któraś czekała na odbiorcę, robotnicy po ID)
+template <typename Ramps, typename Workers, typename Storehouses>
+void write_simulation_report(ReportBuffer& out, Time turn, bool ramps_blocked, Ramps ramps, Workers workers,
+                             Storehouses storehouses) {
+    out << "=== [ Turn: " << turn << " ] ===\n";
+    if(ramps_blocked) {
+        out << "\n== LOADING RAMPS == \n";
+        ramps();
     }
-    os << "\n";
+    out << "\n== WORKERS == \n";
+    workers();
+    out << "\n== STOREHOUSES == \n\n";
+    storehouses();
+    out << '\n';
+}
+
+} // namespace
+
+void generate_simulation_report(const Factory& f, std::ostream& os, Time turn) {
+    ReportBuffer out(os);
+    bool ramps_blocked = std::any_of(f.ramp_cbegin(), f.ramp_cend(),
+                                     [](const Ramp& ramp) { return ramp.get_blocked_turns() != 0; });
+    write_simulation_report(
+        out, turn, ramps_blocked,
+        [&] {
+            for(auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
+                write_ramp_state(out, *it);
+            }
+        },
+        [&] {
+            for(const Worker* worker : f.workers_by_id()) {
+                write_worker_state(out, *worker, turn);
+            }
+        },
+        [&] {
+            for(auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) {
+                write_storehouse_state(out, *it);
+            }
+        });
+}
+
+void generate_ramp_state(const Ramp& r, std::ostream& os) {
+    ReportBuffer out(os);
+    write_ramp_state(out, r);
+}
+
+void generate_worker_state(const Worker& w, std::ostream& os, Time turn) {
+    ReportBuffer out(os);
+    write_worker_state(out, w, turn);
+}
+
+void generate_storehouse_state(const Storehouse& s, std::ostream& os) {
+    ReportBuffer out(os);
+    write_storehouse_state(out, s);
+}
+
+void assemble_simulation_report(std::ostream& os, Time turn, const std::vector<std::string>& ramps,
+                                const std::vector<std::string>& workers, const std::vector<std::string>& storehouses) {
+    ReportBuffer out(os);
+    auto write_all = [&out](const std::vector<std::string>& parts) {
+        return [&out, &parts] {
+            for (const auto& part : parts) {
+                out << std::string_view(part);
+            }
+        };
+    };
+    write_simulation_report(out, turn, !ramps.empty(), write_all(ramps), write_all(workers), write_all(storehouses));
 }
 
 void link_fill(std::stringstream& link_stream, const PackageSender& package_sender, ElementID package_sender_id, std::string package_sender_type){
@@ -313,7 +730,11 @@ void save_factory_structure(const Factory& factory, std::ostream& os){
         
         os << "WORKER id=" << worker.get_id() 
            << " processing-time=" << worker.get_processing_duration() 
-           << " queue-type=" << queue_type_str << '\n';
+           << " queue-type=" << queue_type_str;
+        if (worker.get_queue_capacity() != 0) {
+            os << " queue-capacity=" << worker.get_queue_capacity();
+        }
+        os << '\n';
            
         link_fill(link_stream, worker, worker.get_id(), "worker");
     });
@@ -327,4 +748,12 @@ void save_factory_structure(const Factory& factory, std::ostream& os){
     os << link_stream.str();
 
     os.flush();
-}
\ No newline at end of file
+}
+
+void save_factory_structure(const Factory& factory, std::ostream& os, StructureFormat format) {
+    if (format == StructureFormat::BINARY) {
+        save_binary_structure(factory, os);
+    } else {
+        save_factory_structure(factory, os);
+    }
+}
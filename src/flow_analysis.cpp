@@ -0,0 +1,168 @@
+#include "flow_analysis.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+
+// Połączenia wchodzące do węzła w formacie CSR
+struct IncomingLinks {
+    std::vector<std::size_t> offsets;
+    std::vector<std::size_t> sources;
+    std::vector<double> probabilities;
+};
+
+} // namespace
+
+FlowAnalysis analyze_flow(const Factory& factory, const FlowAnalysisOptions& options) {
+    std::vector<const Worker*> workers;
+    std::unordered_map<const IPackageReceiver*, std::size_t> worker_index;
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        worker_index.emplace(&*it, workers.size());
+        workers.push_back(&*it);
+    }
+    std::vector<const Storehouse*> storehouses;
+    std::unordered_map<const IPackageReceiver*, std::size_t> storehouse_index;
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        storehouse_index.emplace(&*it, storehouses.size());
+        storehouses.push_back(&*it);
+    }
+
+    const std::size_t n = workers.size();
+    std::vector<double> external(n, 0.0);
+    std::vector<double> store_external(storehouses.size(), 0.0);
+    std::vector<double> service(n, 0.0);
+    std::vector<double> self_prob(n, 0.0);
+
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        const double rate = 1.0 / it->get_delivery_interval();
+        for (const auto& [receiver, prob] : it->receiver_preferences_.get_preferences()) {
+            if (receiver->get_receiver_type() == ReceiverType::WORKER) {
+                external[worker_index.at(receiver)] += rate * prob;
+            } else {
+                store_external[storehouse_index.at(receiver)] += rate * prob;
+            }
+        }
+    }
+
+    // Zliczenie, potem wypełnienie CSR (bez pętli własnych - te liczone osobno)
+    IncomingLinks in;
+    in.offsets.assign(n + 1, 0);
+    for (std::size_t i = 0; i < n; ++i) {
+        service[i] = 1.0 / workers[i]->get_processing_duration();
+        for (const auto& [receiver, prob] : workers[i]->receiver_preferences_.get_preferences()) {
+            if (receiver->get_receiver_type() != ReceiverType::WORKER) {
+                continue;
+            }
+            std::size_t target = worker_index.at(receiver);
+            if (target == i) {
+                self_prob[i] += prob;
+            } else {
+                ++in.offsets[target + 1];
+            }
+        }
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        in.offsets[i + 1] += in.offsets[i];
+    }
+    in.sources.resize(in.offsets[n]);
+    in.probabilities.resize(in.offsets[n]);
+    std::vector<std::size_t> fill(in.offsets.begin(), in.offsets.end() - 1);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (const auto& [receiver, prob] : workers[i]->receiver_preferences_.get_preferences()) {
+            if (receiver->get_receiver_type() != ReceiverType::WORKER) {
+                continue;
+            }
+            std::size_t target = worker_index.at(receiver);
+            if (target != i) {
+                in.sources[fill[target]] = i;
+                in.probabilities[fill[target]++] = prob;
+            }
+        }
+    }
+
+    // Gauss-Seidel: lambda_i = b_i + sum_j min(lambda_j, mu_j) p_ji, pętla własna rozwiązana jawnie
+    std::vector<double> arrival(external);
+    FlowAnalysis analysis;
+    for (analysis.iterations = 1; analysis.iterations <= options.max_iterations; ++analysis.iterations) {
+        double residual = 0.0;
+        for (std::size_t i = 0; i < n; ++i) {
+            double rest = external[i];
+            for (std::size_t k = in.offsets[i]; k < in.offsets[i + 1]; ++k) {
+                std::size_t j = in.sources[k];
+                rest += std::min(arrival[j], service[j]) * in.probabilities[k];
+            }
+            double value = rest;
+            if (self_prob[i] > 0.0) {
+                value = self_prob[i] < 1.0 ? rest / (1.0 - self_prob[i]) : INFINITY;
+                if (value >= service[i]) {
+                    value = rest + service[i] * self_prob[i];
+                }
+            }
+            residual = std::max(residual, std::abs(value - arrival[i]) / std::max(1.0, std::abs(value)));
+            arrival[i] = value;
+        }
+        analysis.residual = residual;
+        if (residual < options.tolerance) {
+            analysis.converged = true;
+            break;
+        }
+    }
+    analysis.iterations = std::min(analysis.iterations, options.max_iterations);
+
+    std::vector<double> store_arrival(store_external);
+    for (std::size_t i = 0; i < n; ++i) {
+        const double out = std::min(arrival[i], service[i]);
+        for (const auto& [receiver, prob] : workers[i]->receiver_preferences_.get_preferences()) {
+            if (receiver->get_receiver_type() == ReceiverType::STOREHOUSE) {
+                store_arrival[storehouse_index.at(receiver)] += out * prob;
+            }
+        }
+    }
+
+    analysis.workers.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        const double utilization = arrival[i] / service[i];
+        analysis.workers.push_back({workers[i]->get_id(), arrival[i], service[i], utilization, utilization >= 1.0});
+    }
+    std::sort(analysis.workers.begin(), analysis.workers.end(),
+              [](const WorkerFlow& a, const WorkerFlow& b) { return a.id < b.id; });
+    for (std::size_t i = 0; i < storehouses.size(); ++i) {
+        analysis.storehouses.push_back({storehouses[i]->get_id(), store_arrival[i]});
+    }
+    std::sort(analysis.storehouses.begin(), analysis.storehouses.end(),
+              [](const StorehouseFlow& a, const StorehouseFlow& b) { return a.id < b.id; });
+    return analysis;
+}
+
+void generate_flow_report(const FlowAnalysis& analysis, std::ostream& os) {
+    os << "== FLOW BALANCE ==\n";
+    os << "  Solver: " << analysis.iterations << " iterations, residual " << analysis.residual
+       << (analysis.converged ? "" : " (NOT CONVERGED)") << "\n\n";
+
+    const WorkerFlow* bottleneck = nullptr;
+    for (const auto& w : analysis.workers) {
+        if (bottleneck == nullptr || w.utilization > bottleneck->utilization) {
+            bottleneck = &w;
+        }
+    }
+
+    for (const auto& w : analysis.workers) {
+        os << "WORKER #" << w.id << "\n";
+        os << "  Arrival rate: " << w.arrival_rate << "\n";
+        os << "  Service rate: " << w.service_rate << "\n";
+        os << "  Utilization: " << w.utilization * 100.0 << "%";
+        if (w.unstable) {
+            os << " (UNSTABLE)";
+        }
+        os << "\n\n";
+    }
+    for (const auto& s : analysis.storehouses) {
+        os << "STOREHOUSE #" << s.id << "\n";
+        os << "  Arrival rate: " << s.arrival_rate << "\n\n";
+    }
+    if (bottleneck != nullptr) {
+        os << "Bottleneck: worker #" << bottleneck->id << "\n";
+    }
+}
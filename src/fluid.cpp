@@ -0,0 +1,282 @@
+#include "fluid.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+// Ziarno jak w make_probability_generator(), więc przy pojedynczych paczkach
+// losowania są identyczne z Factory::seed_routing()
+void seed_engine(RoutingStream& engine, std::uint64_t seed, ElementType type, ElementID id) {
+    const std::uint64_t stream = (static_cast<std::uint64_t>(type) << 32) | static_cast<std::uint32_t>(id);
+    engine = RoutingStream(seed, stream);
+}
+
+} // namespace
+
+FluidFactory::FluidFactory(const Factory& factory, const FluidOptions& options) : batch_size_(options.batch_size) {
+    if (batch_size_ == 0) {
+        throw std::invalid_argument("Batch size must be positive");
+    }
+    if (!factory.is_consistent()) {
+        throw std::logic_error("Non-consistent factory");
+    }
+
+    std::unordered_map<const IPackageReceiver*, std::size_t> worker_index;
+    std::unordered_map<const IPackageReceiver*, std::size_t> storehouse_index;
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        worker_index.emplace(&*it, worker_index.size());
+    }
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        storehouse_index.emplace(&*it, storehouses_.size());
+        storehouses_.push_back(FluidStorehouse{it->get_id(), 0});
+    }
+
+    auto add_links = [&](const PackageSender& sender, FluidSender& fluid) {
+        fluid.first_link = links_.size();
+        const auto& prefs = sender.receiver_preferences_.get_preferences();
+        for (IPackageReceiver* receiver : sender.receiver_preferences_.sorted_receivers()) {
+            bool store = receiver->get_receiver_type() == ReceiverType::STOREHOUSE;
+            links_.push_back(FluidLink{store, store ? storehouse_index.at(receiver) : worker_index.at(receiver),
+                                       prefs.at(receiver)});
+        }
+        fluid.link_count = links_.size() - fluid.first_link;
+    };
+
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        FluidRamp ramp;
+        ramp.id = it->get_id();
+        ramp.delivery_interval = it->get_delivery_interval();
+        add_links(*it, ramp);
+        seed_engine(ramp.engine, options.seed, ElementType::RAMP, ramp.id);
+        ramps_.push_back(std::move(ramp));
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        FluidWorker worker;
+        worker.id = it->get_id();
+        worker.processing_duration = it->get_processing_duration();
+        worker.queue_type = it->get_queue()->get_queue_type();
+        worker.queue_capacity = it->get_queue_capacity();
+        add_links(*it, worker);
+        seed_engine(worker.engine, options.seed, ElementType::WORKER, worker.id);
+        workers_.push_back(std::move(worker));
+    }
+
+    workers_by_id_.resize(workers_.size());
+    for (std::size_t i = 0; i < workers_by_id_.size(); ++i) {
+        workers_by_id_[i] = i;
+    }
+    std::sort(workers_by_id_.begin(), workers_by_id_.end(),
+              [this](std::size_t a, std::size_t b) { return workers_[a].id < workers_[b].id; });
+}
+
+void FluidFactory::reseed(std::uint64_t seed) {
+    for (auto& ramp : ramps_) {
+        seed_engine(ramp.engine, seed, ElementType::RAMP, ramp.id);
+    }
+    for (auto& worker : workers_) {
+        seed_engine(worker.engine, seed, ElementType::WORKER, worker.id);
+    }
+}
+
+void FluidFactory::do_deliveries(Time t) {
+    turn_ = t;
+    for (auto& ramp : ramps_) {
+        if (ramp.buffer == 0 && (t - 1) % ramp.delivery_interval == 0) {
+            ramp.buffer = batch_size_;
+            delivered_ += batch_size_;
+        }
+    }
+}
+
+void FluidFactory::do_package_passing() {
+    for (auto& ramp : ramps_) {
+        route(ramp);
+    }
+    for (auto& worker : workers_) {
+        route(worker);
+    }
+}
+
+void FluidFactory::do_work(Time t) {
+    for (auto& worker : workers_) {
+        if (worker.processing == 0 && worker.queued != 0) {
+            // Pobranie partii: FIFO od najstarszych kohort, LIFO od najnowszych
+            std::uint64_t wanted = std::min(batch_size_, worker.queued);
+            worker.processing = wanted;
+            worker.processing_start = t;
+            worker.queued -= wanted;
+            worker.started += wanted;
+            while (wanted != 0) {
+                FluidCohort& cohort = worker.queue_type == PackageQueueType::FIFO ? worker.queue.front()
+                                                                                  : worker.queue.back();
+                std::uint64_t taken = std::min(wanted, cohort.count);
+                worker.total_wait += static_cast<double>(taken) * static_cast<double>(t - cohort.arrival);
+                cohort.count -= taken;
+                wanted -= taken;
+                if (cohort.count == 0) {
+                    if (worker.queue_type == PackageQueueType::FIFO) {
+                        worker.queue.pop_front();
+                    } else {
+                        worker.queue.pop_back();
+                    }
+                }
+            }
+        }
+        if (worker.processing != 0 && worker.buffer == 0
+            && t - worker.processing_start + 1 >= worker.processing_duration) {
+            worker.buffer = worker.processing;
+            worker.processing = 0;
+        }
+    }
+}
+
+void FluidFactory::run(TimeOffset d, const std::function<void(const FluidFactory&, Time)>& rf) {
+    for (TimeOffset i = 0; i < d; ++i) {
+        Time t = turn_ + 1;
+        do_deliveries(t);
+        do_package_passing();
+        do_work(t);
+        if (rf) {
+            rf(*this, t);
+        }
+    }
+}
+
+// Dzieli bufor nadawcy między odbiorców; zwraca liczbę paczek, które zostały w buforze
+std::uint64_t FluidFactory::route(FluidSender& sender) {
+    if (sender.buffer == 0 || sender.link_count == 0) {
+        return 0;
+    }
+    std::uint64_t left = 0;
+
+    if (sender.buffer == 1) {
+        // Pojedyncza paczka: ten sam wybór co ReceiverPreferences::choose_receiver()
+        const double p = sender.engine.uniform();
+        const FluidLink* target = &links_[sender.first_link + sender.link_count - 1];
+        double distribution = 0.0;
+        for (std::size_t k = sender.first_link; k < sender.first_link + sender.link_count; ++k) {
+            distribution += links_[k].probability;
+            if (p <= distribution) {
+                target = &links_[k];
+                break;
+            }
+        }
+        left = 1 - accept(*target, 1);
+    } else {
+        // Rozkład wielomianowy jako ciąg rozkładów dwumianowych
+        std::uint64_t remaining = sender.buffer;
+        double remaining_probability = 1.0;
+        for (std::size_t k = sender.first_link; k < sender.first_link + sender.link_count && remaining != 0; ++k) {
+            const FluidLink& link = links_[k];
+            std::uint64_t share = remaining;
+            if (k + 1 < sender.first_link + sender.link_count && remaining_probability > 0.0) {
+                double p = std::min(1.0, link.probability / remaining_probability);
+                share = std::binomial_distribution<std::uint64_t>(remaining, p)(sender.engine);
+            }
+            remaining_probability -= link.probability;
+            remaining -= share;
+            left += share - accept(link, share);
+        }
+    }
+
+    sender.buffer = left;
+    if (left != 0) {
+        ++sender.blocked_turns;
+    }
+    return left;
+}
+
+// Przyjmuje do count paczek (do wolnego miejsca w kolejce); zwraca liczbę przyjętych
+std::uint64_t FluidFactory::accept(const FluidLink& link, std::uint64_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    if (link.store) {
+        storehouses_[link.index].stock += count;
+        return count;
+    }
+    FluidWorker& worker = workers_[link.index];
+    if (worker.queue_capacity != 0) {
+        count = std::min(count, worker.queue_capacity - std::min(worker.queue_capacity, worker.queued));
+        if (count == 0) {
+            return 0;
+        }
+    }
+    if (!worker.queue.empty() && worker.queue.back().arrival == turn_) {
+        worker.queue.back().count += count;
+    } else {
+        worker.queue.push_back(FluidCohort{turn_, count});
+    }
+    worker.queued += count;
+    return count;
+}
+
+std::uint64_t FluidFactory::in_flight() const {
+    std::uint64_t total = 0;
+    for (const auto& ramp : ramps_) {
+        total += ramp.buffer;
+    }
+    for (const auto& worker : workers_) {
+        total += worker.queued + worker.processing + worker.buffer;
+    }
+    return total;
+}
+
+FactorySnapshot FluidFactory::snapshot() const {
+    FactorySnapshot snapshot;
+    snapshot.turn = turn_;
+    for (std::size_t i : workers_by_id_) {
+        const FluidWorker& w = workers_[i];
+        snapshot.workers.push_back(WorkerSnapshot{w.id, static_cast<std::uint32_t>(w.queued),
+                                                  static_cast<std::uint8_t>(w.processing != 0),
+                                                  static_cast<std::uint8_t>(w.buffer != 0), {0, 0},
+                                                  static_cast<std::uint32_t>(w.blocked_turns)});
+    }
+    for (const auto& s : storehouses_) {
+        snapshot.storehouses.push_back(StorehouseSnapshot{s.id, static_cast<std::uint32_t>(s.stock)});
+    }
+    for (const auto& r : ramps_) {
+        snapshot.ramps.push_back(RampSnapshot{r.id, static_cast<std::uint8_t>(r.buffer != 0), {0, 0, 0},
+                                              static_cast<std::uint32_t>(r.blocked_turns)});
+    }
+    return snapshot;
+}
+
+void generate_fluid_report(const FluidFactory& factory, std::ostream& os) {
+    os << "=== [ Turn: " << factory.current_turn() << " ] === (batch " << factory.batch_size() << ")\n";
+    bool ramps_blocked = std::any_of(factory.ramps().begin(), factory.ramps().end(),
+                                     [](const FluidRamp& ramp) { return ramp.blocked_turns != 0; });
+    if (ramps_blocked) {
+        os << "\n== LOADING RAMPS == \n";
+        for (const auto& r : factory.ramps()) {
+            os << "LOADING_RAMP #" << r.id << '\n';
+            os << "  Loaded: " << r.buffer << '\n';
+            os << "  Blocked turns: " << r.blocked_turns << "\n\n";
+        }
+    }
+    os << "\n== WORKERS == \n";
+    for (std::size_t i : factory.workers_by_id()) {
+        const FluidWorker* w = &factory.workers()[i];
+        os << "WORKER #" << w->id << '\n';
+        os << "  Processing: " << w->processing;
+        if (w->processing != 0) {
+            os << " (pt = " << factory.current_turn() - w->processing_start + 1 << ")";
+        }
+        os << '\n';
+        os << "  Queue: " << w->queued << '\n';
+        os << "  Sending: " << w->buffer << '\n';
+        os << "  Mean wait: " << w->mean_wait() << '\n';
+        if (w->blocked_turns != 0) {
+            os << "  Blocked turns: " << w->blocked_turns << '\n';
+        }
+        os << '\n';
+    }
+    os << "\n== STOREHOUSES == \n\n";
+    for (const auto& s : factory.storehouses()) {
+        os << "STOREHOUSE #" << s.id << '\n';
+        os << "  Stock: " << s.stock << '\n';
+    }
+    os << '\n';
+}
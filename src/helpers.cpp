@@ -10,4 +10,12 @@ std::mt19937 rng{rd()};
 ProbabilityGenerator probability_generator = []() {
     static std::uniform_real_distribution<double> dist(0.0, 1.0);
     return dist(rng);
-};
\ No newline at end of file
+};
+
+// Domknięcie przechowuje tylko RoutingStream - mieści się w buforze std::function
+ProbabilityGenerator make_probability_generator(std::uint64_t seed, std::uint64_t stream, bool antithetic) {
+    if (antithetic) {
+        return [generator = RoutingStream(seed, stream)]() mutable { return 1.0 - generator.uniform(); };
+    }
+    return [generator = RoutingStream(seed, stream)]() mutable { return generator.uniform(); };
+}
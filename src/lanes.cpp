@@ -0,0 +1,221 @@
+#include "lanes.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+std::uint64_t splitmix64(std::uint64_t& state) {
+    std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+} // namespace
+
+LaneFactory::LaneFactory(const Factory& factory, std::uint64_t seed, std::uint64_t first_replication) {
+    if (!factory.is_consistent()) {
+        throw std::logic_error("Non-consistent factory");
+    }
+
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> worker_index;
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> storehouse_index;
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        worker_index.emplace(&*it, static_cast<std::uint32_t>(worker_ids_.size()));
+        worker_ids_.push_back(it->get_id());
+    }
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        storehouse_index.emplace(&*it, static_cast<std::uint32_t>(storehouse_ids_.size()));
+        storehouse_ids_.push_back(it->get_id());
+    }
+
+    auto make_sender = [&](const PackageSender& sender) {
+        Sender s;
+        s.first_link = static_cast<std::uint32_t>(links_.size());
+        double cumulative = 0.0;
+        for (const auto& [receiver, probability] : sender.receiver_preferences_.get_preferences()) {
+            cumulative += probability;
+            bool store = receiver->get_receiver_type() == ReceiverType::STOREHOUSE;
+            links_.push_back(Link{store, store ? storehouse_index.at(receiver) : worker_index.at(receiver),
+                                  static_cast<float>(cumulative)});
+        }
+        s.link_count = static_cast<std::uint32_t>(links_.size()) - s.first_link;
+        return s;
+    };
+
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        ramp_ids_.push_back(it->get_id());
+        ramp_senders_.push_back(make_sender(*it));
+        delivery_intervals_.push_back(it->get_delivery_interval());
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        worker_senders_.push_back(make_sender(*it));
+        processing_durations_.push_back(static_cast<std::uint32_t>(it->get_processing_duration()));
+        queue_capacities_.push_back(static_cast<std::uint32_t>(it->get_queue_capacity()));
+    }
+
+    workers_by_id_.resize(worker_ids_.size());
+    for (std::size_t i = 0; i < workers_by_id_.size(); ++i) {
+        workers_by_id_[i] = i;
+    }
+    std::sort(workers_by_id_.begin(), workers_by_id_.end(),
+              [this](std::size_t a, std::size_t b) { return worker_ids_[a] < worker_ids_[b]; });
+
+    ramp_buffer_.assign(ramp_senders_.size() * LANE_WIDTH, 0);
+    ramp_blocked_.assign(ramp_senders_.size() * LANE_WIDTH, 0);
+    queue_.assign(worker_ids_.size() * LANE_WIDTH, 0);
+    busy_.assign(worker_ids_.size() * LANE_WIDTH, 0);
+    start_.assign(worker_ids_.size() * LANE_WIDTH, 0);
+    sending_.assign(worker_ids_.size() * LANE_WIDTH, 0);
+    blocked_.assign(worker_ids_.size() * LANE_WIDTH, 0);
+    stock_.assign(storehouse_ids_.size() * LANE_WIDTH, 0);
+
+    for (std::size_t l = 0; l < LANE_WIDTH; ++l) {
+        std::uint64_t state = seed ^ ((first_replication + l) * 0xD1B54A32D192ED03ULL);
+        std::uint64_t a = splitmix64(state);
+        std::uint64_t b = splitmix64(state);
+        x_[l] = static_cast<std::uint32_t>(a);
+        y_[l] = static_cast<std::uint32_t>(a >> 32);
+        z_[l] = static_cast<std::uint32_t>(b);
+        w_[l] = static_cast<std::uint32_t>(b >> 32) | 1u;   // stan nie może być zerowy
+    }
+}
+
+// Numer łącza wylosowanego w każdym pasie: liczba progów skumulowanych poniżej u
+// (ostatnie łącze, gdy suma prawdopodobieństw jest odrobinę mniejsza od 1)
+void LaneFactory::draw(std::uint32_t* target, const Sender& sender) {
+    float u[LANE_WIDTH];
+    for (std::size_t l = 0; l < LANE_WIDTH; ++l) {
+        std::uint32_t t = x_[l] ^ (x_[l] << 11);
+        x_[l] = y_[l];
+        y_[l] = z_[l];
+        z_[l] = w_[l];
+        w_[l] = w_[l] ^ (w_[l] >> 19) ^ t ^ (t >> 8);
+        u[l] = static_cast<float>(w_[l] >> 8) * (1.0f / 16777216.0f);
+        target[l] = 0;
+    }
+    for (std::uint32_t k = 0; k + 1 < sender.link_count; ++k) {
+        const float threshold = links_[sender.first_link + k].cumulative;
+        for (std::size_t l = 0; l < LANE_WIDTH; ++l) {
+            target[l] += static_cast<std::uint32_t>(u[l] > threshold);
+        }
+    }
+}
+
+void LaneFactory::route(const Sender& sender, std::uint32_t* buffer, std::uint32_t* blocked) {
+    if (sender.link_count == 0) {
+        return;
+    }
+    std::uint32_t target[LANE_WIDTH] = {};
+    if (sender.link_count > 1) {
+        draw(target, sender);
+    }
+    for (std::uint32_t k = 0; k < sender.link_count; ++k) {
+        const Link& link = links_[sender.first_link + k];
+        if (link.store) {
+            std::uint32_t* stock = &stock_[link.index * LANE_WIDTH];
+            for (std::size_t l = 0; l < LANE_WIDTH; ++l) {
+                std::uint32_t sent = buffer[l] & static_cast<std::uint32_t>(target[l] == k);
+                stock[l] += sent;
+                buffer[l] -= sent;
+            }
+        } else {
+            std::uint32_t* queue = &queue_[link.index * LANE_WIDTH];
+            const std::uint32_t capacity = queue_capacities_[link.index];
+            for (std::size_t l = 0; l < LANE_WIDTH; ++l) {
+                std::uint32_t chosen = buffer[l] & static_cast<std::uint32_t>(target[l] == k);
+                std::uint32_t room = static_cast<std::uint32_t>(capacity == 0) | static_cast<std::uint32_t>(queue[l] < capacity);
+                std::uint32_t sent = chosen & room;
+                queue[l] += sent;
+                blocked[l] += chosen & (room ^ 1u);
+                buffer[l] -= sent;
+            }
+        }
+    }
+}
+
+void LaneFactory::step() {
+    const Time t = ++turn_;
+
+    for (std::size_t r = 0; r < ramp_senders_.size(); ++r) {
+        if ((t - 1) % delivery_intervals_[r] != 0) {
+            continue;
+        }
+        std::uint32_t* buffer = &ramp_buffer_[r * LANE_WIDTH];
+        for (std::size_t l = 0; l < LANE_WIDTH; ++l) {
+            delivered_[l] += buffer[l] ^ 1u;
+            buffer[l] = 1;
+        }
+    }
+
+    for (std::size_t r = 0; r < ramp_senders_.size(); ++r) {
+        route(ramp_senders_[r], &ramp_buffer_[r * LANE_WIDTH], &ramp_blocked_[r * LANE_WIDTH]);
+    }
+    for (std::size_t i = 0; i < worker_senders_.size(); ++i) {
+        route(worker_senders_[i], &sending_[i * LANE_WIDTH], &blocked_[i * LANE_WIDTH]);
+    }
+
+    const auto now = static_cast<std::uint32_t>(t);
+    for (std::size_t i = 0; i < worker_senders_.size(); ++i) {
+        std::uint32_t* queue = &queue_[i * LANE_WIDTH];
+        std::uint32_t* busy = &busy_[i * LANE_WIDTH];
+        std::uint32_t* start = &start_[i * LANE_WIDTH];
+        std::uint32_t* sending = &sending_[i * LANE_WIDTH];
+        const std::uint32_t duration = processing_durations_[i];
+        for (std::size_t l = 0; l < LANE_WIDTH; ++l) {
+            std::uint32_t starts = (busy[l] ^ 1u) & static_cast<std::uint32_t>(queue[l] != 0);
+            queue[l] -= starts;
+            busy[l] |= starts;
+            start[l] = starts ? now : start[l];
+            // Przy pełnym buforze wysyłkowym paczka czeka w przetwarzaniu (jak Worker::do_work)
+            std::uint32_t finished = static_cast<std::uint32_t>(now - start[l] + 1 >= duration);
+            std::uint32_t done = busy[l] & (sending[l] ^ 1u) & finished;
+            sending[l] |= done;
+            busy[l] ^= done;
+        }
+    }
+}
+
+void LaneFactory::run(TimeOffset d) {
+    for (TimeOffset i = 0; i < d; ++i) {
+        step();
+    }
+}
+
+FactorySnapshot LaneFactory::snapshot(std::size_t lane) const {
+    if (lane >= LANE_WIDTH) {
+        throw std::out_of_range("Lane out of range");
+    }
+    FactorySnapshot snapshot;
+    snapshot.turn = turn_;
+    for (std::size_t i : workers_by_id_) {
+        const std::size_t at = i * LANE_WIDTH + lane;
+        snapshot.workers.push_back(WorkerSnapshot{worker_ids_[i], queue_[at], static_cast<std::uint8_t>(busy_[at]),
+                                                  static_cast<std::uint8_t>(sending_[at]), {0, 0}, blocked_[at]});
+    }
+    for (std::size_t s = 0; s < storehouse_ids_.size(); ++s) {
+        snapshot.storehouses.push_back(StorehouseSnapshot{storehouse_ids_[s], stock_[s * LANE_WIDTH + lane]});
+    }
+    for (std::size_t r = 0; r < ramp_ids_.size(); ++r) {
+        const std::size_t at = r * LANE_WIDTH + lane;
+        snapshot.ramps.push_back(RampSnapshot{ramp_ids_[r], static_cast<std::uint8_t>(ramp_buffer_[at]), {0, 0, 0},
+                                              ramp_blocked_[at]});
+    }
+    return snapshot;
+}
+
+std::vector<FactorySnapshot> simulate_lane_replications(const Factory& factory, TimeOffset d,
+                                                        std::size_t replications, std::uint64_t seed) {
+    std::vector<FactorySnapshot> results;
+    results.reserve(replications);
+    for (std::size_t first = 0; first < replications; first += LANE_WIDTH) {
+        LaneFactory lanes(factory, seed, first);
+        lanes.run(d);
+        for (std::size_t l = 0; l < LANE_WIDTH && first + l < replications; ++l) {
+            results.push_back(lanes.snapshot(l));
+        }
+    }
+    return results;
+}
@@ -0,0 +1,83 @@
+#include "lineage.hpp"
+
+#include <algorithm>
+
+LineageRing::LineageRing(std::size_t capacity) {
+    std::size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    slots_.resize(size);
+    mask_ = size - 1;
+}
+
+LineageTracer::LineageTracer(std::uint32_t sample_every, std::size_t ring_capacity)
+    : sample_every_(sample_every), ring_(ring_capacity) {}
+
+void LineageTracer::skip_to(std::uint64_t created) {
+    created_ = created;
+    if (sample_every_ != 0) {
+        last_trace_id_ = static_cast<std::uint32_t>((created + sample_every_ - 1) / sample_every_);
+    }
+}
+
+void LineageTracer::merge(const std::vector<LineageRecord>& records, std::uint64_t created, std::uint64_t dropped) {
+    drain(history_);
+    history_.insert(history_.end(), records.begin(), records.end());
+    if (created > created_) {
+        skip_to(created);
+    }
+    dropped_.fetch_add(dropped, std::memory_order_relaxed);
+}
+
+std::size_t LineageTracer::drain(std::vector<LineageRecord>& out) {
+    std::size_t count = 0;
+    LineageRecord record;
+    while (ring_.try_pop(record)) {
+        out.push_back(record);
+        ++count;
+    }
+    return count;
+}
+
+void LineageTracer::export_routes(std::ostream& os) {
+    drain(history_);
+    std::stable_sort(history_.begin(), history_.end(),
+                     [](const LineageRecord& a, const LineageRecord& b) { return a.trace_id < b.trace_id; });
+
+    os << "trace,package,turn,event,node\n";
+    for (const auto& record : history_) {
+        os << record.trace_id << ',' << record.package_id << ',' << record.turn << ',' << to_string(record.event)
+           << ',' << to_string(record.node) << '-' << record.node_id << '\n';
+    }
+    history_.clear();
+    history_.shrink_to_fit();
+}
+
+const char* to_string(LineageEvent event) {
+    switch (event) {
+        case LineageEvent::CREATED:
+            return "created";
+        case LineageEvent::ENQUEUED:
+            return "enqueued";
+        case LineageEvent::STARTED:
+            return "started";
+        case LineageEvent::SENT:
+            return "sent";
+        case LineageEvent::STORED:
+            return "stored";
+    }
+    return "unknown";
+}
+
+const char* to_string(LineageNode node) {
+    switch (node) {
+        case LineageNode::RAMP:
+            return "ramp";
+        case LineageNode::WORKER:
+            return "worker";
+        case LineageNode::STOREHOUSE:
+            return "store";
+    }
+    return "unknown";
+}
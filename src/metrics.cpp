@@ -0,0 +1,172 @@
+#include "metrics.hpp"
+
+#include "local_socket.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+void write_family(std::ostringstream& os, const char* name, const char* help) {
+    os << "# HELP " << name << ' ' << help << "\n# TYPE " << name << " gauge\n";
+}
+
+} // namespace
+
+MetricsExporter::MetricsExporter(const std::string& address, const Factory& factory, TimeOffset interval)
+    : interval_(interval), started_(std::chrono::steady_clock::now()) {
+    for (const Worker* w : factory.workers_by_id()) {
+        worker_ids_.push_back(w->get_id());
+    }
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        storehouse_ids_.push_back(it->get_id());
+    }
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        ramp_ids_.push_back(it->get_id());
+    }
+    queue_lengths_ = std::make_unique<std::atomic<std::uint32_t>[]>(worker_ids_.size());
+    busy_ = std::make_unique<std::atomic<std::uint8_t>[]>(worker_ids_.size());
+    worker_blocked_ = std::make_unique<std::atomic<std::uint64_t>[]>(worker_ids_.size());
+    stock_ = std::make_unique<std::atomic<std::uint64_t>[]>(storehouse_ids_.size());
+    ramp_blocked_ = std::make_unique<std::atomic<std::uint64_t>[]>(ramp_ids_.size());
+    for (const auto& [name, component] : MemoryUsage{}.components()) {
+        memory_components_.push_back(name);
+    }
+    memory_bytes_ = std::make_unique<std::atomic<std::uint64_t>[]>(memory_components_.size());
+    update(factory, 0);
+
+    if (address.rfind("unix:", 0) == 0) {
+        unix_path_ = address.substr(5);
+        listen_fd_ = open_unix_socket(unix_path_);
+    } else if (address.rfind("tcp:", 0) == 0) {
+        port_ = std::stoi(address.substr(4));
+        listen_fd_ = open_tcp_socket(port_);
+    } else {
+        throw std::invalid_argument("Invalid metrics address: " + address);
+    }
+    server_ = std::thread([this] { serve(); });
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop_.store(true);
+    if (server_.joinable()) {
+        server_.join();
+    }
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+    }
+    if (!unix_path_.empty()) {
+        ::unlink(unix_path_.c_str());
+    }
+}
+
+void MetricsExporter::update(const Factory& factory, Time t) {
+    std::uint64_t in_flight = 0;
+    std::size_t r = 0;
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it, ++r) {
+        in_flight += it->get_sending_buffer().has_value();
+        if (r < ramp_ids_.size()) {
+            ramp_blocked_[r].store(it->get_blocked_turns(), std::memory_order_relaxed);
+        }
+    }
+    const auto& workers = factory.workers_by_id();
+    for (std::size_t i = 0; i < workers.size() && i < worker_ids_.size(); ++i) {
+        const Worker& w = *workers[i];
+        auto queued = static_cast<std::uint32_t>(w.get_queue()->size());
+        bool busy = w.get_processing_buffer().has_value();
+        queue_lengths_[i].store(queued, std::memory_order_relaxed);
+        busy_[i].store(busy, std::memory_order_relaxed);
+        worker_blocked_[i].store(w.get_blocked_turns(), std::memory_order_relaxed);
+        in_flight += queued + busy + w.get_sending_buffer().has_value();
+    }
+    std::size_t i = 0;
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend() && i < storehouse_ids_.size(); ++it, ++i) {
+        stock_[i].store(it->size(), std::memory_order_relaxed);
+    }
+    packages_in_flight_.store(in_flight, std::memory_order_relaxed);
+    if (memory_requested_.exchange(false, std::memory_order_relaxed)) {
+        const auto components = factory.memory_usage().components();
+        for (std::size_t c = 0; c < components.size() && c < memory_components_.size(); ++c) {
+            memory_bytes_[c].store(components[c].second.bytes, std::memory_order_relaxed);
+        }
+    }
+    turn_.store(t, std::memory_order_relaxed);
+}
+
+std::string MetricsExporter::render() const {
+    const Time turn = turn_.load(std::memory_order_relaxed);
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+
+    std::ostringstream os;
+    write_family(os, "netsim_turn", "Last completed simulation turn.");
+    os << "netsim_turn " << turn << '\n';
+    write_family(os, "netsim_turns_per_second", "Average simulation speed since the exporter started.");
+    os << "netsim_turns_per_second " << (elapsed > 0.0 ? turn / elapsed : 0.0) << '\n';
+    write_family(os, "netsim_packages_in_flight", "Packages held by ramps and workers.");
+    os << "netsim_packages_in_flight " << packages_in_flight_.load(std::memory_order_relaxed) << '\n';
+
+    write_family(os, "netsim_worker_queue_length", "Packages waiting in the worker queue.");
+    for (std::size_t i = 0; i < worker_ids_.size(); ++i) {
+        os << "netsim_worker_queue_length{worker=\"" << worker_ids_[i] << "\"} "
+           << queue_lengths_[i].load(std::memory_order_relaxed) << '\n';
+    }
+    write_family(os, "netsim_worker_busy", "1 if the worker is processing a package.");
+    for (std::size_t i = 0; i < worker_ids_.size(); ++i) {
+        os << "netsim_worker_busy{worker=\"" << worker_ids_[i] << "\"} "
+           << static_cast<int>(busy_[i].load(std::memory_order_relaxed)) << '\n';
+    }
+    write_family(os, "netsim_worker_blocked_turns", "Turns the worker could not pass a package on.");
+    for (std::size_t i = 0; i < worker_ids_.size(); ++i) {
+        os << "netsim_worker_blocked_turns{worker=\"" << worker_ids_[i] << "\"} "
+           << worker_blocked_[i].load(std::memory_order_relaxed) << '\n';
+    }
+    write_family(os, "netsim_ramp_blocked_turns", "Turns the ramp could not pass a package on.");
+    for (std::size_t i = 0; i < ramp_ids_.size(); ++i) {
+        os << "netsim_ramp_blocked_turns{ramp=\"" << ramp_ids_[i] << "\"} "
+           << ramp_blocked_[i].load(std::memory_order_relaxed) << '\n';
+    }
+    write_family(os, "netsim_storehouse_stock", "Packages delivered to the storehouse.");
+    for (std::size_t i = 0; i < storehouse_ids_.size(); ++i) {
+        os << "netsim_storehouse_stock{storehouse=\"" << storehouse_ids_[i] << "\"} "
+           << stock_[i].load(std::memory_order_relaxed) << '\n';
+    }
+    write_family(os, "netsim_memory_bytes", "Estimated memory held by factory data structures.");
+    for (std::size_t c = 0; c < memory_components_.size(); ++c) {
+        os << "netsim_memory_bytes{component=\"" << memory_components_[c] << "\"} "
+           << memory_bytes_[c].load(std::memory_order_relaxed) << '\n';
+    }
+    return os.str();
+}
+
+void MetricsExporter::serve() {
+    while (!stop_.load()) {
+        pollfd listener{listen_fd_, POLLIN, 0};
+        if (::poll(&listener, 1, 100) <= 0) {
+            continue;
+        }
+        int client = ::accept(listen_fd_, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+        // Treść zapytania nie ma znaczenia - wystarczy poczekać na koniec nagłówków
+        std::string request;
+        char buffer[1024];
+        pollfd peer{client, POLLIN, 0};
+        while (request.find("\r\n\r\n") == std::string::npos && ::poll(&peer, 1, 200) > 0) {
+            ssize_t n = ::recv(client, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                break;
+            }
+            request.append(buffer, static_cast<std::size_t>(n));
+        }
+        const std::string body = render();
+        memory_requested_.store(true, std::memory_order_relaxed);
+        write_all(client, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                              std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+        ::close(client);
+    }
+}
@@ -0,0 +1,69 @@
+#include "codegen.hpp"
+#include "simulate.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Generuje symulator C++ wyspecjalizowany dla struktury fabryki.
+// Użycie: netsim_codegen [--unroll-limit N] <struktura> <wyjście.cpp>
+//         netsim_codegen --simulate <struktura> <tury> [ziarno] [co ile tur raport]
+// Tryb --simulate wypisuje raporty zwykłego simulate() - wzorzec dla wygenerowanego programu.
+namespace {
+
+int run_reference(int argc, char** argv) {
+    std::ifstream in(argv[2], std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << argv[2] << "\n";
+        return 1;
+    }
+    Factory factory = load_factory_structure(in);
+    const TimeOffset turns = std::stoi(argv[3]);
+    factory.seed_routing(argc > 4 ? std::stoull(argv[4]) : 1);
+    IntervalReportNotifier notifier(argc > 5 ? std::stoi(argv[5]) : 1);
+    simulate(factory, turns, [](Factory& f, TimeOffset t) {
+        generate_simulation_report(f, std::cout, t);
+    }, notifier);
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        if (argc >= 4 && std::string(argv[1]) == "--simulate") {
+            return run_reference(argc, argv);
+        }
+
+        CodegenOptions options;
+        int arg = 1;
+        if (argc > 2 && std::string(argv[1]) == "--unroll-limit") {
+            options.unroll_limit = std::stoul(argv[2]);
+            arg += 2;
+        }
+        if (argc - arg != 2) {
+            std::cerr << "Usage: " << argv[0] << " [--unroll-limit N] <structure> <output.cpp>\n"
+                      << "       " << argv[0] << " --simulate <structure> <turns> [seed] [report interval]\n";
+            return 1;
+        }
+
+        std::ifstream in(argv[arg], std::ios::binary);
+        if (!in) {
+            std::cerr << "Cannot open " << argv[arg] << "\n";
+            return 1;
+        }
+        Factory factory = load_factory_structure(in);
+
+        std::ofstream out(argv[arg + 1]);
+        if (!out) {
+            std::cerr << "Cannot open " << argv[arg + 1] << "\n";
+            return 1;
+        }
+        generate_simulator_source(factory, out, options);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
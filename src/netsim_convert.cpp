@@ -0,0 +1,41 @@
+#include "binary_structure.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Konwersja struktury fabryki między formatem tekstowym a binarnym (format wejścia
+// rozpoznawany automatycznie). Użycie: netsim_convert [--text] <wejście> <wyjście>
+int main(int argc, char** argv) {
+    StructureFormat format = StructureFormat::BINARY;
+    int arg = 1;
+    if (argc > 1 && std::string(argv[1]) == "--text") {
+        format = StructureFormat::TEXT;
+        ++arg;
+    }
+    if (argc - arg != 2) {
+        std::cerr << "Usage: " << argv[0] << " [--text] <input> <output>\n";
+        return 1;
+    }
+
+    try {
+        std::ifstream in(argv[arg], std::ios::binary);
+        if (!in) {
+            std::cerr << "Cannot open " << argv[arg] << "\n";
+            return 1;
+        }
+        Factory factory = load_factory_structure(in);
+
+        std::ofstream out(argv[arg + 1], std::ios::binary);
+        if (!out) {
+            std::cerr << "Cannot open " << argv[arg + 1] << "\n";
+            return 1;
+        }
+        save_factory_structure(factory, out, format);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
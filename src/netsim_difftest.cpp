@@ -0,0 +1,51 @@
+#include "differential.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Test różnicowy alternatywnego silnika względem simulate() na losowych strukturach.
+// Użycie: netsim_difftest <replay|binary|partitioned> [przypadki] [tury] [ziarno] [plik na minimalną strukturę]
+// Kod wyjścia 0 - brak różnic, 2 - znaleziono różnicę (zapisana zmniejszona struktura).
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <replay|binary|partitioned> [cases] [turns] [seed] [output]\n";
+        return 1;
+    }
+    const std::string name = argv[1];
+    DifferentialOptions options;
+    options.cases = argc > 2 ? std::stoul(argv[2]) : options.cases;
+    options.turns = argc > 3 ? std::stoi(argv[3]) : options.turns;
+    options.seed = argc > 4 ? std::stoull(argv[4]) : options.seed;
+    const std::string output = argc > 5 ? argv[5] : "mismatch.txt";
+
+    SimulationEngine engine;
+    if (name == "replay") {
+        engine = replay_engine();
+    } else if (name == "binary") {
+        engine = binary_structure_engine();
+    } else if (name == "partitioned") {
+        engine = partitioned_engine(2);
+        options.structure.queue_capacity_probability = 0.0;  // nieobsługiwane w trybie podzielonym
+    } else {
+        std::cerr << "Unknown engine: " << name << "\n";
+        return 1;
+    }
+
+    try {
+        auto mismatch = run_differential(engine, options);
+        if (!mismatch) {
+            std::cout << name << ": " << options.cases << " cases, " << options.turns << " turns - no mismatch\n";
+            return 0;
+        }
+        generate_mismatch_report(*mismatch, std::cout);
+        std::ofstream out(output);
+        out << mismatch->structure;
+        std::cout << "Minimal structure written to " << output << "\n";
+        return 2;
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
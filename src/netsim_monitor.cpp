@@ -0,0 +1,57 @@
+#include "snapshot.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Podgląd stanu symulacji publikowanego przez SnapshotPublisher.
+// Użycie: netsim_monitor <nazwa segmentu> [okres w ms] [liczba odczytów, 0 - bez końca]
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <segment name> [period ms] [count]\n";
+        return 1;
+    }
+    const std::string name = argv[1];
+    const int period_ms = argc > 2 ? std::stoi(argv[2]) : 1000;
+    const int count = argc > 3 ? std::stoi(argv[3]) : 0;
+
+    try {
+        SnapshotReader reader(name);
+        FactorySnapshot snapshot;
+        for (int i = 0; count == 0 || i < count; ++i) {
+            if (i > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(period_ms));
+            }
+            if (!reader.read(snapshot)) {
+                std::cout << "(no snapshot yet)\n";
+                continue;
+            }
+            std::cout << "=== [ Turn: " << snapshot.turn << " ] ===\n";
+            for (const auto& w : snapshot.workers) {
+                std::cout << "WORKER #" << w.id << "  queue=" << w.queue_length
+                          << (w.busy ? "  busy" : "  idle") << (w.sending ? "  sending" : "");
+                if (w.blocked_turns != 0) {
+                    std::cout << "  blocked=" << w.blocked_turns;
+                }
+                std::cout << "\n";
+            }
+            for (const auto& s : snapshot.storehouses) {
+                std::cout << "STOREHOUSE #" << s.id << "  stock=" << s.stock << "\n";
+            }
+            for (const auto& r : snapshot.ramps) {
+                std::cout << "LOADING_RAMP #" << r.id << (r.loaded ? "  loaded" : "  empty");
+                if (r.blocked_turns != 0) {
+                    std::cout << "  blocked=" << r.blocked_turns;
+                }
+                std::cout << "\n";
+            }
+            std::cout << std::flush;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+#include "partition.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+// Proces shardu symulacji podzielonej, uruchamiany przez simulate_partitioned().
+// Użycie: netsim_shard <deskryptor gniazda do koordynatora>
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <fd>\n";
+        return 1;
+    }
+    return run_shard(std::atoi(argv[1]));
+}
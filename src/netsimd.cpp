@@ -0,0 +1,67 @@
+#include "daemon.hpp"
+
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include <pthread.h>
+
+// Rezydentny serwer symulacji na gnieździe uniksowym (protokół w daemon.hpp).
+// Użycie: netsimd <ścieżka gniazda> [wątki] [nazwa=plik struktury ...]
+// Działa do SIGINT/SIGTERM.
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <socket path> [threads] [name=structure ...]\n";
+        return 1;
+    }
+
+    // Sygnały blokowane przed startem wątków - odbiera je tylko sigwait() poniżej
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    try {
+        DaemonOptions options;
+        options.socket_path = argv[1];
+        int arg = 2;
+        if (argc > 2 && std::string(argv[2]).find('=') == std::string::npos) {
+            options.threads = std::stoul(argv[2]);
+            arg = 3;
+        }
+        SimulationDaemon daemon(options);
+
+        for (; arg < argc; ++arg) {
+            const std::string spec = argv[arg];
+            const auto eq = spec.find('=');
+            std::ifstream in(spec.substr(eq + 1), std::ios::binary);
+            if (eq == std::string::npos || !in) {
+                std::cerr << "Cannot load " << spec << "\n";
+                return 1;
+            }
+            const std::string structure((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            const std::string name = spec.substr(0, eq);
+            const std::string response = daemon.handle("LOAD " + name + " " + std::to_string(structure.size()), structure);
+            if (response.rfind("ERR ", 0) == 0) {
+                std::cerr << spec << ": " << response.substr(4);
+                return 1;
+            }
+            std::cerr << "netsimd: " << name << " " << response.substr(response.find('\n') + 1) << "\n";
+        }
+        std::cerr << "netsimd: listening on " << options.socket_path << " (" << daemon.thread_count()
+                  << " threads)\n";
+
+        int signal = 0;
+        sigwait(&signals, &signal);
+        daemon.stop();
+        std::cerr << "netsimd: " << daemon.runs() << " runs served\n";
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,16 +1,19 @@
 #include "nodes.hpp"
 
+#include <stdexcept>
+
 void ReceiverPreferences::add_receiver(IPackageReceiver* r) {
     preferences_[r] = 0.0;
-    double equal_prob = 1.0 / preferences_.size();
-
-    for (auto& [receiver, prob] : preferences_) {
-        prob = equal_prob;
-    }
+    normalize();
 }
 
 void ReceiverPreferences::remove_receiver(IPackageReceiver* r) {
     preferences_.erase(r);
+    normalize();
+}
+
+void ReceiverPreferences::normalize() {
+    sorted_receivers_valid_ = false;
     if (preferences_.empty()) return;
 
     double equal_prob = 1.0 / preferences_.size();
@@ -19,11 +22,41 @@ void ReceiverPreferences::remove_receiver(IPackageReceiver* r) {
     }
 }
 
+void ReceiverPreferences::set_receivers(const std::vector<std::pair<IPackageReceiver*, double>>& weighted) {
+    preferences_.clear();
+    for (const auto& [receiver, prob] : weighted) {
+        preferences_[receiver] = prob;
+    }
+    sorted_receivers_valid_ = false;
+}
+
+void ReceiverPreferences::replace_receiver(IPackageReceiver* old_r, IPackageReceiver* new_r) {
+    auto it = preferences_.find(old_r);
+    if (it == preferences_.end()) return;
+
+    double prob = it->second;
+    preferences_.erase(it);
+    preferences_[new_r] = prob;
+    sorted_receivers_valid_ = false;
+}
+
+const std::vector<IPackageReceiver*>& ReceiverPreferences::sorted_receivers() const {
+    if (!sorted_receivers_valid_) {
+        sorted_receivers_.clear();
+        sorted_receivers_.reserve(preferences_.size());
+        for (const auto& [receiver, prob] : preferences_) {
+            sorted_receivers_.push_back(receiver);
+        }
+        sorted_receivers_valid_ = true;
+    }
+    return sorted_receivers_;
+}
+
 IPackageReceiver* ReceiverPreferences::choose_receiver() const {
     if (preferences_.empty()) return nullptr;
 
     const double p = generate_probability_();
-    
+
     double distribution = 0.0;
     for (const auto& [receiver, prob] : preferences_) {
         distribution += prob;
@@ -42,18 +75,42 @@ void PackageSender::send_package() {
     if (receiver == nullptr) {
         return;
     }
+    send_package_to(receiver);
+}
+
+bool PackageSender::send_package_to(IPackageReceiver* receiver) {
+    if (!buffer_) {
+        return false;
+    }
+    if (!receiver->can_receive()) {
+        ++blocked_turns_;
+        return false;
+    }
+    trace(*buffer_, LineageEvent::SENT);
     receiver->receive_package(std::move(buffer_.value()));
     buffer_ = std::nullopt;
+    return true;
+}
+
+Package PackageSender::release_package() {
+    if (!buffer_) {
+        throw std::logic_error("Sending buffer is empty");
+    }
+    Package p(std::move(*buffer_));
+    buffer_ = std::nullopt;
+    return p;
 }
 
 void Worker::do_work(Time t) {
     if (!processing_buffer_.has_value() && !queue_->empty()) {
         processing_buffer_.emplace(queue_->pop()); 
         t_ = t; 
+        trace(*processing_buffer_, LineageEvent::STARTED);
     }
 
-    if (processing_buffer_.has_value()) {
-        if (t - t_ + 1 == pd_) {
+    // Zablokowany robotnik (pełny bufor wysyłkowy) trzyma skończoną paczkę w przetwarzaniu
+    if (processing_buffer_.has_value() && !buffer_) {
+        if (t - t_ + 1 >= pd_) {
             push_package(std::move(*processing_buffer_));
             
             processing_buffer_.reset();
@@ -61,6 +118,21 @@ void Worker::do_work(Time t) {
     }
 }
 
+std::vector<Package> Worker::release_all_packages() {
+    std::vector<Package> packages;
+    if (processing_buffer_) {
+        packages.push_back(std::move(*processing_buffer_));
+        processing_buffer_.reset();
+    }
+    while (!queue_->empty()) {
+        packages.push_back(queue_->pop());
+    }
+    if (buffer_) {
+        packages.push_back(release_package());
+    }
+    return packages;
+}
+
 void Ramp::deliver_goods(Time t) {
     if (buffer_.has_value()) {
         return;
@@ -71,7 +143,11 @@ void Ramp::deliver_goods(Time t) {
     //     std::cout << "Ramp " << id_ << " delivered package " << buffer_->get_id() << " at time " << t << "\n";
     // }
       if  ((t-1)  % delivery_interval_ == 0){
-         push_package(Package());
+         push_package(Package(*ids_));
+         ++delivered_;
+         if (tracer_ != nullptr) {
+             tracer_->on_created(*buffer_, id_);
+         }
         
      }
 }
@@ -1 +1,84 @@
 #include "package.hpp"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Numer rejestru -> rejestr (numer 0 - rejestr globalny, poza tablicą). Tablica rośnie
+// blokami, które nie są zwalniane, więc odczyt obywa się bez blokady - niszczona paczka
+// szuka swojego rejestru przy każdym zwolnieniu ID. Numery zwolnione przez rejestry są
+// używane ponownie.
+constexpr std::size_t SLOTS_PER_CHUNK = 4096;
+constexpr std::size_t MAX_CHUNKS = 4096;
+
+using SlotChunk = std::array<std::atomic<PackageIdAllocator*>, SLOTS_PER_CHUNK>;
+
+struct AllocatorSlots {
+    std::array<std::atomic<SlotChunk*>, MAX_CHUNKS> chunks{};
+    std::vector<std::unique_ptr<SlotChunk>> owned;   // pod blokadą
+    std::vector<std::uint32_t> free;                 // pod blokadą
+    std::uint32_t next = 1;                          // pod blokadą
+    std::mutex mutex;
+
+    std::atomic<PackageIdAllocator*>& at(std::uint32_t handle) {
+        return (*chunks[handle / SLOTS_PER_CHUNK].load(std::memory_order_acquire))[handle % SLOTS_PER_CHUNK];
+    }
+};
+
+AllocatorSlots& allocator_slots() {
+    static AllocatorSlots slots;
+    return slots;
+}
+
+} // namespace
+
+PackageIdAllocator::PackageIdAllocator() : handle_(0) {
+    auto& slots = allocator_slots();
+    std::lock_guard<std::mutex> lock(slots.mutex);
+    if (!slots.free.empty()) {
+        handle_ = slots.free.back();
+        slots.free.pop_back();
+    } else {
+        if (slots.next == SLOTS_PER_CHUNK * MAX_CHUNKS) {
+            throw std::length_error("Too many package ID allocators");
+        }
+        handle_ = slots.next++;
+        if (handle_ % SLOTS_PER_CHUNK == 0 || handle_ == 1) {
+            slots.owned.push_back(std::make_unique<SlotChunk>());
+            slots.chunks[handle_ / SLOTS_PER_CHUNK].store(slots.owned.back().get(), std::memory_order_release);
+        }
+    }
+    slots.at(handle_).store(this, std::memory_order_release);
+}
+
+PackageIdAllocator::~PackageIdAllocator() {
+    if (handle_ == 0) {
+        return;
+    }
+    // Paczka, która przeżyje rejestr, zwolniłaby ID w rejestrze nowego właściciela numeru
+    assert(assigned_IDs.empty() && "Package outlived its PackageIdAllocator");
+    auto& slots = allocator_slots();
+    slots.at(handle_).store(nullptr, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(slots.mutex);
+    slots.free.push_back(handle_);
+}
+
+PackageIdAllocator& PackageIdAllocator::global() {
+    static PackageIdAllocator instance{GlobalTag{}};
+    return instance;
+}
+
+PackageIdAllocator& PackageIdAllocator::from_handle(std::uint32_t handle) {
+    if (handle == 0) {
+        return global();
+    }
+    PackageIdAllocator* ids = allocator_slots().at(handle).load(std::memory_order_acquire);
+    assert(ids != nullptr && "Package outlived its PackageIdAllocator");
+    return *ids;
+}
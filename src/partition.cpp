@@ -0,0 +1,1008 @@
+#include "partition.hpp"
+#include "binary_structure.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// Paczka przekazywana między shardami
+struct Transfer {
+    std::int32_t type;
+    std::int32_t id;
+    std::int32_t rank;      // pozycja nadawcy w kolejności obsługi (rampy, potem robotnicy)
+    std::int32_t package;
+    std::uint32_t trace;    // numer śledzenia (LineageTracer), 0 - paczka nieśledzona
+};
+
+// Plan shardu wysyłany do procesu netsim_shard po jego uruchomieniu: shard buduje z niego
+// własną fabrykę (tylko swoje węzły i zastępców odbiorców z innych shardów)
+struct ShardHeader {
+    std::int32_t turns;
+    std::uint32_t sample_every;   // 0 - bez śledzenia tras
+    std::uint64_t seed;
+    std::uint64_t trace_base;     // utworzenia paczek przed przebiegiem (LineageTracer::created_count())
+};
+
+struct SenderPlan {
+    std::int32_t id;
+    std::int32_t parameter;       // odstęp dostaw rampy albo czas przetwarzania robotnika
+    std::int32_t queue_type;
+    std::int32_t order;           // pozycja rampy w kolekcji (harmonogram dostaw)
+    std::int32_t rank;
+    std::uint32_t first_link;
+    std::uint32_t link_count;
+};
+
+struct LinkPlan {
+    std::int32_t sender_type;
+    std::int32_t sender_id;
+    std::int32_t type;
+    std::int32_t id;
+    double probability;
+};
+
+struct Delivery {
+    std::int32_t rank;
+    IPackageReceiver* receiver;
+    Package package;
+};
+
+// Zastępca odbiorcy z innego shardu - daje ReceiverPreferences ten sam typ i ID, więc
+// losowanie odbiorców przebiega jak w jednym procesie. Paczki do niego trafiają do
+// koordynatora, nigdy przez receive_package().
+class RemoteReceiver : public IPackageReceiver {
+public:
+    RemoteReceiver(ReceiverType type, ElementID id) : type_(type), id_(id) {}
+
+    void receive_package(Package&&) override { throw std::logic_error("Remote receiver"); }
+    ElementID get_id() const override { return id_; }
+    ReceiverType get_receiver_type() const override { return type_; }
+    IPackageStockpile::const_iterator cbegin() const override { return none_.cbegin(); }
+    IPackageStockpile::const_iterator cend() const override { return none_.cend(); }
+    IPackageStockpile::const_iterator begin() const override { return none_.begin(); }
+    IPackageStockpile::const_iterator end() const override { return none_.end(); }
+
+private:
+    ReceiverType type_;
+    ElementID id_;
+    std::list<Package> none_;
+};
+
+NodeKey receiver_key(const IPackageReceiver* r) {
+    return {r->get_receiver_type() == ReceiverType::STOREHOUSE ? ElementType::STOREHOUSE : ElementType::WORKER,
+            r->get_id()};
+}
+
+// Paczki dostarczone przez rampę o odstępie di w turach 1..t (rampa nigdy nie czeka -
+// kolejki bez limitu)
+std::int64_t deliveries_until(Time t, TimeOffset di) {
+    return t < 1 ? 0 : (t - 1) / di + 1;
+}
+
+// Kolejność przeskoków jednej paczki w turze (dostawy, przekazanie, praca)
+int turn_phase(LineageEvent event) {
+    switch (event) {
+        case LineageEvent::CREATED:
+            return 0;
+        case LineageEvent::SENT:
+            return 1;
+        case LineageEvent::ENQUEUED:
+        case LineageEvent::STORED:
+            return 2;
+        case LineageEvent::STARTED:
+            return 3;
+    }
+    return 4;
+}
+
+bool write_all(int fd, const void* data, std::size_t n) {
+    const char* p = static_cast<const char*>(data);
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return false;
+        }
+        p += w;
+        n -= static_cast<std::size_t>(w);
+    }
+    return true;
+}
+
+bool read_all(int fd, void* data, std::size_t n) {
+    char* p = static_cast<char*>(data);
+    while (n > 0) {
+        ssize_t r = recv(fd, p, n, 0);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+        p += r;
+        n -= static_cast<std::size_t>(r);
+    }
+    return true;
+}
+
+template <typename T>
+bool write_vector(int fd, const std::vector<T>& v) {
+    auto count = static_cast<std::uint32_t>(v.size());
+    return write_all(fd, &count, sizeof(count)) && write_all(fd, v.data(), v.size() * sizeof(T));
+}
+
+template <typename T>
+bool read_vector(int fd, std::vector<T>& v) {
+    std::uint32_t count = 0;
+    if (!read_all(fd, &count, sizeof(count))) {
+        return false;
+    }
+    v.resize(count);
+    return read_all(fd, v.data(), v.size() * sizeof(T));
+}
+
+bool write_strings(int fd, const std::vector<std::string>& strings) {
+    std::vector<std::uint32_t> sizes;
+    std::vector<char> text;
+    for (const auto& s : strings) {
+        sizes.push_back(static_cast<std::uint32_t>(s.size()));
+        text.insert(text.end(), s.begin(), s.end());
+    }
+    return write_vector(fd, sizes) && write_vector(fd, text);
+}
+
+bool read_strings(int fd, std::vector<std::string>& strings) {
+    std::vector<std::uint32_t> sizes;
+    std::vector<char> text;
+    if (!read_vector(fd, sizes) || !read_vector(fd, text)) {
+        return false;
+    }
+    strings.clear();
+    std::size_t at = 0;
+    for (std::uint32_t size : sizes) {
+        if (size > text.size() - at) {
+            return false;
+        }
+        strings.emplace_back(text.data() + at, size);
+        at += size;
+    }
+    return true;
+}
+
+// Stan węzłów shardu po ostatniej turze: FactorySnapshot i fragmenty raportu
+struct ShardState {
+    std::vector<WorkerSnapshot> workers;
+    std::vector<StorehouseSnapshot> storehouses;
+    std::vector<RampSnapshot> ramps;
+    std::vector<std::string> worker_reports;
+    std::vector<std::string> storehouse_reports;
+    std::vector<std::string> ramp_reports;
+    std::vector<LineageRecord> lineage;
+    std::vector<std::uint64_t> dropped;   // jeden element: rekordy odrzucone przez tracer shardu
+};
+
+bool write_state(int fd, const ShardState& s) {
+    return write_vector(fd, s.workers) && write_vector(fd, s.storehouses) && write_vector(fd, s.ramps)
+           && write_strings(fd, s.worker_reports) && write_strings(fd, s.storehouse_reports)
+           && write_strings(fd, s.ramp_reports) && write_vector(fd, s.lineage) && write_vector(fd, s.dropped);
+}
+
+bool read_state(int fd, ShardState& s) {
+    return read_vector(fd, s.workers) && read_vector(fd, s.storehouses) && read_vector(fd, s.ramps)
+           && read_strings(fd, s.worker_reports) && read_strings(fd, s.storehouse_reports)
+           && read_strings(fd, s.ramp_reports) && read_vector(fd, s.lineage) && read_vector(fd, s.dropped)
+           && s.dropped.size() == 1;
+}
+
+struct ShardPlan {
+    ShardHeader header;
+    std::vector<std::int32_t> schedule;   // odstępy dostaw wszystkich ramp (kolejność kolekcji)
+    std::vector<SenderPlan> ramps;
+    std::vector<SenderPlan> workers;
+    std::vector<std::int32_t> storehouses;
+    std::vector<LinkPlan> links;
+};
+
+bool write_plan(int fd, const ShardPlan& plan) {
+    return write_all(fd, &plan.header, sizeof(plan.header)) && write_vector(fd, plan.schedule)
+           && write_vector(fd, plan.ramps) && write_vector(fd, plan.workers) && write_vector(fd, plan.storehouses)
+           && write_vector(fd, plan.links);
+}
+
+bool read_plan(int fd, ShardPlan& plan) {
+    return read_all(fd, &plan.header, sizeof(plan.header)) && read_vector(fd, plan.schedule)
+           && read_vector(fd, plan.ramps) && read_vector(fd, plan.workers) && read_vector(fd, plan.storehouses)
+           && read_vector(fd, plan.links);
+}
+
+NodeKey link_sender_key(const LinkPlan& link) {
+    return {static_cast<ElementType>(link.sender_type), link.sender_id};
+}
+
+NodeKey link_receiver_key(const LinkPlan& link) {
+    return {static_cast<ElementType>(link.type), link.id};
+}
+
+// Jak has_reachable_storehouse() w Factory::is_consistent(), ale na samych kluczach węzłów
+bool reaches_storehouse(const NodeKey& sender, const std::map<NodeKey, std::vector<NodeKey>>& receivers,
+                        std::map<NodeKey, NodeColor>& colors) {
+    if (colors[sender] == NodeColor::VERIFIED) {
+        return true;
+    }
+    colors[sender] = NodeColor::VISITED;
+
+    auto found = receivers.find(sender);
+    if (found == receivers.end() || found->second.empty()) {
+        return false;
+    }
+    bool has_other_receiver = false;
+    for (const NodeKey& receiver : found->second) {
+        if (receiver.type == ElementType::STOREHOUSE) {
+            has_other_receiver = true;
+        } else if (receiver == sender) {
+            continue;
+        } else if (colors[receiver] == NodeColor::NOT_VISITED) {
+            if (!reaches_storehouse(receiver, receivers, colors)) {
+                return false;
+            }
+            has_other_receiver = true;
+        } else if (colors[receiver] == NodeColor::VERIFIED) {
+            has_other_receiver = true;
+        }
+    }
+    colors[sender] = NodeColor::VERIFIED;
+    return has_other_receiver;
+}
+
+// Plany shardów budowane węzeł po węźle - z gotowej fabryki albo wprost z wierszy pliku
+// struktury, więc koordynator nie trzyma całej fabryki, tylko rekordy planów. Połączenia
+// w pliku mogą być przemieszane, więc są grupowane po nadawcach dopiero w finish().
+class PlanBuilder {
+public:
+    // Prawdopodobieństwo jak w load_factory_structure(): równy udział odbiorców nadawcy
+    static constexpr double EQUAL_SHARE = -1.0;
+
+    PlanBuilder(const ShardAssignment& assignment, const ShardHeader& header) : assignment_(assignment) {
+        int shard_count = 0;
+        for (const auto& [key, shard] : assignment) {
+            if (shard < 0) {
+                throw std::invalid_argument("Invalid shard number");
+            }
+            shard_count = std::max(shard_count, shard + 1);
+        }
+        plans_.resize(shard_count);
+        for (auto& plan : plans_) {
+            plan.header = header;
+        }
+    }
+
+    void add_ramp(ElementID id, TimeOffset di) {
+        const auto order = static_cast<std::int32_t>(schedule_.size());
+        plan_of({ElementType::RAMP, id}, "Unassigned ramp").ramps.push_back(SenderPlan{id, di, 0, order, order, 0, 0});
+        schedule_.push_back(di);
+        ramp_ids_.push_back(id);
+    }
+
+    void add_worker(ElementID id, TimeOffset pd, PackageQueueType qt, std::size_t capacity) {
+        ShardPlan& plan = plan_of({ElementType::WORKER, id}, "Unassigned worker");
+        // Blokowanie nadawcy wymagałoby znajomości stanu kolejek w innych shardach w trakcie tury
+        if (capacity != 0) {
+            throw std::invalid_argument("Bounded queues are not supported in partitioned mode");
+        }
+        plan.workers.push_back(SenderPlan{id, pd, static_cast<std::int32_t>(qt), 0, worker_count_++, 0, 0});
+    }
+
+    void add_storehouse(ElementID id) {
+        plan_of({ElementType::STOREHOUSE, id}, "Unassigned storehouse").storehouses.push_back(id);
+        storehouse_ids_.push_back(id);
+    }
+
+    void add_link(const NodeKey& sender, const NodeKey& receiver, double probability = EQUAL_SHARE) {
+        plan_of(sender, "Unassigned sender").links.push_back(
+            LinkPlan{static_cast<std::int32_t>(sender.type), sender.id, static_cast<std::int32_t>(receiver.type),
+                     receiver.id, probability});
+    }
+
+    // Rangi robotników po wszystkich rampach, zakresy połączeń nadawców i harmonogram dostaw
+    void finish() {
+        const auto ramp_count = static_cast<std::int32_t>(schedule_.size());
+        auto by_sender = [](const LinkPlan& a, const LinkPlan& b) { return link_sender_key(a) < link_sender_key(b); };
+        for (auto& plan : plans_) {
+            plan.schedule = schedule_;
+
+            // Powtórzone połączenie to jeden odbiorca - jak w ReceiverPreferences
+            std::stable_sort(plan.links.begin(), plan.links.end(), [](const LinkPlan& a, const LinkPlan& b) {
+                return link_sender_key(a) == link_sender_key(b) ? link_receiver_key(a) < link_receiver_key(b)
+                                                                : link_sender_key(a) < link_sender_key(b);
+            });
+            plan.links.erase(std::unique(plan.links.begin(), plan.links.end(),
+                                         [](const LinkPlan& a, const LinkPlan& b) {
+                                             return link_sender_key(a) == link_sender_key(b)
+                                                    && link_receiver_key(a) == link_receiver_key(b);
+                                         }),
+                             plan.links.end());
+
+            auto assign_links = [&](SenderPlan& sender, ElementType type) {
+                const LinkPlan probe{static_cast<std::int32_t>(type), sender.id, 0, 0, 0.0};
+                auto [first, last] = std::equal_range(plan.links.begin(), plan.links.end(), probe, by_sender);
+                sender.first_link = static_cast<std::uint32_t>(first - plan.links.begin());
+                sender.link_count = static_cast<std::uint32_t>(last - first);
+                for (auto it = first; it != last; ++it) {
+                    if (it->probability == EQUAL_SHARE) {
+                        it->probability = 1.0 / sender.link_count;
+                    }
+                }
+            };
+            for (SenderPlan& ramp : plan.ramps) {
+                assign_links(ramp, ElementType::RAMP);
+            }
+            for (SenderPlan& worker : plan.workers) {
+                worker.rank += ramp_count;
+                assign_links(worker, ElementType::WORKER);
+            }
+        }
+    }
+
+    // Factory::is_consistent() dla struktury zapisanej w planach
+    bool is_consistent() const {
+        std::map<NodeKey, std::vector<NodeKey>> receivers;
+        for (const auto& plan : plans_) {
+            for (const LinkPlan& link : plan.links) {
+                receivers[link_sender_key(link)].push_back(link_receiver_key(link));
+            }
+        }
+        std::map<NodeKey, NodeColor> colors;
+        for (const auto& plan : plans_) {
+            for (const SenderPlan& ramp : plan.ramps) {
+                if (!reaches_storehouse({ElementType::RAMP, ramp.id}, receivers, colors)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    const std::vector<ShardPlan>& plans() const { return plans_; }
+    const std::vector<std::int32_t>& schedule() const { return schedule_; }
+    const std::vector<ElementID>& ramp_ids() const { return ramp_ids_; }
+    const std::vector<ElementID>& storehouse_ids() const { return storehouse_ids_; }
+
+private:
+    ShardPlan& plan_of(const NodeKey& key, const char* unassigned) {
+        auto it = assignment_.find(key);
+        if (it == assignment_.end()) {
+            throw std::invalid_argument(unassigned);
+        }
+        return plans_[it->second];
+    }
+
+    const ShardAssignment& assignment_;
+    std::vector<ShardPlan> plans_;
+    std::vector<std::int32_t> schedule_;     // odstępy dostaw wszystkich ramp (kolejność struktury)
+    std::vector<ElementID> ramp_ids_;
+    std::vector<ElementID> storehouse_ids_;
+    std::int32_t worker_count_ = 0;
+};
+
+// Wiersze tekstowego pliku struktury w kolejności zapisu, z tymi samymi błędami co
+// load_factory_structure(), ale bez budowania fabryki: on_node(klucz, parametry) dla
+// węzłów i on_link(nadawca, odbiorca) dla połączeń
+template <typename OnNode, typename OnLink>
+void scan_structure(std::istream& is, OnNode on_node, OnLink on_link) {
+    if (is.peek() == static_cast<int>(BINARY_STRUCTURE_MAGIC & 0xFF)) {
+        throw std::invalid_argument("Binary structure is not supported in partitioned mode");
+    }
+
+    std::set<NodeKey> defined;
+    auto require = [&defined](const NodeKey& key) {
+        if (defined.count(key) == 0) {
+            throw std::logic_error("LINK refers to undefined node");
+        }
+    };
+
+    std::string line;
+    while (std::getline(is, line)) {
+        if (line.empty() || line[0] == ';') {
+            continue;
+        }
+        ElementType type = ElementType::LINK;
+        bool known = false;
+        for (ElementType t : {ElementType::RAMP, ElementType::WORKER, ElementType::STOREHOUSE, ElementType::LINK}) {
+            if (line.find(ElementTypeTags.at(t)) == 0) {
+                type = t;
+                known = true;
+                break;
+            }
+        }
+        if (!known) {
+            throw std::logic_error("Invalid structure");
+        }
+        auto params = parse_line(line);
+        if (type != ElementType::LINK) {
+            NodeKey key{type, static_cast<ElementID>(std::stoi(params["id"]))};
+            defined.insert(key);
+            on_node(key, params);
+            continue;
+        }
+
+        auto src_data = decode_node_id(params["src"]);
+        auto dest_data = decode_node_id(params["dest"]);
+        if (src_data.first != NODE_TYPE_RAMP && src_data.first != NODE_TYPE_WORKER) {
+            continue;
+        }
+        NodeKey sender{src_data.first == NODE_TYPE_RAMP ? ElementType::RAMP : ElementType::WORKER, src_data.second};
+        require(sender);
+        if (dest_data.first != NODE_TYPE_WORKER && dest_data.first != NODE_TYPE_STOREHOUSE) {
+            throw std::logic_error(sender.type == ElementType::RAMP ? "Invalid LINK destination for RAMP"
+                                                                    : "Invalid LINK destination for WORKER");
+        }
+        NodeKey receiver{dest_data.first == NODE_TYPE_WORKER ? ElementType::WORKER : ElementType::STOREHOUSE,
+                         dest_data.second};
+        require(receiver);
+        on_link(sender, receiver);
+    }
+}
+
+// Graf przepływu do podziału: węzły w kolejności kolekcji, odbiorcy nadawcy w kolejności
+// ReceiverOrder (magazyny, potem robotnicy, rosnąco po ID)
+struct FlowGraph {
+    std::vector<NodeKey> ramps;
+    std::vector<NodeKey> workers;
+    std::vector<NodeKey> storehouses;
+    std::map<NodeKey, std::vector<NodeKey>> receivers;
+};
+
+ShardAssignment assign_in_flow_order(const FlowGraph& graph, int shard_count) {
+    if (shard_count <= 0) {
+        throw std::invalid_argument("Shard count must be positive");
+    }
+
+    std::vector<NodeKey> order;
+    std::set<NodeKey> seen;
+    std::queue<NodeKey> pending;
+    auto visit = [&](const NodeKey& key) {
+        if (seen.insert(key).second) {
+            order.push_back(key);
+            return true;
+        }
+        return false;
+    };
+
+    for (const NodeKey& ramp : graph.ramps) {
+        visit(ramp);
+        pending.push(ramp);
+    }
+    while (!pending.empty()) {
+        auto found = graph.receivers.find(pending.front());
+        pending.pop();
+        if (found == graph.receivers.end()) {
+            continue;
+        }
+        for (const NodeKey& receiver : found->second) {
+            if (visit(receiver) && receiver.type == ElementType::WORKER) {
+                pending.push(receiver);
+            }
+        }
+    }
+    for (const NodeKey& worker : graph.workers) {
+        visit(worker);
+    }
+    for (const NodeKey& storehouse : graph.storehouses) {
+        visit(storehouse);
+    }
+
+    ShardAssignment assignment;
+    const std::size_t chunk = (order.size() + shard_count - 1) / shard_count;
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        assignment[order[i]] = static_cast<int>(i / std::max<std::size_t>(chunk, 1));
+    }
+    return assignment;
+}
+
+// Program shardu: NETSIM_SHARD albo netsim_shard obok bieżącego programu
+std::string shard_binary() {
+    if (const char* path = std::getenv("NETSIM_SHARD")) {
+        return path;
+    }
+    char self[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (n <= 0) {
+        return "netsim_shard";
+    }
+    std::string path(self, static_cast<std::size_t>(n));
+    return path.substr(0, path.rfind('/') + 1) + "netsim_shard";
+}
+
+constexpr int SHARD_FD = 3;   // deskryptor gniazda w procesie shardu
+
+// fork() + exec() programu shardu. Wywołujący może mieć inne wątki (pula netsimd, wątki
+// testów), więc dziecko do exec() woła tylko funkcje async-signal-safe - argumenty są
+// przygotowane przed fork(), a reszta deskryptorów ma FD_CLOEXEC.
+pid_t spawn_shard(const std::string& binary, int fd) {
+    char fd_arg[16];
+    std::snprintf(fd_arg, sizeof(fd_arg), "%d", SHARD_FD);
+    char* argv[] = {const_cast<char*>(binary.c_str()), fd_arg, nullptr};
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // dup2() na ten sam deskryptor nie zdejmuje FD_CLOEXEC
+        if (fd == SHARD_FD ? fcntl(fd, F_SETFD, 0) != 0 : dup2(fd, SHARD_FD) < 0) {
+            _exit(127);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+ShardHeader make_header(TimeOffset d, std::uint64_t seed, const LineageTracer* tracer) {
+    return ShardHeader{d, tracer != nullptr ? tracer->sample_every() : 0u, seed,
+                       tracer != nullptr ? tracer->created_count() : 0u};
+}
+
+// Proces shardu: fabryka z planu, d tur z wymianą paczek przez koordynatora, na końcu stan węzłów
+int serve_shard(int fd) {
+    try {
+        ShardPlan plan;
+        if (!read_plan(fd, plan)) {
+            return 1;
+        }
+        const ShardHeader& header = plan.header;
+
+        // ID paczek z globalnego harmonogramu dostaw - jak w jednym procesie z własnym rejestrem
+        PackageIdAllocator ids;
+        Factory factory;
+        factory.set_package_id_allocator(ids);
+        for (const SenderPlan& r : plan.ramps) {
+            factory.add_ramp(Ramp(r.id, r.parameter));
+        }
+        for (const SenderPlan& w : plan.workers) {
+            factory.add_worker(Worker(w.id, w.parameter,
+                                      std::make_unique<PackageQueue>(static_cast<PackageQueueType>(w.queue_type))));
+        }
+        for (std::int32_t id : plan.storehouses) {
+            factory.add_storehouse(Storehouse(id));
+        }
+
+        std::list<RemoteReceiver> remote;
+        std::set<const IPackageReceiver*> remote_set;
+        std::map<NodeKey, IPackageReceiver*> receivers;
+        for (auto it = factory.worker_begin(); it != factory.worker_end(); ++it) {
+            receivers[{ElementType::WORKER, it->get_id()}] = &*it;
+        }
+        for (auto it = factory.storehouse_begin(); it != factory.storehouse_end(); ++it) {
+            receivers[{ElementType::STOREHOUSE, it->get_id()}] = &*it;
+        }
+        auto link_sender = [&](PackageSender& sender, const SenderPlan& p) {
+            std::vector<std::pair<IPackageReceiver*, double>> weighted;
+            for (std::uint32_t k = p.first_link; k < p.first_link + p.link_count; ++k) {
+                const LinkPlan& link = plan.links.at(k);
+                NodeKey key{static_cast<ElementType>(link.type), link.id};
+                auto found = receivers.find(key);
+                if (found == receivers.end()) {
+                    remote.emplace_back(key.type == ElementType::STOREHOUSE ? ReceiverType::STOREHOUSE
+                                                                            : ReceiverType::WORKER,
+                                        key.id);
+                    remote_set.insert(&remote.back());
+                    found = receivers.emplace(key, &remote.back()).first;
+                }
+                weighted.emplace_back(found->second, link.probability);
+            }
+            sender.receiver_preferences_.set_receivers(weighted);
+        };
+
+        struct Sender {
+            std::int32_t rank;
+            PackageSender* node;
+            LineageNode trace_node;
+            ElementID id;
+        };
+        std::vector<Sender> senders;
+        std::vector<Ramp*> ramps;
+        auto ramp_it = factory.ramp_begin();
+        for (const SenderPlan& r : plan.ramps) {
+            link_sender(*ramp_it, r);
+            senders.push_back({r.rank, &*ramp_it, LineageNode::RAMP, r.id});
+            ramps.push_back(&*ramp_it);
+            ++ramp_it;
+        }
+        auto worker_it = factory.worker_begin();
+        for (const SenderPlan& w : plan.workers) {
+            link_sender(*worker_it, w);
+            senders.push_back({w.rank, &*worker_it, LineageNode::WORKER, w.id});
+            ++worker_it;
+        }
+
+        factory.seed_routing(header.seed);
+        std::unique_ptr<LineageTracer> tracer;
+        if (header.sample_every != 0) {
+            tracer = std::make_unique<LineageTracer>(header.sample_every);
+            factory.set_lineage_tracer(tracer.get());
+        }
+
+        std::vector<std::int64_t> ahead(plan.schedule.size());   // dostawy ramp wcześniejszych w kolekcji w tej turze
+        std::int64_t created_before = 0;                         // dostawy wszystkich ramp w poprzednich turach
+        std::vector<Delivery> deliveries;
+        std::vector<Transfer> outbox;
+        std::vector<Transfer> inbox;
+        for (Time t = 1; t <= header.turns; ++t) {
+            std::int64_t delivering = 0;
+            for (std::size_t k = 0; k < plan.schedule.size(); ++k) {
+                ahead[k] = delivering;
+                delivering += (t - 1) % plan.schedule[k] == 0;
+            }
+            if (tracer) {
+                tracer->set_turn(t);
+            }
+            for (std::size_t i = 0; i < ramps.size(); ++i) {
+                const SenderPlan& r = plan.ramps[i];
+                if ((t - 1) % r.parameter != 0) {
+                    continue;
+                }
+                if (ramps[i]->get_sending_buffer()) {
+                    throw std::logic_error("Ramp missed its delivery");
+                }
+                const std::int64_t index = created_before + ahead[r.order];
+                ids.advance_to(static_cast<ElementID>(index + 1));
+                if (tracer) {
+                    tracer->skip_to(header.trace_base + static_cast<std::uint64_t>(index));
+                }
+                ramps[i]->deliver_goods(t);
+            }
+            created_before += delivering;
+
+            deliveries.clear();
+            outbox.clear();
+            for (const Sender& sender : senders) {
+                if (!sender.node->get_sending_buffer()) {
+                    continue;
+                }
+                IPackageReceiver* r = sender.node->receiver_preferences_.choose_receiver();
+                if (r == nullptr) {
+                    continue;
+                }
+                Package p = sender.node->release_package();
+                if (tracer) {
+                    tracer->record(p, LineageEvent::SENT, sender.trace_node, sender.id);
+                }
+                if (remote_set.count(r) == 0) {
+                    deliveries.push_back({sender.rank, r, std::move(p)});
+                } else {
+                    NodeKey key = receiver_key(r);
+                    outbox.push_back({static_cast<std::int32_t>(key.type), key.id, sender.rank, p.get_id(),
+                                      tracer ? tracer->trace_id(p) : 0u});
+                }
+            }
+
+            if (!write_vector(fd, outbox) || !read_vector(fd, inbox)) {
+                return 1;
+            }
+            for (const Transfer& tr : inbox) {
+                IPackageReceiver* r = receivers.at({static_cast<ElementType>(tr.type), tr.id});
+                Package p(tr.package, ids);
+                if (tracer) {
+                    tracer->adopt(p, tr.trace);
+                }
+                deliveries.push_back({tr.rank, r, std::move(p)});
+            }
+
+            // Ta sama kolejność przyjęć, co w jednym procesie - według kolejności nadawców
+            std::stable_sort(deliveries.begin(), deliveries.end(),
+                             [](const Delivery& a, const Delivery& b) { return a.rank < b.rank; });
+            for (Delivery& delivery : deliveries) {
+                delivery.receiver->receive_package(std::move(delivery.package));
+            }
+
+            factory.do_work(t);
+        }
+
+        ShardState state;
+        for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+            state.workers.push_back(make_worker_snapshot(*it));
+            std::ostringstream os;
+            generate_worker_state(*it, os, header.turns);
+            state.worker_reports.push_back(os.str());
+        }
+        for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+            state.storehouses.push_back(make_storehouse_snapshot(*it));
+            std::ostringstream os;
+            generate_storehouse_state(*it, os);
+            state.storehouse_reports.push_back(os.str());
+        }
+        for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+            state.ramps.push_back(make_ramp_snapshot(*it));
+            std::ostringstream os;
+            generate_ramp_state(*it, os);
+            state.ramp_reports.push_back(os.str());
+        }
+        state.dropped.push_back(0);
+        if (tracer) {
+            tracer->drain(state.lineage);
+            state.dropped[0] = tracer->dropped_count();
+        }
+        return write_state(fd, state) ? 0 : 1;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+void stop_shards(const std::vector<pid_t>& pids, const std::vector<int>& fds, bool kill_children) {
+    for (int fd : fds) {
+        close(fd);
+    }
+    for (pid_t pid : pids) {
+        if (kill_children) {
+            kill(pid, SIGKILL);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+    }
+}
+
+// Koordynator: uruchamia shardy z planami, przekazuje paczki między nimi raz na turę
+// i składa stan końcowy w kolejności struktury
+PartitionedRun run_shards(const PlanBuilder& builder, TimeOffset d, const ShardAssignment& assignment,
+                          LineageTracer* tracer) {
+    const std::vector<ShardPlan>& plans = builder.plans();
+    const int shard_count = static_cast<int>(plans.size());
+    const std::string binary = shard_binary();
+    if (access(binary.c_str(), X_OK) != 0) {
+        throw std::runtime_error("Shard binary not found: " + binary);
+    }
+
+    std::vector<pid_t> pids;
+    std::vector<int> fds;
+    for (int shard = 0; shard < shard_count; ++shard) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) {
+            stop_shards(pids, fds, true);
+            throw std::runtime_error(std::string("socketpair: ") + std::strerror(errno));
+        }
+        pid_t pid = spawn_shard(binary, pair[1]);
+        const int error = errno;
+        close(pair[1]);
+        if (pid < 0) {
+            close(pair[0]);
+            stop_shards(pids, fds, true);
+            throw std::runtime_error(std::string("fork: ") + std::strerror(error));
+        }
+        pids.push_back(pid);
+        fds.push_back(pair[0]);
+        if (!write_plan(pair[0], plans[shard])) {
+            stop_shards(pids, fds, true);
+            throw std::runtime_error("Shard process failed");
+        }
+    }
+
+    std::vector<std::vector<Transfer>> inbound(shard_count);
+    std::vector<Transfer> outbox;
+    for (Time t = 1; t <= d; ++t) {
+        for (auto& v : inbound) {
+            v.clear();
+        }
+        for (int shard = 0; shard < shard_count; ++shard) {
+            if (!read_vector(fds[shard], outbox)) {
+                stop_shards(pids, fds, true);
+                throw std::runtime_error("Shard process failed");
+            }
+            for (const Transfer& tr : outbox) {
+                inbound[assignment.at({static_cast<ElementType>(tr.type), tr.id})].push_back(tr);
+            }
+        }
+        for (int shard = 0; shard < shard_count; ++shard) {
+            if (!write_vector(fds[shard], inbound[shard])) {
+                stop_shards(pids, fds, true);
+                throw std::runtime_error("Shard process failed");
+            }
+        }
+    }
+
+    std::map<ElementID, std::pair<WorkerSnapshot, std::string>> workers;
+    std::map<ElementID, std::pair<StorehouseSnapshot, std::string>> storehouses;
+    std::map<ElementID, std::pair<RampSnapshot, std::string>> ramps;
+    std::vector<LineageRecord> lineage;
+    std::uint64_t dropped = 0;
+    ShardState state;
+    for (int shard = 0; shard < shard_count; ++shard) {
+        if (!read_state(fds[shard], state) || state.worker_reports.size() != state.workers.size()
+            || state.storehouse_reports.size() != state.storehouses.size()
+            || state.ramp_reports.size() != state.ramps.size()) {
+            stop_shards(pids, fds, true);
+            throw std::runtime_error("Shard process failed");
+        }
+        for (std::size_t i = 0; i < state.workers.size(); ++i) {
+            workers[state.workers[i].id] = {state.workers[i], std::move(state.worker_reports[i])};
+        }
+        for (std::size_t i = 0; i < state.storehouses.size(); ++i) {
+            storehouses[state.storehouses[i].id] = {state.storehouses[i], std::move(state.storehouse_reports[i])};
+        }
+        for (std::size_t i = 0; i < state.ramps.size(); ++i) {
+            ramps[state.ramps[i].id] = {state.ramps[i], std::move(state.ramp_reports[i])};
+        }
+        lineage.insert(lineage.end(), state.lineage.begin(), state.lineage.end());
+        dropped += state.dropped[0];
+    }
+    stop_shards(pids, fds, false);
+
+    PartitionedRun result;
+    result.snapshot.turn = d;
+    std::vector<std::string> worker_reports;
+    std::vector<std::string> storehouse_reports;
+    std::vector<std::string> ramp_reports;
+    bool ramps_blocked = false;
+    for (const auto& [id, w] : workers) {
+        result.snapshot.workers.push_back(w.first);
+        worker_reports.push_back(w.second);
+    }
+    for (ElementID id : builder.storehouse_ids()) {
+        const auto& s = storehouses.at(id);
+        result.snapshot.storehouses.push_back(s.first);
+        storehouse_reports.push_back(s.second);
+    }
+    for (ElementID id : builder.ramp_ids()) {
+        const auto& r = ramps.at(id);
+        result.snapshot.ramps.push_back(r.first);
+        ramp_reports.push_back(r.second);
+        ramps_blocked = ramps_blocked || r.first.blocked_turns != 0;
+    }
+    if (!ramps_blocked) {
+        ramp_reports.clear();
+    }
+    std::ostringstream report;
+    assemble_simulation_report(report, d, ramp_reports, worker_reports, storehouse_reports);
+    result.report = report.str();
+
+    if (tracer != nullptr) {
+        // Przeskoki jednej paczki w kolejności tur i faz - jak w zapisie jednego procesu
+        std::stable_sort(lineage.begin(), lineage.end(), [](const LineageRecord& a, const LineageRecord& b) {
+            return a.turn != b.turn ? a.turn < b.turn : turn_phase(a.event) < turn_phase(b.event);
+        });
+        std::uint64_t created = tracer->created_count();
+        for (std::int32_t di : builder.schedule()) {
+            created += static_cast<std::uint64_t>(deliveries_until(d, di));
+        }
+        tracer->merge(lineage, created, dropped);
+    }
+    return result;
+}
+
+} // namespace
+
+ShardAssignment partition_factory(const Factory& factory, int shard_count) {
+    FlowGraph graph;
+    auto add_receivers = [&graph](const NodeKey& key, const PackageSender& sender) {
+        auto& receivers = graph.receivers[key];
+        for (IPackageReceiver* r : sender.receiver_preferences_.sorted_receivers()) {
+            receivers.push_back(receiver_key(r));
+        }
+    };
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        graph.ramps.push_back({ElementType::RAMP, it->get_id()});
+        add_receivers(graph.ramps.back(), *it);
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        graph.workers.push_back({ElementType::WORKER, it->get_id()});
+        add_receivers(graph.workers.back(), *it);
+    }
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        graph.storehouses.push_back({ElementType::STOREHOUSE, it->get_id()});
+    }
+    return assign_in_flow_order(graph, shard_count);
+}
+
+ShardAssignment partition_structure(std::istream& structure, int shard_count) {
+    FlowGraph graph;
+    scan_structure(
+        structure,
+        [&graph](const NodeKey& key, std::map<std::string, std::string>&) {
+            switch (key.type) {
+                case ElementType::RAMP:
+                    graph.ramps.push_back(key);
+                    break;
+                case ElementType::WORKER:
+                    graph.workers.push_back(key);
+                    break;
+                default:
+                    graph.storehouses.push_back(key);
+                    break;
+            }
+        },
+        [&graph](const NodeKey& sender, const NodeKey& receiver) { graph.receivers[sender].push_back(receiver); });
+
+    // Kolejność ReceiverOrder, powtórzone połączenia jak jedno
+    auto receiver_order = [](const NodeKey& a, const NodeKey& b) {
+        const bool a_store = a.type == ElementType::STOREHOUSE;
+        const bool b_store = b.type == ElementType::STOREHOUSE;
+        return a_store != b_store ? a_store : a.id < b.id;
+    };
+    for (auto& [sender, receivers] : graph.receivers) {
+        std::sort(receivers.begin(), receivers.end(), receiver_order);
+        receivers.erase(std::unique(receivers.begin(), receivers.end()), receivers.end());
+    }
+    return assign_in_flow_order(graph, shard_count);
+}
+
+PartitionedRun simulate_partitioned(const Factory& factory, TimeOffset d,
+                                    const ShardAssignment& assignment, std::uint64_t seed) {
+    if (!factory.is_consistent()) {
+        throw std::logic_error("Non-consistent factory");
+    }
+
+    LineageTracer* tracer = factory.lineage_tracer();
+    PlanBuilder builder(assignment, make_header(d, seed, tracer));
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        builder.add_ramp(it->get_id(), it->get_delivery_interval());
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        builder.add_worker(it->get_id(), it->get_processing_duration(), it->get_queue()->get_queue_type(),
+                           it->get_queue_capacity());
+    }
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        builder.add_storehouse(it->get_id());
+    }
+    auto add_links = [&builder](const NodeKey& key, const PackageSender& sender) {
+        for (const auto& [receiver, probability] : sender.receiver_preferences_.get_preferences()) {
+            builder.add_link(key, receiver_key(receiver), probability);
+        }
+    };
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        add_links({ElementType::RAMP, it->get_id()}, *it);
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        add_links({ElementType::WORKER, it->get_id()}, *it);
+    }
+    builder.finish();
+    return run_shards(builder, d, assignment, tracer);
+}
+
+PartitionedRun simulate_partitioned(std::istream& structure, TimeOffset d, const ShardAssignment& assignment,
+                                    std::uint64_t seed, LineageTracer* tracer) {
+    PlanBuilder builder(assignment, make_header(d, seed, tracer));
+    scan_structure(
+        structure,
+        [&builder](const NodeKey& key, std::map<std::string, std::string>& params) {
+            switch (key.type) {
+                case ElementType::RAMP:
+                    builder.add_ramp(key.id, std::stoi(params["delivery-interval"]));
+                    break;
+                case ElementType::WORKER:
+                    builder.add_worker(key.id, std::stoi(params["processing-time"]),
+                                       params["queue-type"] == "FIFO" ? PackageQueueType::FIFO : PackageQueueType::LIFO,
+                                       params.count("queue-capacity") ? std::stoul(params["queue-capacity"]) : 0);
+                    break;
+                default:
+                    builder.add_storehouse(key.id);
+                    break;
+            }
+        },
+        [&builder](const NodeKey& sender, const NodeKey& receiver) { builder.add_link(sender, receiver); });
+    builder.finish();
+    if (!builder.is_consistent()) {
+        throw std::logic_error("Non-consistent factory");
+    }
+    return run_shards(builder, d, assignment, tracer);
+}
+
+int run_shard(int fd) {
+    return serve_shard(fd);
+}
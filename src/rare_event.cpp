@@ -0,0 +1,141 @@
+#include "rare_event.hpp"
+
+#include "convergence.hpp"
+
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+std::uint64_t mix(std::uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+std::size_t find_worker(const FluidFactory& factory, ElementID id) {
+    const auto& workers = factory.workers();
+    for (std::size_t i = 0; i < workers.size(); ++i) {
+        if (workers[i].id == id) {
+            return i;
+        }
+    }
+    throw std::invalid_argument("Unknown worker");
+}
+
+// Biegnie do osiągnięcia poziomu (kolejka >= level) albo do końca horyzontu
+bool run_to_level(FluidFactory& factory, std::size_t worker, std::size_t level, TimeOffset horizon,
+                  std::uint64_t& turns) {
+    if (factory.workers()[worker].queued >= level) {
+        return true;
+    }
+    while (factory.current_turn() < horizon) {
+        factory.run(1);
+        ++turns;
+        if (factory.workers()[worker].queued >= level) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::size_t> level_sequence(const SplittingOptions& options) {
+    if (options.threshold == 0) {
+        throw std::invalid_argument("Threshold must be positive");
+    }
+    std::vector<std::size_t> levels = options.levels;
+    if (levels.empty()) {
+        for (std::size_t k = 1; k < options.level_count; ++k) {
+            std::size_t level = options.threshold * k / options.level_count;
+            if (level != 0 && (levels.empty() || level > levels.back())) {
+                levels.push_back(level);
+            }
+        }
+    }
+    for (std::size_t k = 0; k < levels.size(); ++k) {
+        if (levels[k] == 0 || levels[k] >= options.threshold || (k > 0 && levels[k] <= levels[k - 1])) {
+            throw std::invalid_argument("Levels must increase and stay below the threshold");
+        }
+    }
+    levels.push_back(options.threshold);
+    return levels;
+}
+
+void fill_interval(RareEventEstimate& result, const std::vector<double>& estimates, double confidence) {
+    const double n = static_cast<double>(estimates.size());
+    double mean = 0.0;
+    for (double x : estimates) {
+        mean += x;
+    }
+    mean /= n;
+    double ss = 0.0;
+    for (double x : estimates) {
+        ss += (x - mean) * (x - mean);
+    }
+    result.probability = mean;
+    result.half_width = student_t_quantile(0.5 + confidence / 2.0, n - 1.0) * std::sqrt(ss / (n - 1.0) / n);
+    result.replications = estimates.size();
+}
+
+} // namespace
+
+RareEventEstimate estimate_overflow_probability(const Factory& factory, const SplittingOptions& options) {
+    if (options.replications < 2 || options.effort == 0) {
+        throw std::invalid_argument("Need at least two replications and positive effort");
+    }
+    const std::vector<std::size_t> levels = level_sequence(options);
+    const FluidFactory initial(factory, FluidOptions{1, options.seed});
+    const std::size_t worker = find_worker(initial, options.worker);
+
+    RareEventEstimate result;
+    result.level_probabilities.assign(levels.size(), 0.0);
+    std::vector<double> estimates;
+    for (std::size_t r = 0; r < options.replications; ++r) {
+        std::mt19937_64 rng(mix(options.seed ^ mix(r)));
+        std::vector<FluidFactory> entrance{initial};
+        double probability = 1.0;
+        for (std::size_t k = 0; k < levels.size() && probability > 0.0; ++k) {
+            // Start z losowo wybranego stanu wejścia poprzedniego poziomu, z nowym ziarnem
+            std::vector<FluidFactory> hits;
+            std::uniform_int_distribution<std::size_t> pick(0, entrance.size() - 1);
+            for (std::size_t j = 0; j < options.effort; ++j) {
+                FluidFactory branch = entrance[pick(rng)];
+                branch.reseed(rng());
+                if (run_to_level(branch, worker, levels[k], options.horizon, result.simulated_turns)) {
+                    hits.push_back(std::move(branch));
+                }
+            }
+            const double level_probability = static_cast<double>(hits.size()) / static_cast<double>(options.effort);
+            result.level_probabilities[k] += level_probability / static_cast<double>(options.replications);
+            probability *= level_probability;
+            entrance = std::move(hits);
+        }
+        estimates.push_back(probability);
+    }
+    fill_interval(result, estimates, options.confidence);
+    return result;
+}
+
+RareEventEstimate estimate_overflow_brute_force(const Factory& factory, const SplittingOptions& options,
+                                                std::size_t runs) {
+    if (runs < 2) {
+        throw std::invalid_argument("Need at least two runs");
+    }
+    const FluidFactory initial(factory, FluidOptions{1, options.seed});
+    const std::size_t worker = find_worker(initial, options.worker);
+
+    RareEventEstimate result;
+    std::vector<double> outcomes;
+    outcomes.reserve(runs);
+    for (std::size_t i = 0; i < runs; ++i) {
+        FluidFactory run = initial;
+        run.reseed(mix(options.seed ^ mix(i)));
+        bool hit = run_to_level(run, worker, options.threshold, options.horizon, result.simulated_turns);
+        outcomes.push_back(hit ? 1.0 : 0.0);
+    }
+    fill_interval(result, outcomes, options.confidence);
+    result.level_probabilities = {result.probability};
+    return result;
+}
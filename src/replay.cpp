@@ -0,0 +1,201 @@
+#include "replay.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+constexpr std::uint32_t ROUTING_LOG_MAGIC = 0x4C52534E;  // "NSRL"
+constexpr std::uint32_t ROUTING_LOG_VERSION = 2;
+
+unsigned index_bits(std::size_t receivers) {
+    unsigned bits = 0;
+    while ((std::size_t{1} << bits) < receivers) {
+        ++bits;
+    }
+    return bits;
+}
+
+std::uint64_t fnv1a(std::uint64_t hash, std::int64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        hash ^= static_cast<std::uint64_t>(value >> (8 * i)) & 0xFF;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template <typename T>
+void write_pod(std::ostream& os, const T& value) {
+    os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T read_pod(std::istream& is) {
+    T value{};
+    if (!is.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw std::runtime_error("Truncated routing log");
+    }
+    return value;
+}
+
+} // namespace
+
+void RoutingLog::write(std::uint32_t value, unsigned bits) {
+    for (unsigned done = 0; done < bits;) {
+        const unsigned offset = static_cast<unsigned>(bit_count_ % 64);
+        if (offset == 0) {
+            words_.push_back(0);
+        }
+        const unsigned chunk = std::min(bits - done, 64 - offset);
+        const std::uint64_t mask = chunk == 64 ? ~0ULL : ((1ULL << chunk) - 1);
+        words_.back() |= ((static_cast<std::uint64_t>(value) >> done) & mask) << offset;
+        done += chunk;
+        bit_count_ += chunk;
+    }
+}
+
+std::uint32_t RoutingLog::read(std::uint64_t& cursor, unsigned bits) const {
+    if (cursor + bits > bit_count_) {
+        throw std::runtime_error("Routing log exhausted");
+    }
+    std::uint64_t value = 0;
+    for (unsigned done = 0; done < bits;) {
+        const unsigned offset = static_cast<unsigned>(cursor % 64);
+        const unsigned chunk = std::min(bits - done, 64 - offset);
+        const std::uint64_t mask = chunk == 64 ? ~0ULL : ((1ULL << chunk) - 1);
+        value |= ((words_[cursor / 64] >> offset) & mask) << done;
+        done += chunk;
+        cursor += chunk;
+    }
+    return static_cast<std::uint32_t>(value);
+}
+
+void RoutingLog::save(std::ostream& os) const {
+    write_pod(os, ROUTING_LOG_MAGIC);
+    write_pod(os, ROUTING_LOG_VERSION);
+    write_pod(os, static_cast<std::int32_t>(turns_));
+    write_pod(os, structure_hash_);
+    write_pod(os, bit_count_);
+    os.write(reinterpret_cast<const char*>(words_.data()),
+             static_cast<std::streamsize>(words_.size() * sizeof(std::uint64_t)));
+}
+
+RoutingLog RoutingLog::load(std::istream& is) {
+    if (read_pod<std::uint32_t>(is) != ROUTING_LOG_MAGIC || read_pod<std::uint32_t>(is) != ROUTING_LOG_VERSION) {
+        throw std::runtime_error("Not a routing log");
+    }
+    RoutingLog log;
+    log.turns_ = read_pod<std::int32_t>(is);
+    log.structure_hash_ = read_pod<std::uint64_t>(is);
+    log.bit_count_ = read_pod<std::uint64_t>(is);
+    log.words_.resize((log.bit_count_ + 63) / 64);
+    if (!is.read(reinterpret_cast<char*>(log.words_.data()),
+                 static_cast<std::streamsize>(log.words_.size() * sizeof(std::uint64_t)))) {
+        throw std::runtime_error("Truncated routing log");
+    }
+    return log;
+}
+
+std::uint64_t routing_structure_hash(const Factory& factory) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    auto add_sender = [&hash](ElementType type, ElementID id, const PackageSender& sender) {
+        hash = fnv1a(hash, static_cast<std::int64_t>(type));
+        hash = fnv1a(hash, id);
+        for (const IPackageReceiver* r : sender.receiver_preferences_.sorted_receivers()) {
+            hash = fnv1a(hash, static_cast<std::int64_t>(r->get_receiver_type()));
+            hash = fnv1a(hash, r->get_id());
+        }
+    };
+    // Parametry czasowe i pojemności decydują, w której turze nadawca losuje
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        add_sender(ElementType::RAMP, it->get_id(), *it);
+        hash = fnv1a(hash, it->get_delivery_interval());
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        add_sender(ElementType::WORKER, it->get_id(), *it);
+        hash = fnv1a(hash, it->get_processing_duration());
+        hash = fnv1a(hash, static_cast<std::int64_t>(it->get_queue()->get_queue_type()));
+        hash = fnv1a(hash, static_cast<std::int64_t>(it->get_queue_capacity()));
+    }
+    return hash;
+}
+
+RoutingLog record_simulation(Factory& factory, TimeOffset d,
+                             const std::function<void(Factory&, TimeOffset)>& rf) {
+    if (!factory.is_consistent()) {
+        throw std::logic_error("Non-consistent factory");
+    }
+
+    RoutingLog log;
+    log.structure_hash_ = routing_structure_hash(factory);
+    log.turns_ = d;
+
+    auto route = [&log](PackageSender& sender) {
+        if (!sender.get_sending_buffer()) {
+            return;
+        }
+        IPackageReceiver* receiver = sender.receiver_preferences_.choose_receiver();
+        if (receiver == nullptr) {
+            return;
+        }
+        const auto& receivers = sender.receiver_preferences_.sorted_receivers();
+        auto index = std::find(receivers.begin(), receivers.end(), receiver) - receivers.begin();
+        log.write(static_cast<std::uint32_t>(index), index_bits(receivers.size()));
+        sender.send_package_to(receiver);
+    };
+
+    for (Time t = 1; t <= d; ++t) {
+        for (auto it = factory.ramp_begin(); it != factory.ramp_end(); ++it) {
+            bool was_empty = !it->get_sending_buffer();
+            it->deliver_goods(t);
+            log.write(was_empty && it->get_sending_buffer() ? 1 : 0, 1);
+        }
+        std::for_each(factory.ramp_begin(), factory.ramp_end(), route);
+        std::for_each(factory.worker_begin(), factory.worker_end(), route);
+        factory.do_work(t);
+        if (rf) {
+            rf(factory, t);
+        }
+    }
+    return log;
+}
+
+void replay_simulation(Factory& factory, const RoutingLog& log,
+                       const std::function<void(Factory&, TimeOffset)>& rf) {
+    if (routing_structure_hash(factory) != log.structure_hash()) {
+        throw std::runtime_error("Routing log recorded for a different structure");
+    }
+
+    std::uint64_t cursor = 0;
+    auto route = [&log, &cursor](PackageSender& sender) {
+        const auto& receivers = sender.receiver_preferences_.sorted_receivers();
+        if (!sender.get_sending_buffer() || receivers.empty()) {
+            return;
+        }
+        std::uint32_t index = log.read(cursor, index_bits(receivers.size()));
+        if (index >= receivers.size()) {
+            throw std::runtime_error("Replay diverged: invalid receiver index");
+        }
+        sender.send_package_to(receivers[index]);
+    };
+
+    for (Time t = 1; t <= log.turns(); ++t) {
+        for (auto it = factory.ramp_begin(); it != factory.ramp_end(); ++it) {
+            bool was_empty = !it->get_sending_buffer();
+            it->deliver_goods(t);
+            bool delivered = was_empty && it->get_sending_buffer();
+            if (log.read(cursor, 1) != (delivered ? 1u : 0u)) {
+                throw std::runtime_error("Replay diverged: ramp delivery mismatch");
+            }
+        }
+        std::for_each(factory.ramp_begin(), factory.ramp_end(), route);
+        std::for_each(factory.worker_begin(), factory.worker_end(), route);
+        factory.do_work(t);
+        if (rf) {
+            rf(factory, t);
+        }
+    }
+    if (cursor != log.bit_count()) {
+        throw std::runtime_error("Replay diverged: unused routing log entries");
+    }
+}
@@ -0,0 +1,224 @@
+#include "result_cache.hpp"
+
+#include "helpers.hpp"
+#include "simulate.hpp"
+#include "snapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+namespace {
+
+constexpr const char* RESULT_FILE_TAG = "NSR";
+
+class Fnv1a {
+public:
+    void add_byte(unsigned char byte) {
+        hash_ ^= byte;
+        hash_ *= 0x100000001B3ULL;
+    }
+
+    void add(std::uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            add_byte(static_cast<unsigned char>(value >> (8 * i)));
+        }
+    }
+
+    void add(double value) {
+        std::uint64_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        add(bits);
+    }
+
+    std::uint64_t value() const { return hash_; }
+
+private:
+    std::uint64_t hash_ = 0xCBF29CE484222325ULL;
+};
+
+void add_links(Fnv1a& h, const PackageSender& sender) {
+    const auto& prefs = sender.receiver_preferences_.get_preferences();
+    h.add(static_cast<std::uint64_t>(prefs.size()));
+    for (const auto& [receiver, probability] : prefs) {
+        h.add(static_cast<std::uint64_t>(receiver->get_receiver_type()));
+        h.add(static_cast<std::uint64_t>(receiver->get_id()));
+        h.add(probability);
+    }
+}
+
+std::string key_hex(std::uint64_t key) {
+    std::ostringstream os;
+    os << std::hex << std::setw(16) << std::setfill('0') << key;
+    return os.str();
+}
+
+Factory copy_structure(const Factory& factory) {
+    std::stringstream ss;
+    save_factory_structure(factory, ss, StructureFormat::BINARY);
+    return load_factory_structure(ss);
+}
+
+void write_metrics(const Factory& factory, Time t, std::ostream& os) {
+    FactorySnapshot snapshot = capture_snapshot(factory, t);
+    os << "turn," << snapshot.turn << '\n';
+    os << "worker,id,queue,busy,sending,blocked\n";
+    for (const auto& w : snapshot.workers) {
+        os << "worker," << w.id << ',' << w.queue_length << ',' << static_cast<int>(w.busy) << ','
+           << static_cast<int>(w.sending) << ',' << w.blocked_turns << '\n';
+    }
+    os << "storehouse,id,stock\n";
+    for (const auto& s : snapshot.storehouses) {
+        os << "storehouse," << s.id << ',' << s.stock << '\n';
+    }
+    os << "ramp,id,loaded,blocked\n";
+    for (const auto& r : snapshot.ramps) {
+        os << "ramp," << r.id << ',' << static_cast<int>(r.loaded) << ',' << r.blocked_turns << '\n';
+    }
+}
+
+bool read_section(std::istream& is, const std::string& name, std::string& out) {
+    std::string tag;
+    std::size_t size = 0;
+    if (!(is >> tag >> size) || tag != name || is.get() != '\n') {
+        return false;
+    }
+    out.resize(size);
+    return static_cast<bool>(is.read(out.data(), static_cast<std::streamsize>(size)));
+}
+
+} // namespace
+
+std::uint64_t structure_hash(const Factory& factory) {
+    Fnv1a h;
+    h.add(static_cast<std::uint64_t>(RESULT_CACHE_VERSION));
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        h.add(static_cast<std::uint64_t>(ElementType::RAMP));
+        h.add(static_cast<std::uint64_t>(it->get_id()));
+        h.add(static_cast<std::uint64_t>(it->get_delivery_interval()));
+        add_links(h, *it);
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        h.add(static_cast<std::uint64_t>(ElementType::WORKER));
+        h.add(static_cast<std::uint64_t>(it->get_id()));
+        h.add(static_cast<std::uint64_t>(it->get_processing_duration()));
+        h.add(static_cast<std::uint64_t>(it->get_queue()->get_queue_type()));
+        h.add(static_cast<std::uint64_t>(it->get_queue_capacity()));
+        add_links(h, *it);
+    }
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        h.add(static_cast<std::uint64_t>(ElementType::STOREHOUSE));
+        h.add(static_cast<std::uint64_t>(it->get_id()));
+    }
+    return h.value();
+}
+
+std::uint64_t run_key(std::uint64_t structure_hash, const RunParameters& params) {
+    Fnv1a h;
+    h.add(static_cast<std::uint64_t>(RESULT_CACHE_VERSION));
+    h.add(RoutingStream::ALGORITHM);
+    h.add(structure_hash);
+    h.add(params.seed);
+    h.add(static_cast<std::uint64_t>(params.horizon));
+    h.add(static_cast<std::uint64_t>(params.report_interval));
+    h.add(static_cast<std::uint64_t>(params.report_turns.size()));
+    for (Time t : params.report_turns) {
+        h.add(static_cast<std::uint64_t>(t));
+    }
+    return h.value();
+}
+
+CachedRun simulate_run(Factory& factory, const RunParameters& params) {
+    factory.seed_routing(params.seed);
+
+    CachedRun result;
+    result.key = run_key(structure_hash(factory), params);
+    IntervalReportNotifier interval(params.report_interval);
+    std::ostringstream reports;
+    Time last = 0;
+    simulate(factory, params.horizon, [&](Factory& f, TimeOffset t) {
+        if (interval.should_generate_report(t) || params.report_turns.count(t) != 0) {
+            generate_simulation_report(f, reports, t);
+        }
+        last = t;
+    });
+    std::ostringstream metrics;
+    write_metrics(factory, last, metrics);
+    result.reports = reports.str();
+    result.metrics = metrics.str();
+    return result;
+}
+
+CachedRun run_uncached(const Factory& factory, const RunParameters& params) {
+    // Własny rejestr ID - wynik jak w świeżym procesie niezależnie od żywych paczek
+    PackageIdAllocator ids;
+    Factory copy = copy_structure(factory);
+    copy.set_package_id_allocator(ids);
+    return simulate_run(copy, params);
+}
+
+ResultCache::ResultCache(std::string directory) : directory_(std::move(directory)) {
+    std::filesystem::create_directories(directory_);
+}
+
+std::string ResultCache::path_for(std::uint64_t key) const {
+    return (std::filesystem::path(directory_) / (key_hex(key) + ".nsr")).string();
+}
+
+std::optional<CachedRun> ResultCache::lookup(std::uint64_t key) const {
+    std::ifstream is(path_for(key), std::ios::binary);
+    if (!is) {
+        return std::nullopt;
+    }
+    std::string tag;
+    std::uint32_t version = 0;
+    std::string hex;
+    if (!(is >> tag >> version >> hex) || tag != RESULT_FILE_TAG || version != RESULT_CACHE_VERSION
+        || hex != key_hex(key) || is.get() != '\n') {
+        return std::nullopt;
+    }
+    CachedRun run;
+    run.key = key;
+    run.hit = true;
+    if (!read_section(is, "reports", run.reports) || !read_section(is, "metrics", run.metrics)) {
+        return std::nullopt;
+    }
+    return run;
+}
+
+void ResultCache::store(const CachedRun& run) const {
+    const std::string path = path_for(run.key);
+    const std::string temp = path + ".tmp." + std::to_string(::getpid());
+    {
+        std::ofstream os(temp, std::ios::binary | std::ios::trunc);
+        os << RESULT_FILE_TAG << ' ' << RESULT_CACHE_VERSION << ' ' << key_hex(run.key) << '\n';
+        os << "reports " << run.reports.size() << '\n' << run.reports;
+        os << "metrics " << run.metrics.size() << '\n' << run.metrics;
+        if (!os.flush()) {
+            std::remove(temp.c_str());
+            throw std::runtime_error("Cannot write result cache entry: " + temp);
+        }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        throw std::runtime_error("Cannot store result cache entry: " + path);
+    }
+}
+
+CachedRun ResultCache::run(const Factory& factory, const RunParameters& params) {
+    const std::uint64_t key = run_key(structure_hash(factory), params);
+    if (auto cached = lookup(key)) {
+        ++hits_;
+        return *cached;
+    }
+    ++misses_;
+    CachedRun result = run_uncached(factory, params);
+    store(result);
+    return result;
+}
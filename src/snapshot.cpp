@@ -0,0 +1,174 @@
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::size_t segment_size(std::size_t workers, std::size_t storehouses, std::size_t ramps) {
+    return sizeof(SnapshotHeader) + workers * sizeof(WorkerSnapshot) + storehouses * sizeof(StorehouseSnapshot)
+           + ramps * sizeof(RampSnapshot);
+}
+
+std::runtime_error system_error(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+FactorySnapshot capture_snapshot(const Factory& factory, Time t) {
+    FactorySnapshot snapshot;
+    snapshot.turn = t;
+    for (const Worker* w : factory.workers_by_id()) {
+        snapshot.workers.push_back(make_worker_snapshot(*w));
+    }
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        snapshot.storehouses.push_back(make_storehouse_snapshot(*it));
+    }
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        snapshot.ramps.push_back(make_ramp_snapshot(*it));
+    }
+    return snapshot;
+}
+
+SnapshotPublisher::SnapshotPublisher(const std::string& name, const Factory& factory, TimeOffset interval)
+    : name_(name), interval_(interval) {
+    std::size_t workers = std::distance(factory.worker_cbegin(), factory.worker_cend());
+    std::size_t storehouses = std::distance(factory.storehouse_cbegin(), factory.storehouse_cend());
+    std::size_t ramps = std::distance(factory.ramp_cbegin(), factory.ramp_cend());
+    size_ = segment_size(workers, storehouses, ramps);
+
+    int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        throw system_error("shm_open " + name_);
+    }
+    if (ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+        close(fd);
+        shm_unlink(name_.c_str());
+        throw system_error("ftruncate " + name_);
+    }
+    mapping_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping_ == MAP_FAILED) {
+        shm_unlink(name_.c_str());
+        throw system_error("mmap " + name_);
+    }
+
+    auto* header = new (mapping_) SnapshotHeader{};
+    header->magic = SNAPSHOT_MAGIC;
+    header->version = SNAPSHOT_VERSION;
+    header->sequence.store(0, std::memory_order_relaxed);
+    header->worker_capacity = static_cast<std::uint32_t>(workers);
+    header->storehouse_capacity = static_cast<std::uint32_t>(storehouses);
+    header->ramp_capacity = static_cast<std::uint32_t>(ramps);
+}
+
+SnapshotPublisher::~SnapshotPublisher() {
+    munmap(mapping_, size_);
+    shm_unlink(name_.c_str());
+}
+
+void SnapshotPublisher::publish(const Factory& factory, Time t) {
+    auto* header = static_cast<SnapshotHeader*>(mapping_);
+    auto* workers = reinterpret_cast<WorkerSnapshot*>(header + 1);
+    auto* storehouses = reinterpret_cast<StorehouseSnapshot*>(workers + header->worker_capacity);
+    auto* ramps = reinterpret_cast<RampSnapshot*>(storehouses + header->storehouse_capacity);
+
+    const auto& sorted_workers = factory.workers_by_id();
+    std::size_t storehouse_count = std::distance(factory.storehouse_cbegin(), factory.storehouse_cend());
+    std::size_t ramp_count = std::distance(factory.ramp_cbegin(), factory.ramp_cend());
+    if (sorted_workers.size() > header->worker_capacity || storehouse_count > header->storehouse_capacity
+        || ramp_count > header->ramp_capacity) {
+        throw std::logic_error("Factory outgrew snapshot segment");
+    }
+
+    const std::uint64_t seq = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    header->turn = t;
+    header->worker_count = static_cast<std::uint32_t>(sorted_workers.size());
+    header->storehouse_count = static_cast<std::uint32_t>(storehouse_count);
+    header->ramp_count = static_cast<std::uint32_t>(ramp_count);
+
+    for (std::size_t i = 0; i < sorted_workers.size(); ++i) {
+        workers[i] = make_worker_snapshot(*sorted_workers[i]);
+    }
+    std::size_t i = 0;
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it, ++i) {
+        storehouses[i] = make_storehouse_snapshot(*it);
+    }
+    i = 0;
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it, ++i) {
+        ramps[i] = make_ramp_snapshot(*it);
+    }
+
+    header->sequence.store(seq + 2, std::memory_order_release);
+}
+
+SnapshotReader::SnapshotReader(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw system_error("shm_open " + name);
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        close(fd);
+        throw std::runtime_error("Invalid snapshot segment " + name);
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    mapping_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping_ == MAP_FAILED) {
+        throw system_error("mmap " + name);
+    }
+
+    const auto* header = static_cast<const SnapshotHeader*>(mapping_);
+    if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION
+        || size_ < segment_size(header->worker_capacity, header->storehouse_capacity, header->ramp_capacity)) {
+        munmap(const_cast<void*>(mapping_), size_);
+        throw std::runtime_error("Incompatible snapshot segment " + name);
+    }
+}
+
+SnapshotReader::~SnapshotReader() {
+    munmap(const_cast<void*>(mapping_), size_);
+}
+
+bool SnapshotReader::read(FactorySnapshot& out) const {
+    const auto* header = static_cast<const SnapshotHeader*>(mapping_);
+    const auto* workers = reinterpret_cast<const WorkerSnapshot*>(header + 1);
+    const auto* storehouses = reinterpret_cast<const StorehouseSnapshot*>(workers + header->worker_capacity);
+    const auto* ramps = reinterpret_cast<const RampSnapshot*>(storehouses + header->storehouse_capacity);
+
+    while (true) {
+        const std::uint64_t before = header->sequence.load(std::memory_order_acquire);
+        if (before == 0) {
+            return false;
+        }
+        if (before % 2 != 0) {
+            continue;
+        }
+
+        std::uint32_t worker_count = std::min(header->worker_count, header->worker_capacity);
+        std::uint32_t storehouse_count = std::min(header->storehouse_count, header->storehouse_capacity);
+        std::uint32_t ramp_count = std::min(header->ramp_count, header->ramp_capacity);
+        out.turn = header->turn;
+        out.workers.assign(workers, workers + worker_count);
+        out.storehouses.assign(storehouses, storehouses + storehouse_count);
+        out.ramps.assign(ramps, ramps + ramp_count);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+}
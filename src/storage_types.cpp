@@ -3,7 +3,6 @@
 PackageQueue::PackageQueue(PackageQueueType queue_type) : queue_type_(queue_type), queue_() {};
 
 Package PackageQueue::pop() {
-  Package p;
   if(queue_.empty()) {
     throw std::out_of_range("The queue is empty");
   }
@@ -17,7 +16,7 @@ Package PackageQueue::pop() {
     queue_.pop_back();
     return temp;
   }
-  return p;
+  throw std::logic_error("Unknown queue type");
 }
 
 PackageQueueType PackageQueue::get_queue_type() const {
@@ -0,0 +1,559 @@
+#include "structure_diff.hpp"
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+NodeKey decode_node_key(const std::string& raw_id) {
+    auto [type, id] = decode_node_id(raw_id);
+    if (type == NODE_TYPE_RAMP) {
+        return NodeKey{ElementType::RAMP, id};
+    }
+    if (type == NODE_TYPE_WORKER) {
+        return NodeKey{ElementType::WORKER, id};
+    }
+    if (type == NODE_TYPE_STOREHOUSE) {
+        return NodeKey{ElementType::STOREHOUSE, id};
+    }
+    throw std::logic_error("Invalid node reference");
+}
+
+NodeKey key_of(const IPackageReceiver* receiver) {
+    ElementType type = receiver->get_receiver_type() == ReceiverType::STOREHOUSE ? ElementType::STOREHOUSE
+                                                                                  : ElementType::WORKER;
+    return NodeKey{type, receiver->get_id()};
+}
+
+const std::string& required(const DiffOperation& op, const std::string& name) {
+    auto it = op.params.find(name);
+    if (it == op.params.end()) {
+        throw std::logic_error("Missing parameter: " + name);
+    }
+    return it->second;
+}
+
+std::pair<NodeKey, NodeKey> link_of(const DiffOperation& op) {
+    NodeKey src = decode_node_key(required(op, "src"));
+    NodeKey dest = decode_node_key(required(op, "dest"));
+    if (src.type == ElementType::STOREHOUSE || dest.type == ElementType::RAMP) {
+        throw std::logic_error("Invalid LINK");
+    }
+    return {src, dest};
+}
+
+bool exists_in(const Factory& f, const NodeKey& key) {
+    switch (key.type) {
+        case ElementType::RAMP:
+            return f.find_ramp_by_id(key.id) != f.ramp_cend();
+        case ElementType::WORKER:
+            return f.find_worker_by_id(key.id) != f.worker_cend();
+        case ElementType::STOREHOUSE:
+            return f.find_storehouse_by_id(key.id) != f.storehouse_cend();
+        default:
+            return false;
+    }
+}
+
+const PackageSender* sender_in(const Factory& f, const NodeKey& key) {
+    if (key.type == ElementType::RAMP) {
+        auto it = f.find_ramp_by_id(key.id);
+        return it != f.ramp_cend() ? &*it : nullptr;
+    }
+    if (key.type == ElementType::WORKER) {
+        auto it = f.find_worker_by_id(key.id);
+        return it != f.worker_cend() ? &*it : nullptr;
+    }
+    return nullptr;
+}
+
+PackageSender* sender_in(Factory& f, const NodeKey& key) {
+    return const_cast<PackageSender*>(sender_in(static_cast<const Factory&>(f), key));
+}
+
+IPackageReceiver* receiver_in(Factory& f, const NodeKey& key) {
+    if (key.type == ElementType::WORKER) {
+        auto it = f.find_worker_by_id(key.id);
+        return it != f.worker_end() ? &*it : nullptr;
+    }
+    if (key.type == ElementType::STOREHOUSE) {
+        auto it = f.find_storehouse_by_id(key.id);
+        return it != f.storehouse_end() ? &*it : nullptr;
+    }
+    return nullptr;
+}
+
+// Struktura po zmianie widziana jako nakładka na bieżącą fabrykę - pozwala sprawdzić
+// spójność, zanim cokolwiek zostanie zmienione.
+class DiffOverlay {
+public:
+    explicit DiffOverlay(const Factory& f) : f_(f) {}
+
+    bool exists(const NodeKey& key) const {
+        if (removed_.count(key)) {
+            return false;
+        }
+        return added_.count(key) || exists_in(f_, key);
+    }
+
+    void add_node(const NodeKey& key) {
+        if (removed_.count(key)) {
+            throw std::logic_error("Node removed and added again in one diff");
+        }
+        if (exists(key)) {
+            throw std::logic_error("Node already exists");
+        }
+        added_.insert(key);
+        if (key.type != ElementType::STOREHOUSE) {
+            affected_.insert(key);
+        }
+    }
+
+    void remove_node(const NodeKey& key) {
+        require(key);
+        removed_.insert(key);
+        affected_.erase(key);
+        // Nadawcy tracący odbiorcę
+        for (const auto& sender : senders_linking_to(key)) {
+            affected_.insert(sender);
+        }
+    }
+
+    void add_link(const NodeKey& src, const NodeKey& dest) {
+        require(src);
+        require(dest);
+        removed_links_.erase({src, dest});
+        added_links_[src].insert(dest);
+    }
+
+    void remove_link(const NodeKey& src, const NodeKey& dest) {
+        require(src);
+        require(dest);
+        added_links_[src].erase(dest);
+        removed_links_.insert({src, dest});
+        affected_.insert(src);
+    }
+
+    void require(const NodeKey& key) const {
+        if (!exists(key)) {
+            throw std::logic_error("Diff refers to undefined node");
+        }
+    }
+
+    std::vector<NodeKey> receivers(const NodeKey& sender) const {
+        std::vector<NodeKey> result;
+        auto keep = [&](const NodeKey& dest) {
+            return exists(dest) && !removed_links_.count({sender, dest});
+        };
+        if (!added_.count(sender)) {
+            if (const PackageSender* s = sender_in(f_, sender)) {
+                for (IPackageReceiver* r : s->receiver_preferences_.sorted_receivers()) {
+                    NodeKey dest = key_of(r);
+                    if (keep(dest)) {
+                        result.push_back(dest);
+                    }
+                }
+            }
+        }
+        auto it = added_links_.find(sender);
+        if (it != added_links_.end()) {
+            for (const auto& dest : it->second) {
+                if (keep(dest)) {
+                    result.push_back(dest);
+                }
+            }
+        }
+        return result;
+    }
+
+    // Sprawdza, czy każdy dotknięty nadawca ma drogę do magazynu; zwraca liczbę sprawdzonych
+    std::size_t check_affected() const {
+        std::set<NodeKey> verified;
+        std::size_t checked = 0;
+        for (const auto& sender : affected_) {
+            if (!exists(sender)) {
+                continue;
+            }
+            ++checked;
+            std::set<NodeKey> visited;
+            if (!reaches_storehouse(sender, visited, verified)) {
+                throw std::logic_error("Diff leaves " + ElementTypeTags.at(sender.type) + " " +
+                                       std::to_string(sender.id) + " without a reachable storehouse");
+            }
+        }
+        return checked;
+    }
+
+private:
+    std::vector<NodeKey> senders_linking_to(const NodeKey& key) const {
+        std::vector<NodeKey> senders;
+        auto scan = [&](const PackageSender& s, const NodeKey& sender) {
+            for (const auto& [receiver, prob] : s.receiver_preferences_.get_preferences()) {
+                if (key_of(receiver) == key) {
+                    senders.push_back(sender);
+                    return;
+                }
+            }
+        };
+        if (key.type != ElementType::RAMP) {
+            for (auto it = f_.ramp_cbegin(); it != f_.ramp_cend(); ++it) {
+                scan(*it, NodeKey{ElementType::RAMP, it->get_id()});
+            }
+            for (auto it = f_.worker_cbegin(); it != f_.worker_cend(); ++it) {
+                scan(*it, NodeKey{ElementType::WORKER, it->get_id()});
+            }
+        }
+        for (const auto& [sender, dests] : added_links_) {
+            if (dests.count(key)) {
+                senders.push_back(sender);
+            }
+        }
+        return senders;
+    }
+
+    bool reaches_storehouse(const NodeKey& node, std::set<NodeKey>& visited, std::set<NodeKey>& verified) const {
+        if (node.type == ElementType::STOREHOUSE || verified.count(node)) {
+            return true;
+        }
+        if (!visited.insert(node).second) {
+            return false;
+        }
+        for (const auto& dest : receivers(node)) {
+            if (reaches_storehouse(dest, visited, verified)) {
+                verified.insert(node);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const Factory& f_;
+    std::set<NodeKey> added_;
+    std::set<NodeKey> removed_;
+    std::map<NodeKey, std::set<NodeKey>> added_links_;
+    std::set<std::pair<NodeKey, NodeKey>> removed_links_;
+    std::set<NodeKey> affected_;
+};
+
+// Rampa z zerowym interwałem dzieliłaby przez zero w deliver_goods()
+void validate_delivery_interval(const std::string& value) {
+    if (std::stoi(value) < 1) {
+        throw std::logic_error("Invalid delivery-interval: " + value);
+    }
+}
+
+// Robotnik z czasem przetwarzania < 1 kończyłby pracę od razu w simulate(), a nigdy
+// w silnikach liczących czas bez znaku - silniki by się rozjechały
+void validate_processing_time(const std::string& value) {
+    if (std::stoi(value) < 1) {
+        throw std::logic_error("Invalid processing-time: " + value);
+    }
+}
+
+// Pojemność stosowana jako size_t - ujemna wartość stałaby się ogromnym limitem
+std::size_t validate_queue_capacity(const std::string& value) {
+    if (std::stoi(value) < 0) {
+        throw std::logic_error("Invalid queue-capacity: " + value);
+    }
+    return std::stoul(value);
+}
+
+void validate_attributes(const DiffOperation& op) {
+    for (const auto& [name, value] : op.params) {
+        if (name == "id") {
+            continue;
+        }
+        bool known = (op.type == ElementType::RAMP && name == "delivery-interval") ||
+                     (op.type == ElementType::WORKER && (name == "processing-time" || name == "queue-capacity"));
+        if (!known) {
+            throw std::logic_error("Unsupported attribute: " + name);
+        }
+        if (name == "delivery-interval") {
+            validate_delivery_interval(value);
+        } else if (name == "processing-time") {
+            validate_processing_time(value);
+        } else {
+            validate_queue_capacity(value);
+        }
+    }
+}
+
+// Paczki usuniętego węzła czekające na nowych odbiorców
+struct ReroutedPackages {
+    std::vector<Package> packages;
+    std::vector<NodeKey> targets;
+};
+
+// Liczba paczek usuwanego węzła i jego odbiorcy w chwili usunięcia
+struct PlannedReroute {
+    std::size_t packages = 0;
+    std::vector<NodeKey> targets;
+};
+
+// Kolejni odbiorcy po kolei, z pominięciem tych bez miejsca (has_room(i)); zwraca
+// indeks odbiorcy albo targets, gdy nikt nie ma miejsca
+template <typename HasRoom>
+std::size_t next_with_room(std::size_t& cursor, std::size_t targets, HasRoom&& has_room) {
+    for (std::size_t k = 0; k < targets; ++k) {
+        std::size_t i = (cursor + k) % targets;
+        if (has_room(i)) {
+            cursor = i + 1;
+            return i;
+        }
+    }
+    return targets;
+}
+
+std::size_t packages_of(const PackageSender* sender, ElementType type) {
+    if (sender == nullptr) {
+        return 0;
+    }
+    std::size_t count = sender->get_sending_buffer().has_value();
+    if (type == ElementType::WORKER) {
+        const auto* worker = static_cast<const Worker*>(sender);
+        count += worker->get_queue()->size() + worker->get_processing_buffer().has_value();
+    }
+    return count;
+}
+
+// Sprawdza, czy paczki usuwanych węzłów zmieszczą się u odbiorców, którzy przetrwają
+// zmianę (limity kolejek po zmianie); rozkład jak w fazie przekierowania
+void check_reroute_capacity(const Factory& f, const DiffOverlay& overlay, const std::vector<PlannedReroute>& plans,
+                            const std::map<NodeKey, std::size_t>& capacities) {
+    std::map<NodeKey, std::size_t> load;
+    for (const auto& plan : plans) {
+        std::vector<NodeKey> targets;
+        for (const auto& key : plan.targets) {
+            if (overlay.exists(key)) {
+                targets.push_back(key);
+            }
+        }
+        if (targets.empty() || plan.packages == 0) {
+            continue;
+        }
+        auto has_room = [&](std::size_t i) {
+            const NodeKey& key = targets[i];
+            if (key.type == ElementType::STOREHOUSE) {
+                return true;
+            }
+            auto worker = f.find_worker_by_id(key.id);
+            std::size_t capacity = 0;
+            if (auto it = capacities.find(key); it != capacities.end()) {
+                capacity = it->second;
+            } else if (worker != f.worker_cend()) {
+                capacity = worker->get_queue_capacity();
+            }
+            std::size_t queued = worker != f.worker_cend() ? worker->get_queue()->size() : 0;
+            return capacity == 0 || queued + load[key] < capacity;
+        };
+        std::size_t cursor = 0;
+        for (std::size_t p = 0; p < plan.packages; ++p) {
+            std::size_t i = next_with_room(cursor, targets.size(), has_room);
+            if (i == targets.size()) {
+                throw std::logic_error("Diff reroutes more packages than the remaining receivers can queue");
+            }
+            ++load[targets[i]];
+        }
+    }
+}
+
+} // namespace
+
+StructureDiff load_structure_diff(std::istream& is) {
+    static const std::map<std::string, DiffAction> actions = {
+        {"ADD", DiffAction::ADD}, {"REMOVE", DiffAction::REMOVE}, {"SET", DiffAction::SET}};
+
+    StructureDiff diff;
+    std::string line;
+    while (std::getline(is, line)) {
+        if (line.empty() || line[0] == ';') {
+            continue;
+        }
+        std::istringstream ss(line);
+        std::string action, tag;
+        ss >> action >> tag;
+        auto action_it = actions.find(action);
+        if (action_it == actions.end()) {
+            throw std::logic_error("Invalid diff");
+        }
+        DiffOperation op{action_it->second, ElementType::LINK, {}};
+        bool known_tag = false;
+        for (const auto& [type, type_tag] : ElementTypeTags) {
+            if (type_tag == tag) {
+                op.type = type;
+                known_tag = true;
+            }
+        }
+        if (!known_tag || (op.type == ElementType::LINK && op.action == DiffAction::SET)) {
+            throw std::logic_error("Invalid diff");
+        }
+        op.params = parse_line(line.substr(line.find(tag)));
+        diff.operations.push_back(std::move(op));
+    }
+    return diff;
+}
+
+DiffResult apply_structure_diff(Factory& factory, const StructureDiff& diff, RemovedPackagePolicy policy) {
+    DiffResult result;
+
+    // 1. Walidacja na nakładce - fabryka jeszcze niezmieniona
+    DiffOverlay overlay(factory);
+    std::vector<PlannedReroute> plans;
+    std::map<NodeKey, std::size_t> capacities;   // limity kolejek ustawione w zmianie
+    for (const auto& op : diff.operations) {
+        if (op.type == ElementType::LINK) {
+            auto [src, dest] = link_of(op);
+            if (op.action == DiffAction::ADD) {
+                overlay.add_link(src, dest);
+            } else {
+                overlay.remove_link(src, dest);
+            }
+            continue;
+        }
+        NodeKey key{op.type, std::stoi(required(op, "id"))};
+        switch (op.action) {
+            case DiffAction::ADD:
+                if (op.type == ElementType::RAMP) {
+                    validate_delivery_interval(required(op, "delivery-interval"));
+                } else if (op.type == ElementType::WORKER) {
+                    validate_processing_time(required(op, "processing-time"));
+                    auto cap_it = op.params.find("queue-capacity");
+                    capacities[key] = cap_it != op.params.end() ? validate_queue_capacity(cap_it->second) : 0;
+                }
+                overlay.add_node(key);
+                break;
+            case DiffAction::REMOVE:
+                if (policy == RemovedPackagePolicy::REROUTE && key.type != ElementType::STOREHOUSE) {
+                    overlay.require(key);
+                    PlannedReroute plan{packages_of(sender_in(factory, key), key.type), {}};
+                    for (const auto& dest : overlay.receivers(key)) {
+                        if (!(dest == key)) {
+                            plan.targets.push_back(dest);
+                        }
+                    }
+                    // Kolejność odbiorców jak w sorted_receivers() (ReceiverOrder)
+                    std::sort(plan.targets.begin(), plan.targets.end(), [](const NodeKey& a, const NodeKey& b) {
+                        bool a_store = a.type == ElementType::STOREHOUSE;
+                        bool b_store = b.type == ElementType::STOREHOUSE;
+                        return a_store != b_store ? a_store : a.id < b.id;
+                    });
+                    plans.push_back(std::move(plan));
+                }
+                overlay.remove_node(key);
+                break;
+            case DiffAction::SET:
+                overlay.require(key);
+                validate_attributes(op);
+                if (auto cap_it = op.params.find("queue-capacity"); cap_it != op.params.end()) {
+                    capacities[key] = std::stoul(cap_it->second);
+                }
+                break;
+        }
+    }
+    result.checked_senders = overlay.check_affected();
+    check_reroute_capacity(factory, overlay, plans, capacities);
+
+    // 2. Nałożenie zmian
+    std::vector<ReroutedPackages> rerouted;
+    auto take_packages = [&](std::vector<Package>&& packages, const PackageSender& sender, const NodeKey& self) {
+        if (packages.empty()) {
+            return;
+        }
+        if (policy == RemovedPackagePolicy::DRAIN) {
+            result.drained += packages.size();
+            return;
+        }
+        ReroutedPackages group{std::move(packages), {}};
+        for (IPackageReceiver* r : sender.receiver_preferences_.sorted_receivers()) {
+            if (!(key_of(r) == self)) {
+                group.targets.push_back(key_of(r));
+            }
+        }
+        rerouted.push_back(std::move(group));
+    };
+
+    for (const auto& op : diff.operations) {
+        ++result.operations;
+        if (op.type == ElementType::LINK) {
+            auto [src, dest] = link_of(op);
+            auto& prefs = sender_in(factory, src)->receiver_preferences_;
+            if (op.action == DiffAction::ADD) {
+                prefs.add_receiver(receiver_in(factory, dest));
+            } else {
+                prefs.remove_receiver(receiver_in(factory, dest));
+            }
+            continue;
+        }
+
+        ElementID id = std::stoi(op.params.at("id"));
+        if (op.action == DiffAction::ADD) {
+            if (op.type == ElementType::RAMP) {
+                factory.add_ramp(Ramp(id, std::stoi(op.params.at("delivery-interval"))));
+            } else if (op.type == ElementType::WORKER) {
+                auto qt_it = op.params.find("queue-type");
+                PackageQueueType qt = (qt_it != op.params.end() && qt_it->second == "FIFO") ? PackageQueueType::FIFO
+                                                                                           : PackageQueueType::LIFO;
+                auto cap_it = op.params.find("queue-capacity");
+                std::size_t capacity = cap_it != op.params.end() ? std::stoul(cap_it->second) : 0;
+                factory.add_worker(Worker(id, std::stoi(op.params.at("processing-time")),
+                                          std::make_unique<PackageQueue>(qt), capacity));
+            } else {
+                factory.add_storehouse(Storehouse(id));
+            }
+        } else if (op.action == DiffAction::REMOVE) {
+            NodeKey key{op.type, id};
+            if (op.type == ElementType::RAMP) {
+                Ramp& ramp = *factory.find_ramp_by_id(id);
+                std::vector<Package> packages;
+                if (ramp.get_sending_buffer()) {
+                    packages.push_back(ramp.release_package());
+                }
+                take_packages(std::move(packages), ramp, key);
+                factory.remove_ramp(id);
+            } else if (op.type == ElementType::WORKER) {
+                Worker& worker = *factory.find_worker_by_id(id);
+                take_packages(worker.release_all_packages(), worker, key);
+                factory.remove_worker(id);
+            } else {
+                result.drained += factory.find_storehouse_by_id(id)->size();
+                factory.remove_storehouse(id);
+            }
+        } else {
+            for (const auto& [name, value] : op.params) {
+                if (op.type == ElementType::RAMP && name == "delivery-interval") {
+                    factory.find_ramp_by_id(id)->set_delivery_interval(std::stoi(value));
+                } else if (name == "processing-time") {
+                    factory.find_worker_by_id(id)->set_processing_duration(std::stoi(value));
+                } else if (name == "queue-capacity") {
+                    factory.find_worker_by_id(id)->set_queue_capacity(std::stoul(value));
+                }
+            }
+        }
+    }
+
+    // 3. Paczki z usuniętych węzłów - po kolei do odbiorców, którzy przetrwali zmianę,
+    // z pominięciem pełnych kolejek (miejsce sprawdzone w fazie 1)
+    for (auto& group : rerouted) {
+        std::vector<IPackageReceiver*> targets;
+        for (const auto& key : group.targets) {
+            if (IPackageReceiver* r = receiver_in(factory, key)) {
+                targets.push_back(r);
+            }
+        }
+        if (targets.empty()) {
+            result.drained += group.packages.size();
+            continue;
+        }
+        std::size_t cursor = 0;
+        for (auto& package : group.packages) {
+            std::size_t i = next_with_room(cursor, targets.size(),
+                                           [&](std::size_t k) { return targets[k]->can_receive(); });
+            targets[i]->receive_package(std::move(package));
+        }
+        result.rerouted += group.packages.size();
+    }
+    return result;
+}
@@ -0,0 +1,136 @@
+#include "variance_reduction.hpp"
+
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+struct RunOutcome {
+    double response = 0.0;
+    double control = 0.0;
+};
+
+RunOutcome run_once(const FactoryBuilder& make_factory, const ReplicationOptions& options, std::uint64_t seed,
+                    bool antithetic) {
+    Factory factory = make_factory();
+    factory.seed_routing(seed, antithetic);
+
+    MetricProbe probe(factory, options.target);
+
+    // Losowania ramp liczone dopiero po rozbiegu - w tym samym oknie co odpowiedź
+    struct ControlState {
+        double sum = 0.0;
+        bool counting = false;
+    };
+    auto control = std::make_shared<ControlState>();
+    if (options.control_variate) {
+        for (auto it = factory.ramp_begin(); it != factory.ramp_end(); ++it) {
+            auto& prefs = it->receiver_preferences_;
+            prefs.set_probability_generator([inner = prefs.get_probability_generator(), control]() {
+                const double u = inner();
+                if (control->counting) {
+                    control->sum += u - 0.5;
+                }
+                return u;
+            });
+        }
+    }
+
+    double sum = 0.0;
+    SimulationRun run(factory, options.turns);
+    while (!run.done()) {
+        control->counting = run.current_turn() + 1 > options.warmup;
+        Time t = run.step();
+        double value = probe.observe();
+        if (t > options.warmup) {
+            sum += value;
+        }
+    }
+    const double measured = static_cast<double>(options.turns - options.warmup);
+    return RunOutcome{sum / measured, control->sum / measured};
+}
+
+// Średnia z (Y - beta * C) z przedziałem ufności t-Studenta; C ma znaną średnią 0
+ReplicationEstimate estimate(const std::vector<RunOutcome>& observations, const ReplicationOptions& options) {
+    const std::size_t n = observations.size();
+    double mean_y = 0.0;
+    double mean_c = 0.0;
+    for (const auto& o : observations) {
+        mean_y += o.response;
+        mean_c += o.control;
+    }
+    mean_y /= static_cast<double>(n);
+    mean_c /= static_cast<double>(n);
+
+    double syy = 0.0;
+    double scc = 0.0;
+    double syc = 0.0;
+    for (const auto& o : observations) {
+        syy += (o.response - mean_y) * (o.response - mean_y);
+        scc += (o.control - mean_c) * (o.control - mean_c);
+        syc += (o.response - mean_y) * (o.control - mean_c);
+    }
+
+    ReplicationEstimate result;
+    result.observations = n;
+    double dof = static_cast<double>(n) - 1.0;
+    double residual = syy;
+    result.mean = mean_y;
+    if (options.control_variate && scc > 0.0 && n > 2) {
+        result.control_coefficient = syc / scc;
+        result.mean = mean_y - result.control_coefficient * mean_c;
+        residual = syy - syc * syc / scc;
+        dof -= 1.0;
+        result.variance_ratio = residual > 0.0 ? syy / residual : INFINITY;
+    }
+    const double variance = residual / dof;
+    result.half_width =
+        student_t_quantile(0.5 + options.confidence / 2.0, dof) * std::sqrt(variance / static_cast<double>(n));
+    return result;
+}
+
+template <typename Observe>
+ReplicationEstimate replicate(const ReplicationOptions& options, Observe&& observe) {
+    if (options.turns <= options.warmup || options.warmup < 0) {
+        throw std::invalid_argument("Invalid replication options");
+    }
+    const std::size_t count = options.antithetic ? options.replications / 2 : options.replications;
+    if (count < 2) {
+        throw std::invalid_argument("Need at least two independent observations");
+    }
+
+    std::vector<RunOutcome> observations;
+    observations.reserve(count);
+    for (std::size_t r = 0; r < count; ++r) {
+        const std::uint64_t seed = options.base_seed + r;
+        RunOutcome o = observe(seed, false);
+        if (options.antithetic) {
+            RunOutcome mirrored = observe(seed, true);
+            o.response = (o.response + mirrored.response) / 2.0;
+            o.control = (o.control + mirrored.control) / 2.0;
+        }
+        observations.push_back(o);
+    }
+    return estimate(observations, options);
+}
+
+} // namespace
+
+ReplicationEstimate run_replications(const FactoryBuilder& make_factory, const ReplicationOptions& options) {
+    return replicate(options, [&](std::uint64_t seed, bool antithetic) {
+        return run_once(make_factory, options, seed, antithetic);
+    });
+}
+
+ReplicationEstimate compare_variants(const FactoryBuilder& make_a, const FactoryBuilder& make_b,
+                                     const ReplicationOptions& options) {
+    // Bez wspólnych liczb losowych wariant B losuje z rozłącznego zakresu ziaren
+    const std::uint64_t b_offset = options.common_random_numbers ? 0 : 0x9E3779B97F4A7C15ULL;
+    return replicate(options, [&](std::uint64_t seed, bool antithetic) {
+        RunOutcome a = run_once(make_a, options, seed, antithetic);
+        RunOutcome b = run_once(make_b, options, seed + b_offset, antithetic);
+        return RunOutcome{a.response - b.response, (a.control + b.control) / 2.0};
+    });
+}
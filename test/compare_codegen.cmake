@@ -0,0 +1,12 @@
+# Porównuje raporty symulatora wygenerowanego przez netsim_codegen z raportami simulate().
+# Parametry: CODEGEN, GENERATED, STRUCTURE, TURNS, SEED
+execute_process(COMMAND ${GENERATED} ${TURNS} ${SEED}
+                OUTPUT_VARIABLE generated RESULT_VARIABLE generated_result)
+execute_process(COMMAND ${CODEGEN} --simulate ${STRUCTURE} ${TURNS} ${SEED}
+                OUTPUT_VARIABLE reference RESULT_VARIABLE reference_result)
+if(NOT generated_result EQUAL 0 OR NOT reference_result EQUAL 0)
+    message(FATAL_ERROR "Simulator failed: ${generated_result} / ${reference_result}")
+endif()
+if(NOT generated STREQUAL reference)
+    message(FATAL_ERROR "Generated simulator report differs from simulate() for ${STRUCTURE}")
+endif()
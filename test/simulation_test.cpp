@@ -1,4 +1,6 @@
-#include #include #include
+#include <fstream>
+#include <iostream>
+#include <string>
 #include "simulate.hpp"
 #include "factory.hpp"
 #include "io.hpp"
@@ -24,8 +26,7 @@ return 1;
 }
 
 IntervalReportNotifier notifier(1);
-simulate(factory, 3, [&notifier](Factory& f, TimeOffset t) {
-if (notifier.should_generate_report(t)) {
+simulate(factory, 3, [](Factory& f, TimeOffset t) {
 std::cout << "\n=== SIMULATION REPORT AT TIME " << t << " ===\n";
 generate_simulation_report(f, std::cout, t);
 
@@ -39,8 +40,7 @@ return;
 generate_simulation_report(f, out, t);
 
 out.close();
-}
-});
+}, notifier);
 
 return 0;
 }
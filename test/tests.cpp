@@ -6,6 +6,36 @@
 #include "helpers.hpp"
 #include "factory.hpp"
 #include "io.hpp"
+#include "simulate.hpp"
+#include "convergence.hpp"
+#include "snapshot.hpp"
+#include "partition.hpp"
+#include "replay.hpp"
+#include "flow_analysis.hpp"
+#include "lineage.hpp"
+#include "structure_diff.hpp"
+#include "binary_structure.hpp"
+#include "metrics.hpp"
+#include "variance_reduction.hpp"
+#include "differential.hpp"
+#include "codegen.hpp"
+#include "fluid.hpp"
+#include "rare_event.hpp"
+#include "result_cache.hpp"
+#include "daemon.hpp"
+#include "lanes.hpp"
+#include "local_socket.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 TEST(PackageSenderTest, SendingClearsBuffer) {
     Ramp r(1,1);
@@ -84,9 +114,10 @@ TEST(ReceiverPreferencesTest, ChooseReceiverProbability) {
     rp.add_receiver(&sh2);
     rp.add_receiver(&sh3);
 
-    EXPECT_EQ(rp.choose_receiver(), &sh3);
+    // Odbiorcy w kolejności ID, niezależnie od adresów
+    EXPECT_EQ(rp.choose_receiver(), &sh1);
     EXPECT_EQ(rp.choose_receiver(), &sh2);
-    EXPECT_EQ(rp.choose_receiver(), &sh1); 
+    EXPECT_EQ(rp.choose_receiver(), &sh3);
 }
 
 TEST(RampTest, IsTheDeliveryHappeningInTheCorrectTurn) {
@@ -169,9 +200,14 @@ TEST(WorkerTest, ProcessesPackageCorrectly) {
     EXPECT_TRUE(w.get_processing_buffer().has_value());
 
     w.do_work(6);
-    // processing ends
+    // processing ends, but the sending buffer is still full - the package waits
+    EXPECT_TRUE(w.get_processing_buffer().has_value());
+    EXPECT_EQ(w.get_sending_buffer()->get_id(), 1);
+
+    w.release_package();
+    w.do_work(7);
     EXPECT_FALSE(w.get_processing_buffer().has_value());
-    
+    EXPECT_EQ(w.get_sending_buffer()->get_id(), 2);
 }
 
 TEST(WorkerTest, SendsProcessedPackageCorrectly) {
@@ -391,6 +427,48 @@ TEST(UPELPackageTest, IsAssignmentOperatorCorrect) {
     EXPECT_EQ(p2.get_id(), 1);
 }
 
+TEST(PackageIdAllocatorTest, RunAllocatorIsIndependentOfGlobalRegistry) {
+    Package global;
+    PackageIdAllocator ids;
+    {
+        Package first(ids);
+        Package second(ids);
+        EXPECT_EQ(first.get_id(), 1);
+        EXPECT_EQ(second.get_id(), 2);
+        EXPECT_EQ(Package::assigned_id_count(), 1u);
+
+        // Przeniesiona paczka zwalnia ID w swoim rejestrze
+        Package moved(std::move(first));
+        second = std::move(moved);
+        EXPECT_EQ(ids.assigned_count(), 1u);
+        EXPECT_EQ(Package(ids).get_id(), 2);
+    }
+    EXPECT_EQ(ids.assigned_count(), 0u);
+    EXPECT_EQ(Package().get_id(), 2);
+    EXPECT_EQ(global.get_id(), 1);
+}
+
+TEST(PackageIdAllocatorTest, ManyLiveAllocatorsAndHandleReuse) {
+    // Więcej rejestrów naraz niż jeden blok tablicy numerów
+    std::vector<std::unique_ptr<PackageIdAllocator>> live;
+    for (int i = 0; i < 5000; ++i) {
+        live.push_back(std::make_unique<PackageIdAllocator>());
+    }
+    {
+        Package p(*live.back());
+        EXPECT_EQ(&PackageIdAllocator::from_handle(live.back()->handle()), live.back().get());
+        EXPECT_EQ(live.back()->assigned_count(), 1u);
+    }
+    EXPECT_EQ(live.back()->assigned_count(), 0u);
+
+    // Numer zniszczonego rejestru trafia do następnego
+    const std::uint32_t handle = live.front()->handle();
+    live.front().reset();
+    PackageIdAllocator reused;
+    EXPECT_EQ(reused.handle(), handle);
+    EXPECT_EQ(&PackageIdAllocator::from_handle(handle), &reused);
+}
+
 TEST(UPELPackageQueueTest, IsFifoCorrect) {
     PackageQueue q(PackageQueueType::FIFO);
     q.push(Package(1));
@@ -463,3 +541,1847 @@ TEST(UPELFactoryIOTest, ParseRamp) {
     EXPECT_EQ(1, r.get_id());
     EXPECT_EQ(3, r.get_delivery_interval());
 }
+
+// TESTY SYMULACJI KROKOWEJ
+
+TEST(SimulationRunTest, StepMatchesSimulate) {
+    const std::string structure =
+        "LOADING_RAMP id=1 delivery-interval=2\n"
+        "WORKER id=1 processing-time=3 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=store-1\n";
+
+    // ID paczek są globalne - pierwsza fabryka musi zniknąć przed startem drugiej
+    std::ostringstream report_a;
+    {
+        std::istringstream iss_a(structure);
+        Factory fa = load_factory_structure(iss_a);
+        simulate(fa, 10, [&report_a](Factory& f, TimeOffset t) {
+            generate_simulation_report(f, report_a, t);
+        });
+    }
+
+    std::istringstream iss_b(structure);
+    Factory fb = load_factory_structure(iss_b);
+    std::ostringstream report_b;
+    SimulationRun run(fb, 10);
+    while (!run.done()) {
+        Time t = run.step();
+        generate_simulation_report(fb, report_b, t);
+    }
+
+    EXPECT_EQ(run.current_turn(), 10);
+    EXPECT_EQ(report_a.str(), report_b.str());
+    EXPECT_THROW(run.step(), std::logic_error);
+}
+
+TEST(SimulationRunTest, RunUntilStopsOnCondition) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+
+    SimulationRun run(factory, 100);
+    Time stop = run.run_until([](const Factory& f, Time) {
+        const auto& sh = *f.storehouse_cbegin();
+        return std::distance(sh.cbegin(), sh.cend()) >= 4;
+    });
+
+    EXPECT_EQ(stop, 4);
+    EXPECT_FALSE(run.done());
+
+    run.run_for(3);
+    EXPECT_EQ(run.current_turn(), 7);
+}
+
+TEST(SimulationRunTest, InconsistentFactoryThrows) {
+    Factory factory;
+    factory.add_ramp(Ramp(1, 1));
+    EXPECT_THROW(SimulationRun run(factory), std::logic_error);
+}
+
+// TESTY ZBIEŻNOŚCI
+
+TEST(ConvergenceTest, MserDetectsWarmup) {
+    BatchMeansEstimator estimator(1);
+    for (int i = 0; i < 20; ++i) {
+        estimator.add(100.0);
+    }
+    for (int i = 0; i < 80; ++i) {
+        estimator.add(i % 2 == 0 ? 1.0 : 3.0);
+    }
+
+    std::size_t warmup = estimator.warmup_batches();
+    EXPECT_EQ(warmup, 20u);
+    EXPECT_DOUBLE_EQ(estimator.mean(warmup), 2.0);
+}
+
+TEST(ConvergenceTest, StopsEarlyOnStableThroughput) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=2\n"
+        "WORKER id=1 processing-time=1 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+
+    ConvergenceOptions options;
+    options.batch_size = 10;
+    options.ci_width = 0.01;
+    options.max_turns = 100000;
+
+    ConvergenceResult result = simulate_until_converged(factory, options);
+
+    ASSERT_TRUE(result.converged);
+    EXPECT_LT(result.turns, 1000);
+    ASSERT_EQ(result.estimates.size(), 2u);
+    EXPECT_NEAR(result.estimates[0].mean, 0.5, 1e-9);
+    EXPECT_NEAR(result.estimates[1].mean, 0.0, 1e-9);
+}
+
+TEST(ConvergenceTest, StudentQuantileApproximation) {
+    EXPECT_NEAR(student_t_quantile(0.975, 1000.0), 1.962, 1e-2);
+    EXPECT_NEAR(student_t_quantile(0.975, 10.0), 2.228, 2e-2);
+}
+
+// TESTY RAPORTÓW
+
+TEST(ReportTest, StructureReportSortsReceivers) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=3\n"
+        "WORKER id=2 processing-time=1 queue-type=LIFO\n"
+        "WORKER id=1 processing-time=2 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-2\n"
+        "LINK src=ramp-1 dest=store-1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-2 dest=store-1\n"
+        "LINK src=worker-1 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+
+    std::ostringstream os;
+    generate_structure_report(factory, os);
+    EXPECT_EQ(os.str(),
+              "\n== LOADING RAMPS ==\n\n"
+              "LOADING RAMP #1\n  Delivery interval: 3\n  Receivers:\n"
+              "    storehouse #1\n    worker #1\n    worker #2\n\n"
+              "\n== WORKERS ==\n\n"
+              "WORKER #2\n  Processing time: 1\n  Queue type: LIFO\n  Receivers:\n    storehouse #1\n\n"
+              "WORKER #1\n  Processing time: 2\n  Queue type: FIFO\n  Receivers:\n    storehouse #1\n\n"
+              "\n== STOREHOUSES ==\n\n"
+              "STOREHOUSE #1\n");
+
+    factory.remove_worker(1);
+    std::ostringstream after;
+    generate_structure_report(factory, after);
+    EXPECT_EQ(after.str().find("worker #1"), std::string::npos);
+}
+
+TEST(ReportTest, SimulationReportFollowsStructureChanges) {
+    Factory factory;
+    factory.add_worker(Worker(2, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+    factory.add_storehouse(Storehouse(1));
+    factory.find_worker_by_id(2)->receive_package(Package(7));
+    factory.find_worker_by_id(2)->receive_package(Package(8));
+
+    std::ostringstream os;
+    generate_simulation_report(factory, os, 1);
+    EXPECT_EQ(os.str(),
+              "=== [ Turn: 1 ] ===\n\n== WORKERS == \n"
+              "WORKER #2\n  PBuffer: (empty)\n  Queue: #7, #8\n  SBuffer: (empty)\n\n"
+              "\n== STOREHOUSES == \n\n"
+              "STOREHOUSE #1\n  Stock: (empty)\n\n");
+
+    factory.add_worker(Worker(1, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+    std::ostringstream after;
+    generate_simulation_report(factory, after, 2);
+    EXPECT_LT(after.str().find("WORKER #1"), after.str().find("WORKER #2"));
+}
+
+// TESTY MIGAWEK W PAMIĘCI WSPÓŁDZIELONEJ
+
+TEST(SnapshotTest, PublishedStateIsReadable) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=2 processing-time=3 queue-type=FIFO\n"
+        "WORKER id=1 processing-time=1 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-2\n"
+        "LINK src=worker-2 dest=store-1\n"
+        "LINK src=worker-1 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+
+    const std::string name = "/netsim_test_" + std::to_string(getpid());
+    SnapshotPublisher publisher(name, factory, 2);
+    SnapshotReader reader(name);
+
+    FactorySnapshot snapshot;
+    EXPECT_FALSE(reader.read(snapshot));
+
+    simulate(factory, 5, [&publisher](Factory& f, TimeOffset t) {
+        publisher.publish_if_due(f, t);
+    });
+
+    ASSERT_TRUE(reader.read(snapshot));
+    EXPECT_EQ(snapshot.turn, 4);
+    ASSERT_EQ(snapshot.workers.size(), 2u);
+    EXPECT_EQ(snapshot.workers[0].id, 1);
+    EXPECT_EQ(snapshot.workers[1].id, 2);
+    EXPECT_EQ(snapshot.workers[1].busy, 1);
+    EXPECT_EQ(snapshot.workers[1].queue_length, 2u);
+    ASSERT_EQ(snapshot.storehouses.size(), 1u);
+    EXPECT_EQ(snapshot.storehouses[0].stock, 1u);
+    ASSERT_EQ(snapshot.ramps.size(), 1u);
+    EXPECT_EQ(snapshot.ramps[0].id, 1);
+    EXPECT_EQ(snapshot.ramps[0].blocked_turns, 0u);
+}
+
+// TESTY SYMULACJI PODZIELONEJ NA PROCESY
+
+TEST(PartitionTest, AssignsEveryNodeInFlowOrder) {
+    std::ifstream file("load_factory.txt");
+    ASSERT_TRUE(file.is_open());
+    Factory factory = load_factory_structure(file);
+
+    ShardAssignment assignment = partition_factory(factory, 2);
+    ASSERT_EQ(assignment.size(), 5u);
+    EXPECT_EQ(assignment.at({ElementType::RAMP, 1}), 0);
+    EXPECT_EQ(assignment.at({ElementType::RAMP, 2}), 0);
+    EXPECT_EQ(assignment.at({ElementType::STOREHOUSE, 1}), 1);
+}
+
+TEST(PartitionTest, MatchesSingleProcessRun) {
+    // Jeden proces: własny rejestr ID (jak świeży proces) i śledzenie co drugiej paczki
+    PackageIdAllocator ids;
+    std::ifstream file("load_factory.txt");
+    ASSERT_TRUE(file.is_open());
+    Factory single = load_factory_structure(file);
+    single.set_package_id_allocator(ids);
+    LineageTracer single_tracer(2);
+    single.set_lineage_tracer(&single_tracer);
+    single.seed_routing(7);
+    simulate(single, 40, [](Factory&, TimeOffset) {});
+    const FactorySnapshot expected = capture_snapshot(single, 40);
+    std::ostringstream expected_report;
+    generate_simulation_report(single, expected_report, 40);
+    std::ostringstream expected_routes;
+    single_tracer.export_routes(expected_routes);
+    ASSERT_GT(single_tracer.traced_count(), 10u);
+
+    // Pełny stan, raport z ID paczek i trasy - przy każdej liczbie shardów (5 - węzeł na shard)
+    for (int shards = 1; shards <= 5; ++shards) {
+        std::ifstream again("load_factory.txt");
+        Factory factory = load_factory_structure(again);
+        LineageTracer tracer(2);
+        factory.set_lineage_tracer(&tracer);
+        PartitionedRun partitioned = simulate_partitioned(factory, 40, partition_factory(factory, shards), 7);
+        EXPECT_EQ(partitioned.snapshot.turn, 40);
+        EXPECT_EQ(partitioned.snapshot.workers, expected.workers) << shards << " shards";
+        EXPECT_EQ(partitioned.snapshot.storehouses, expected.storehouses) << shards << " shards";
+        EXPECT_EQ(partitioned.snapshot.ramps, expected.ramps) << shards << " shards";
+        EXPECT_EQ(partitioned.report, expected_report.str()) << shards << " shards";
+
+        std::ostringstream routes;
+        tracer.export_routes(routes);
+        EXPECT_EQ(routes.str(), expected_routes.str()) << shards << " shards";
+        EXPECT_EQ(tracer.traced_count(), single_tracer.traced_count());
+        EXPECT_EQ(factory.storehouse_cbegin()->size(), 0u);   // fabryka wywołującego bez zmian
+    }
+}
+
+TEST(PartitionTest, StructureStreamMatchesFactoryRun) {
+    std::ifstream file("load_factory.txt");
+    ASSERT_TRUE(file.is_open());
+    Factory factory = load_factory_structure(file);
+
+    for (int shards = 1; shards <= 5; ++shards) {
+        std::ifstream structure("load_factory.txt");
+        const ShardAssignment assignment = partition_structure(structure, shards);
+        EXPECT_EQ(assignment, partition_factory(factory, shards)) << shards << " shards";
+
+        LineageTracer expected_tracer(2);
+        factory.set_lineage_tracer(&expected_tracer);
+        PartitionedRun expected = simulate_partitioned(factory, 40, assignment, 7);
+        factory.set_lineage_tracer(nullptr);
+
+        LineageTracer tracer(2);
+        std::ifstream again("load_factory.txt");
+        PartitionedRun streamed = simulate_partitioned(again, 40, assignment, 7, &tracer);
+        EXPECT_EQ(streamed.snapshot.workers, expected.snapshot.workers) << shards << " shards";
+        EXPECT_EQ(streamed.snapshot.storehouses, expected.snapshot.storehouses) << shards << " shards";
+        EXPECT_EQ(streamed.snapshot.ramps, expected.snapshot.ramps) << shards << " shards";
+        EXPECT_EQ(streamed.report, expected.report) << shards << " shards";
+
+        std::ostringstream expected_routes;
+        std::ostringstream routes;
+        expected_tracer.export_routes(expected_routes);
+        tracer.export_routes(routes);
+        EXPECT_EQ(routes.str(), expected_routes.str()) << shards << " shards";
+    }
+}
+
+TEST(PartitionTest, StructureStreamIsValidated) {
+    std::istringstream structure(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=1 processing-time=1 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n");
+    const ShardAssignment assignment = partition_structure(structure, 2);
+    EXPECT_EQ(assignment.size(), 3u);
+
+    structure.clear();
+    structure.seekg(0);
+    EXPECT_THROW(simulate_partitioned(structure, 5, assignment, 1), std::logic_error);   // robotnik bez odbiorców
+
+    std::istringstream undefined("LOADING_RAMP id=1 delivery-interval=1\nLINK src=ramp-1 dest=store-1\n");
+    EXPECT_THROW(partition_structure(undefined, 1), std::logic_error);
+}
+
+TEST(PartitionTest, RunsWhileOtherThreadsExistAndReportsMissingShardBinary) {
+    std::ifstream file("load_factory.txt");
+    Factory factory = load_factory_structure(file);
+    const ShardAssignment assignment = partition_factory(factory, 3);
+    const PartitionedRun expected = simulate_partitioned(factory, 20, assignment, 3);
+
+    // Shardy startują przez exec(), więc wątek trzymający mutex w rodzicu im nie przeszkadza
+    std::mutex busy;
+    std::unique_lock<std::mutex> hold(busy);
+    std::thread other([&busy] { std::lock_guard<std::mutex> wait(busy); });
+    EXPECT_EQ(simulate_partitioned(factory, 20, assignment, 3).report, expected.report);
+    hold.unlock();
+    other.join();
+
+    setenv("NETSIM_SHARD", "/nonexistent/netsim_shard", 1);
+    EXPECT_THROW(simulate_partitioned(factory, 20, assignment, 3), std::runtime_error);
+    unsetenv("NETSIM_SHARD");
+}
+
+// TESTY PORZĄDKOWANIA WĘZŁÓW
+
+TEST(LocalityTest, ReorderFollowsFlowAndKeepsLinks) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=3 processing-time=1 queue-type=FIFO\n"
+        "STOREHOUSE id=2\n"
+        "WORKER id=2 processing-time=1 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "WORKER id=1 processing-time=1 queue-type=LIFO\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=worker-2\n"
+        "LINK src=worker-2 dest=worker-3\n"
+        "LINK src=worker-2 dest=worker-2\n"
+        "LINK src=worker-3 dest=store-1\n"
+        "LINK src=worker-3 dest=store-2\n");
+    LoadOptions options;
+    options.reorder_for_locality = true;
+    Factory factory = load_factory_structure(iss, options);
+
+    std::vector<ElementID> worker_ids;
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        worker_ids.push_back(it->get_id());
+    }
+    EXPECT_EQ(worker_ids, (std::vector<ElementID>{1, 2, 3}));
+    EXPECT_EQ(factory.find_worker_by_id(1)->get_queue()->get_queue_type(), PackageQueueType::LIFO);
+
+    const auto& prefs = factory.find_worker_by_id(2)->receiver_preferences_.get_preferences();
+    ASSERT_EQ(prefs.size(), 2u);
+    EXPECT_EQ(prefs.count(&*factory.find_worker_by_id(2)), 1u);
+    EXPECT_EQ(prefs.count(&*factory.find_worker_by_id(3)), 1u);
+    EXPECT_DOUBLE_EQ(prefs.begin()->second, 0.5);
+    EXPECT_TRUE(factory.is_consistent());
+
+    LocalityReport again = factory.reorder_for_locality();
+    EXPECT_EQ(again.links, 6u);
+    EXPECT_DOUBLE_EQ(again.mean_distance_before, again.mean_distance_after);
+    EXPECT_DOUBLE_EQ(again.forward_links_after, 5.0 / 6.0);
+
+    simulate(factory, 10, [](Factory&, TimeOffset) {});
+    std::size_t stock = 0;
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        stock += it->size();
+    }
+    EXPECT_GT(stock, 0u);
+}
+
+TEST(LocalityTest, ReorderShortensLinks) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=4 processing-time=1 queue-type=FIFO\n"
+        "WORKER id=3 processing-time=1 queue-type=FIFO\n"
+        "WORKER id=2 processing-time=1 queue-type=FIFO\n"
+        "WORKER id=1 processing-time=1 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=worker-2\n"
+        "LINK src=worker-2 dest=worker-3\n"
+        "LINK src=worker-3 dest=worker-4\n"
+        "LINK src=worker-4 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+
+    LocalityReport report = factory.reorder_for_locality();
+    EXPECT_LT(report.mean_distance_after, report.mean_distance_before);
+    EXPECT_DOUBLE_EQ(report.forward_links_after, 1.0);
+
+    std::ostringstream os;
+    generate_locality_report(report, os);
+    EXPECT_NE(os.str().find("Links: 5"), std::string::npos);
+}
+
+// TESTY ZAPISU I ODTWARZANIA ROUTINGU
+
+TEST(RoutingLogTest, PacksAndUnpacksBits) {
+    RoutingLog log;
+    log.write(5, 3);
+    log.write(1, 1);
+    log.write(0x12345, 20);
+    for (int i = 0; i < 30; ++i) {
+        log.write(static_cast<std::uint32_t>(i % 4), 2);
+    }
+    EXPECT_EQ(log.bit_count(), 84u);
+    EXPECT_EQ(log.byte_size(), 11u);
+
+    std::uint64_t cursor = 0;
+    EXPECT_EQ(log.read(cursor, 3), 5u);
+    EXPECT_EQ(log.read(cursor, 1), 1u);
+    EXPECT_EQ(log.read(cursor, 20), 0x12345u);
+    for (int i = 0; i < 30; ++i) {
+        EXPECT_EQ(log.read(cursor, 2), static_cast<std::uint32_t>(i % 4));
+    }
+    EXPECT_THROW(log.read(cursor, 1), std::runtime_error);
+}
+
+TEST(RoutingLogTest, ReplayReproducesRun) {
+    std::ostringstream recorded;
+    std::stringstream saved;
+    {
+        std::ifstream file("load_factory.txt");
+        ASSERT_TRUE(file.is_open());
+        Factory factory = load_factory_structure(file);
+        RoutingLog log = record_simulation(factory, 30, [&recorded](Factory& f, TimeOffset t) {
+            generate_simulation_report(f, recorded, t);
+        });
+        log.save(saved);
+    }
+
+    RoutingLog log = RoutingLog::load(saved);
+    EXPECT_EQ(log.turns(), 30);
+
+    std::ifstream file("load_factory.txt");
+    ASSERT_TRUE(file.is_open());
+    Factory factory = load_factory_structure(file);
+    // Inny generator nie może mieć wpływu na odtworzenie
+    factory.seed_routing(12345);
+    std::ostringstream replayed;
+    replay_simulation(factory, log, [&replayed](Factory& f, TimeOffset t) {
+        generate_simulation_report(f, replayed, t);
+    });
+    EXPECT_EQ(recorded.str(), replayed.str());
+}
+
+TEST(RoutingLogTest, RejectsDifferentStructure) {
+    RoutingLog log;
+    {
+        std::ifstream file("load_factory.txt");
+        Factory factory = load_factory_structure(file);
+        log = record_simulation(factory, 5, nullptr);
+    }
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=store-1\n");
+    Factory other = load_factory_structure(iss);
+    EXPECT_THROW(replay_simulation(other, log, nullptr), std::runtime_error);
+
+    // Te same węzły i łącza, inny czas przetwarzania - decyzje zapadałyby w innych turach
+    std::ifstream file("load_factory.txt");
+    Factory slower = load_factory_structure(file);
+    slower.worker_begin()->set_processing_duration(slower.worker_begin()->get_processing_duration() + 1);
+    EXPECT_NE(routing_structure_hash(slower), log.structure_hash());
+    EXPECT_THROW(replay_simulation(slower, log, nullptr), std::runtime_error);
+}
+
+// TESTY HURTOWEGO DODAWANIA POŁĄCZEŃ
+
+TEST(ReceiverPreferencesTest, BulkAddAndRemove) {
+    std::vector<Storehouse> storehouses;
+    for (int i = 1; i <= 8; ++i) {
+        storehouses.emplace_back(i);
+    }
+    std::vector<IPackageReceiver*> receivers;
+    for (auto& sh : storehouses) {
+        receivers.push_back(&sh);
+    }
+
+    ReceiverPreferences rp;
+    rp.add_receivers(receivers);
+    ASSERT_EQ(rp.get_preferences().size(), 8u);
+    for (const auto& [receiver, prob] : rp) {
+        EXPECT_DOUBLE_EQ(prob, 1.0 / 8.0);
+    }
+
+    rp.remove_receivers(receivers.begin(), receivers.begin() + 4);
+    ASSERT_EQ(rp.get_preferences().size(), 4u);
+    EXPECT_DOUBLE_EQ(rp.get_preferences().at(receivers[7]), 0.25);
+}
+
+TEST(FactoryIOTest, LoaderAddsLinksInBulk) {
+    std::ostringstream structure;
+    structure << "LOADING_RAMP id=1 delivery-interval=1\n";
+    for (int i = 1; i <= 50; ++i) {
+        structure << "STOREHOUSE id=" << i << "\n";
+    }
+    for (int i = 1; i <= 50; ++i) {
+        structure << "LINK src=ramp-1 dest=store-" << i << "\n";
+    }
+    std::istringstream iss(structure.str());
+    Factory factory = load_factory_structure(iss);
+
+    const auto& prefs = factory.ramp_cbegin()->receiver_preferences_.get_preferences();
+    ASSERT_EQ(prefs.size(), 50u);
+    for (const auto& [receiver, prob] : prefs) {
+        EXPECT_DOUBLE_EQ(prob, 1.0 / 50.0);
+    }
+
+    std::istringstream bad("LOADING_RAMP id=1 delivery-interval=1\nLINK src=ramp-1 dest=store-9\n");
+    EXPECT_THROW(load_factory_structure(bad), std::logic_error);
+}
+
+// TESTY OGRANICZONYCH KOLEJEK
+
+TEST(BoundedQueueTest, FullQueueBlocksSenders) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=1 processing-time=3 queue-type=FIFO queue-capacity=1\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+    const Worker& worker = *factory.find_worker_by_id(1);
+    const Ramp& ramp = *factory.ramp_cbegin();
+    EXPECT_EQ(worker.get_queue_capacity(), 1u);
+
+    std::size_t max_queue = 0;
+    simulate(factory, 30, [&max_queue](Factory& f, TimeOffset) {
+        max_queue = std::max(max_queue, f.find_worker_by_id(1)->get_queue()->size());
+    });
+
+    EXPECT_EQ(max_queue, 1u);
+    EXPECT_GT(ramp.get_blocked_turns(), 0u);
+    EXPECT_EQ(worker.get_blocked_turns(), 0u);
+    // Co 3 tury jedna paczka opuszcza robotnika
+    EXPECT_GE(factory.storehouse_cbegin()->size(), 8u);
+
+    std::ostringstream saved;
+    save_factory_structure(factory, saved);
+    EXPECT_NE(saved.str().find("queue-capacity=1"), std::string::npos);
+}
+
+TEST(BoundedQueueTest, BlockedChainKeepsEveryPackage) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=1 processing-time=1 queue-type=FIFO\n"
+        "WORKER id=2 processing-time=5 queue-type=FIFO queue-capacity=1\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=worker-2\n"
+        "LINK src=worker-2 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+
+    std::size_t delivered = 0;
+    std::size_t held = 0;
+    simulate(factory, 30, [&](Factory& f, TimeOffset) {
+        const Ramp& ramp = *f.ramp_cbegin();
+        delivered = ramp.get_delivered_count();
+        held = ramp.get_sending_buffer() ? 1 : 0;
+        for (auto it = f.worker_cbegin(); it != f.worker_cend(); ++it) {
+            held += it->get_queue()->size() + (it->get_processing_buffer() ? 1 : 0)
+                    + (it->get_sending_buffer() ? 1 : 0);
+        }
+        for (auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) {
+            held += it->size();
+        }
+        ASSERT_EQ(held, delivered);
+    });
+
+    // Zablokowany robotnik 1 przestaje przetwarzać, więc paczki czekają w jego kolejce
+    EXPECT_EQ(delivered, 30u);
+    EXPECT_GT(factory.find_worker_by_id(1)->get_blocked_turns(), 0u);
+    EXPECT_GT(factory.find_worker_by_id(1)->get_queue()->size(), 20u);
+}
+
+TEST(BoundedQueueTest, SenderWaitsForFullReceiver) {
+    Worker w(1, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO), 1);
+    Worker upstream(2, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO));
+    upstream.receiver_preferences_.add_receiver(&w);
+
+    w.receive_package(Package(1));
+    upstream.receive_package(Package(2));
+    upstream.do_work(1);
+    upstream.send_package();
+
+    EXPECT_TRUE(upstream.get_sending_buffer().has_value());
+    EXPECT_EQ(upstream.get_blocked_turns(), 1u);
+
+    w.do_work(2);
+    upstream.send_package();
+    EXPECT_FALSE(upstream.get_sending_buffer().has_value());
+    EXPECT_EQ(upstream.get_blocked_turns(), 1u);
+}
+
+TEST(BoundedQueueTest, BlockedTurnsInReport) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "LOADING_RAMP id=2 delivery-interval=5\n"
+        "WORKER id=1 processing-time=3 queue-type=FIFO queue-capacity=1\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=ramp-2 dest=store-1\n"
+        "LINK src=worker-1 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+    std::ostringstream report;
+    simulate(factory, 6, [&report](Factory& f, TimeOffset t) {
+        if (t == 6) {
+            generate_simulation_report(f, report, t);
+        }
+    });
+
+    const Ramp& ramp = *factory.ramp_cbegin();
+    ASSERT_GT(ramp.get_blocked_turns(), 0u);
+    const std::string text = report.str();
+    EXPECT_NE(text.find("\n== LOADING RAMPS == \nLOADING_RAMP #1\n  Blocked turns: " +
+                        std::to_string(ramp.get_blocked_turns()) + "\n\nLOADING_RAMP #2\n  Blocked turns: 0\n"),
+              std::string::npos);
+    EXPECT_LT(text.find("== LOADING RAMPS =="), text.find("== WORKERS =="));
+
+    FactorySnapshot snapshot = capture_snapshot(factory, 6);
+    ASSERT_EQ(snapshot.ramps.size(), 2u);
+    EXPECT_EQ(snapshot.ramps[0].id, 1);
+    EXPECT_EQ(snapshot.ramps[0].loaded, 1);
+    EXPECT_EQ(snapshot.ramps[0].blocked_turns, ramp.get_blocked_turns());
+    EXPECT_EQ(snapshot.ramps[1].blocked_turns, 0u);
+
+    MetricsExporter exporter("unix:netsim_ramp_metrics_test.sock", factory);
+    EXPECT_NE(exporter.render().find("netsim_ramp_blocked_turns{ramp=\"1\"} " +
+                                     std::to_string(ramp.get_blocked_turns()) + "\n"),
+              std::string::npos);
+}
+
+// TESTY ANALIZY PRZEPŁYWÓW
+
+TEST(FlowAnalysisTest, FindsBottleneckWithSelfLink) {
+    std::ifstream file("load_factory.txt");
+    ASSERT_TRUE(file.is_open());
+    Factory factory = load_factory_structure(file);
+
+    FlowAnalysis analysis = analyze_flow(factory);
+    ASSERT_TRUE(analysis.converged);
+    ASSERT_EQ(analysis.workers.size(), 2u);
+
+    // Robotnik 1: 1/3 + 1/4 z ramp + połowa własnej wydajności (0.5) z pętli
+    EXPECT_NEAR(analysis.workers[0].arrival_rate, 7.0 / 12.0 + 0.25, 1e-9);
+    EXPECT_TRUE(analysis.workers[0].unstable);
+    EXPECT_NEAR(analysis.workers[1].arrival_rate, 0.5, 1e-9);
+    EXPECT_NEAR(analysis.workers[1].utilization, 0.5, 1e-9);
+    EXPECT_FALSE(analysis.workers[1].unstable);
+    ASSERT_EQ(analysis.storehouses.size(), 1u);
+    EXPECT_NEAR(analysis.storehouses[0].arrival_rate, 0.5, 1e-9);
+
+    std::ostringstream os;
+    generate_flow_report(analysis, os);
+    EXPECT_NE(os.str().find("Bottleneck: worker #1"), std::string::npos);
+}
+
+TEST(FlowAnalysisTest, SolvesCycleBetweenWorkers) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=10\n"
+        "WORKER id=1 processing-time=1 queue-type=FIFO\n"
+        "WORKER id=2 processing-time=1 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=worker-2\n"
+        "LINK src=worker-2 dest=worker-1\n"
+        "LINK src=worker-2 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+
+    FlowAnalysis analysis = analyze_flow(factory);
+    ASSERT_TRUE(analysis.converged);
+    // lambda1 = 0.1 + 0.5 lambda2, lambda2 = lambda1 -> lambda = 0.2
+    EXPECT_NEAR(analysis.workers[0].arrival_rate, 0.2, 1e-8);
+    EXPECT_NEAR(analysis.workers[1].arrival_rate, 0.2, 1e-8);
+    EXPECT_NEAR(analysis.storehouses[0].arrival_rate, 0.1, 1e-8);
+}
+
+// TESTY ZBIORU AKTYWNYCH ROBOTNIKÓW
+
+TEST(ActiveWorkersTest, MatchesFullScan) {
+    // Każdy nadawca ma jednego odbiorcę - wynik nie zależy od losowania
+    const std::string structure =
+        "LOADING_RAMP id=1 delivery-interval=3\n"
+        "LOADING_RAMP id=2 delivery-interval=7\n"
+        "WORKER id=1 processing-time=2 queue-type=FIFO\n"
+        "WORKER id=2 processing-time=4 queue-type=LIFO\n"
+        "WORKER id=3 processing-time=1 queue-type=FIFO\n"
+        "WORKER id=4 processing-time=3 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=ramp-2 dest=worker-4\n"
+        "LINK src=worker-1 dest=worker-2\n"
+        "LINK src=worker-2 dest=store-1\n"
+        "LINK src=worker-3 dest=store-1\n"
+        "LINK src=worker-4 dest=worker-2\n";
+
+    std::ostringstream full_scan;
+    {
+        std::istringstream iss(structure);
+        Factory factory = load_factory_structure(iss);
+        for (Time t = 1; t <= 40; ++t) {
+            factory.do_deliveries(t);
+            for (auto it = factory.ramp_begin(); it != factory.ramp_end(); ++it) {
+                it->send_package();
+            }
+            for (auto it = factory.worker_begin(); it != factory.worker_end(); ++it) {
+                it->send_package();
+            }
+            for (auto it = factory.worker_begin(); it != factory.worker_end(); ++it) {
+                it->do_work(t);
+            }
+            generate_simulation_report(factory, full_scan, t);
+        }
+    }
+
+    std::istringstream iss(structure);
+    Factory factory = load_factory_structure(iss);
+    std::ostringstream active_only;
+    for (Time t = 1; t <= 40; ++t) {
+        factory.do_deliveries(t);
+        factory.do_package_passing();
+        factory.do_work(t);
+        generate_simulation_report(factory, active_only, t);
+    }
+    EXPECT_EQ(full_scan.str(), active_only.str());
+}
+
+TEST(ActiveWorkersTest, IdleWorkersLeaveTheSet) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=100\n"
+        "WORKER id=1 processing-time=2 queue-type=FIFO\n"
+        "WORKER id=2 processing-time=1 queue-type=FIFO\n"
+        "WORKER id=3 processing-time=1 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=worker-2\n"
+        "LINK src=worker-2 dest=store-1\n"
+        "LINK src=worker-3 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+    SimulationRun run(factory, 100);
+
+    run.step();
+    EXPECT_EQ(factory.active_worker_count(), 1u);
+    run.run_for(2);
+    EXPECT_EQ(factory.active_worker_count(), 1u);
+    run.run_for(2);
+    EXPECT_EQ(factory.active_worker_count(), 0u);
+    EXPECT_EQ(factory.storehouse_cbegin()->size(), 1u);
+
+    // Paczka podana z zewnątrz budzi robotnika
+    factory.find_worker_by_id(3)->receive_package(Package());
+    EXPECT_EQ(factory.active_worker_count(), 1u);
+    run.run_for(2);
+    EXPECT_EQ(factory.storehouse_cbegin()->size(), 2u);
+    EXPECT_EQ(factory.active_worker_count(), 0u);
+}
+
+// TESTY ŚLEDZENIA TRAS PACZEK
+
+namespace {
+
+const char* LINEAGE_STRUCTURE =
+    "LOADING_RAMP id=1 delivery-interval=1\n"
+    "WORKER id=1 processing-time=2 queue-type=FIFO\n"
+    "STOREHOUSE id=1\n"
+    "LINK src=ramp-1 dest=worker-1\n"
+    "LINK src=worker-1 dest=store-1\n";
+
+}
+
+TEST(LineageTest, RecordsRouteOfSampledPackages) {
+    std::istringstream iss(LINEAGE_STRUCTURE);
+    Factory factory = load_factory_structure(iss);
+    LineageTracer tracer(3);
+    factory.set_lineage_tracer(&tracer);
+    simulate(factory, 6, [](Factory&, TimeOffset) {});
+
+    EXPECT_EQ(tracer.traced_count(), 2u);
+    std::size_t traced = 0;
+    for (auto it = factory.storehouse_cbegin()->cbegin(); it != factory.storehouse_cbegin()->cend(); ++it) {
+        traced += tracer.trace_id(*it) != 0;
+    }
+    EXPECT_EQ(traced, 1u);
+
+    std::ostringstream oss;
+    tracer.export_routes(oss);
+    const std::string expected_prefix =
+        "trace,package,turn,event,node\n"
+        "1,1,1,created,ramp-1\n"
+        "1,1,1,sent,ramp-1\n"
+        "1,1,1,enqueued,worker-1\n"
+        "1,1,1,started,worker-1\n"
+        "1,1,3,sent,worker-1\n"
+        "1,1,3,stored,store-1\n"
+        "2,4,4,created,ramp-1\n";
+    EXPECT_EQ(oss.str().substr(0, expected_prefix.size()), expected_prefix);
+}
+
+TEST(LineageTest, ExportWritesOnlyRecordsSincePreviousExport) {
+    std::istringstream iss(LINEAGE_STRUCTURE);
+    Factory factory = load_factory_structure(iss);
+    LineageTracer tracer(3);
+    factory.set_lineage_tracer(&tracer);
+    simulate(factory, 3, [](Factory&, TimeOffset) {});
+
+    std::ostringstream first;
+    tracer.export_routes(first);
+    EXPECT_NE(first.str().find("1,1,3,stored,store-1\n"), std::string::npos);
+
+    std::ostringstream empty;
+    tracer.export_routes(empty);
+    EXPECT_EQ(empty.str(), "trace,package,turn,event,node\n");
+}
+
+TEST(LineageTest, FullRingDropsRecords) {
+    std::istringstream iss(LINEAGE_STRUCTURE);
+    Factory factory = load_factory_structure(iss);
+    LineageTracer tracer(1, 4);
+    factory.set_lineage_tracer(&tracer);
+    simulate(factory, 3, [](Factory&, TimeOffset) {});
+
+    std::vector<LineageRecord> records;
+    EXPECT_EQ(tracer.drain(records), 4u);
+    EXPECT_GT(tracer.dropped_count(), 0u);
+    EXPECT_EQ(records.front().event, LineageEvent::CREATED);
+}
+
+// TESTY ZMIAN STRUKTURY W TRAKCIE SYMULACJI
+
+namespace {
+
+std::size_t packages_held(const Worker& w) {
+    return w.get_queue()->size() + w.get_processing_buffer().has_value() + w.get_sending_buffer().has_value();
+}
+
+StructureDiff parse_diff(const std::string& text) {
+    std::istringstream iss(text);
+    return load_structure_diff(iss);
+}
+
+}
+
+TEST(StructureDiffTest, AppliesBetweenTurnsKeepingQueues) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=1 processing-time=3 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+    SimulationRun run(factory, 40);
+    run.run_for(6);
+    std::size_t queued = factory.find_worker_by_id(1)->get_queue()->size();
+    ASSERT_GT(queued, 0u);
+
+    DiffResult result = apply_structure_diff(factory, parse_diff(
+        "ADD WORKER id=2 processing-time=1 queue-type=FIFO\n"
+        "ADD LINK src=worker-2 dest=store-1\n"
+        "ADD LINK src=ramp-1 dest=worker-2\n"
+        "REMOVE LINK src=ramp-1 dest=worker-1\n"
+        "SET WORKER id=1 processing-time=1\n"));
+    EXPECT_EQ(result.operations, 5u);
+    EXPECT_EQ(result.checked_senders, 2u);
+    EXPECT_EQ(factory.find_worker_by_id(1)->get_queue()->size(), queued);
+    EXPECT_TRUE(factory.is_consistent());
+
+    run.run_for(20);
+    EXPECT_EQ(packages_held(*factory.find_worker_by_id(1)), 0u);
+    EXPECT_EQ(factory.find_ramp_by_id(1)->receiver_preferences_.get_preferences().size(), 1u);
+}
+
+TEST(StructureDiffTest, ReroutesOrDrainsPackagesOfRemovedWorker) {
+    const std::string structure =
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=1 processing-time=3 queue-type=FIFO\n"
+        "WORKER id=2 processing-time=1 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=worker-2\n"
+        "LINK src=worker-2 dest=store-1\n";
+    const std::string diff =
+        "ADD LINK src=ramp-1 dest=worker-2\n"
+        "REMOVE WORKER id=1\n";
+
+    for (auto policy : {RemovedPackagePolicy::REROUTE, RemovedPackagePolicy::DRAIN}) {
+        std::istringstream iss(structure);
+        Factory factory = load_factory_structure(iss);
+        SimulationRun run(factory, 10);
+        run.run_for(5);
+        std::size_t held = packages_held(*factory.find_worker_by_id(1));
+        std::size_t before = packages_held(*factory.find_worker_by_id(2));
+
+        DiffResult result = apply_structure_diff(factory, parse_diff(diff), policy);
+        EXPECT_EQ(factory.find_worker_by_id(1), factory.worker_end());
+        if (policy == RemovedPackagePolicy::REROUTE) {
+            EXPECT_EQ(result.rerouted, held);
+            EXPECT_EQ(packages_held(*factory.find_worker_by_id(2)), before + held);
+        } else {
+            EXPECT_EQ(result.drained, held);
+            EXPECT_EQ(packages_held(*factory.find_worker_by_id(2)), before);
+        }
+        run.run_for(5);
+        EXPECT_TRUE(factory.is_consistent());
+    }
+}
+
+TEST(StructureDiffTest, ReroutingRespectsQueueCapacity) {
+    const std::string structure =
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=1 processing-time=10 queue-type=FIFO\n"
+        "WORKER id=2 processing-time=10 queue-type=FIFO queue-capacity=2\n"
+        "WORKER id=3 processing-time=10 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=worker-2\n"
+        "LINK src=worker-1 dest=worker-3\n"
+        "LINK src=worker-2 dest=store-1\n"
+        "LINK src=worker-3 dest=store-1\n";
+    std::istringstream iss(structure);
+    Factory factory = load_factory_structure(iss);
+    SimulationRun run(factory, 20);
+    run.run_for(8);
+    const std::size_t held = packages_held(*factory.find_worker_by_id(1));
+    ASSERT_EQ(held, 8u);
+
+    // Robotnik 2 przyjmie najwyżej 2 paczki, reszta trafia do robotnika 3
+    DiffResult result = apply_structure_diff(factory, parse_diff(
+        "ADD LINK src=ramp-1 dest=worker-3\n"
+        "REMOVE WORKER id=1\n"));
+    EXPECT_EQ(result.rerouted, held);
+    EXPECT_EQ(factory.find_worker_by_id(2)->get_queue()->size(), 2u);
+    EXPECT_EQ(factory.find_worker_by_id(3)->get_queue()->size(), held - 2);
+
+    // Bez robotnika 3 paczki się nie mieszczą - zmiana odrzucona, fabryka nietknięta
+    std::istringstream again(structure + "LINK src=ramp-1 dest=worker-2\n");
+    Factory bounded = load_factory_structure(again);
+    SimulationRun bounded_run(bounded, 20);
+    bounded_run.run_for(8);
+    const std::size_t before = packages_held(*bounded.find_worker_by_id(1));
+    EXPECT_THROW(apply_structure_diff(bounded, parse_diff(
+                     "REMOVE LINK src=worker-1 dest=worker-3\n"
+                     "REMOVE WORKER id=1\n")),
+                 std::logic_error);
+    EXPECT_EQ(packages_held(*bounded.find_worker_by_id(1)), before);
+    EXPECT_EQ(bounded.find_worker_by_id(1)->receiver_preferences_.get_preferences().size(), 2u);
+}
+
+TEST(StructureDiffTest, InconsistentDiffLeavesFactoryUntouched) {
+    std::ifstream file("load_factory.txt");
+    Factory factory = load_factory_structure(file);
+    std::ostringstream before;
+    generate_structure_report(factory, before);
+
+    EXPECT_THROW(apply_structure_diff(factory, parse_diff(
+                     "ADD STOREHOUSE id=2\n"
+                     "REMOVE LINK src=worker-2 dest=store-1\n")),
+                 std::logic_error);
+    EXPECT_THROW(apply_structure_diff(factory, parse_diff("SET WORKER id=1 queue-type=FIFO\n")), std::logic_error);
+    EXPECT_THROW(apply_structure_diff(factory, parse_diff("REMOVE WORKER id=9\n")), std::logic_error);
+    EXPECT_THROW(apply_structure_diff(factory, parse_diff("SET LOADING_RAMP id=1 delivery-interval=0\n")),
+                 std::logic_error);
+    EXPECT_THROW(apply_structure_diff(factory, parse_diff(
+                     "ADD LOADING_RAMP id=7 delivery-interval=0\n"
+                     "ADD LINK src=ramp-7 dest=store-1\n")),
+                 std::logic_error);
+    EXPECT_THROW(apply_structure_diff(factory, parse_diff("SET WORKER id=1 processing-time=0\n")), std::logic_error);
+    EXPECT_THROW(apply_structure_diff(factory, parse_diff("SET WORKER id=1 queue-capacity=-1\n")), std::logic_error);
+    EXPECT_THROW(apply_structure_diff(factory, parse_diff(
+                     "ADD WORKER id=7 processing-time=-2 queue-type=FIFO\n"
+                     "ADD LINK src=worker-7 dest=store-1\n")),
+                 std::logic_error);
+    EXPECT_THROW(apply_structure_diff(factory, parse_diff(
+                     "ADD WORKER id=7 processing-time=1 queue-type=FIFO queue-capacity=-1\n"
+                     "ADD LINK src=worker-7 dest=store-1\n")),
+                 std::logic_error);
+
+    std::ostringstream after;
+    generate_structure_report(factory, after);
+    EXPECT_EQ(before.str(), after.str());
+}
+
+// TESTY BINARNEGO FORMATU STRUKTURY
+
+namespace {
+
+// Połączenia nadawcy jako (typ odbiorcy, ID, prawdopodobieństwo) w kolejności ReceiverOrder
+std::vector<std::tuple<ReceiverType, ElementID, double>> links_of(const PackageSender& sender) {
+    std::vector<std::tuple<ReceiverType, ElementID, double>> links;
+    for (const auto& [receiver, probability] : sender.receiver_preferences_.get_preferences()) {
+        links.emplace_back(receiver->get_receiver_type(), receiver->get_id(), probability);
+    }
+    return links;
+}
+
+void expect_same_structure(const Factory& expected, const Factory& actual) {
+    ASSERT_EQ(std::distance(expected.ramp_cbegin(), expected.ramp_cend()),
+              std::distance(actual.ramp_cbegin(), actual.ramp_cend()));
+    for (auto e = expected.ramp_cbegin(), a = actual.ramp_cbegin(); e != expected.ramp_cend(); ++e, ++a) {
+        EXPECT_EQ(e->get_id(), a->get_id());
+        EXPECT_EQ(e->get_delivery_interval(), a->get_delivery_interval());
+        EXPECT_EQ(links_of(*e), links_of(*a));
+    }
+    ASSERT_EQ(std::distance(expected.worker_cbegin(), expected.worker_cend()),
+              std::distance(actual.worker_cbegin(), actual.worker_cend()));
+    for (auto e = expected.worker_cbegin(), a = actual.worker_cbegin(); e != expected.worker_cend(); ++e, ++a) {
+        EXPECT_EQ(e->get_id(), a->get_id());
+        EXPECT_EQ(e->get_processing_duration(), a->get_processing_duration());
+        EXPECT_EQ(e->get_queue()->get_queue_type(), a->get_queue()->get_queue_type());
+        EXPECT_EQ(e->get_queue_capacity(), a->get_queue_capacity());
+        EXPECT_EQ(links_of(*e), links_of(*a));
+    }
+    ASSERT_EQ(std::distance(expected.storehouse_cbegin(), expected.storehouse_cend()),
+              std::distance(actual.storehouse_cbegin(), actual.storehouse_cend()));
+    for (auto e = expected.storehouse_cbegin(), a = actual.storehouse_cbegin(); e != expected.storehouse_cend();
+         ++e, ++a) {
+        EXPECT_EQ(e->get_id(), a->get_id());
+    }
+}
+
+}
+
+TEST(BinaryStructureTest, RoundTripsThroughBinaryFormat) {
+    std::ifstream file("load_factory.txt");
+    Factory original = load_factory_structure(file);
+
+    // Nierówne prawdopodobieństwa - format tekstowy ich nie zapisuje, binarny tak
+    Worker& first = *original.worker_begin();
+    std::vector<std::pair<IPackageReceiver*, double>> weighted;
+    double weight = 0.75;
+    for (IPackageReceiver* receiver : first.receiver_preferences_.sorted_receivers()) {
+        weighted.emplace_back(receiver, weight);
+        weight = 0.25 / static_cast<double>(first.receiver_preferences_.get_preferences().size() - 1);
+    }
+    ASSERT_GT(weighted.size(), 1u);
+    first.receiver_preferences_.set_receivers(weighted);
+
+    std::stringstream binary;
+    save_factory_structure(original, binary, StructureFormat::BINARY);
+    const std::string bytes = binary.str();
+    ASSERT_TRUE(is_binary_structure(bytes.data(), bytes.size()));
+
+    // load_factory_structure rozpoznaje format sam
+    Factory loaded = load_factory_structure(binary);
+    expect_same_structure(original, loaded);
+    EXPECT_DOUBLE_EQ(std::get<2>(links_of(*loaded.worker_cbegin()).front()), 0.75);
+    EXPECT_TRUE(loaded.is_consistent());
+
+    const std::string path = "binary_structure_test.nsbs";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << bytes;
+    }
+    Factory mapped = map_binary_structure(path);
+    expect_same_structure(original, mapped);
+    std::remove(path.c_str());
+}
+
+TEST(BinaryStructureTest, RejectsTruncatedImage) {
+    std::ifstream file("load_factory.txt");
+    Factory factory = load_factory_structure(file);
+    std::ostringstream binary;
+    save_binary_structure(factory, binary);
+    const std::string bytes = binary.str();
+
+    std::vector<std::uint64_t> aligned(bytes.size() / 8 + 1);
+    std::memcpy(aligned.data(), bytes.data(), bytes.size());
+    EXPECT_THROW(load_binary_structure(aligned.data(), bytes.size() - 8), std::logic_error);
+    EXPECT_THROW(load_binary_structure(aligned.data(), 16), std::logic_error);
+}
+
+// TESTY EKSPORTERA METRYK
+
+namespace {
+
+std::string scrape_tcp(int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return "";
+    }
+    const std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+    ::send(fd, request.data(), request.size(), 0);
+    std::string response;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, static_cast<std::size_t>(n));
+    }
+    ::close(fd);
+    return response;
+}
+
+}
+
+TEST(MetricsTest, ServesCurrentStateOverTcp) {
+    std::ifstream file("load_factory.txt");
+    Factory factory = load_factory_structure(file);
+    MetricsExporter exporter("tcp:0", factory);
+    ASSERT_GT(exporter.port(), 0);
+
+    simulate(factory, 12, [&exporter](Factory& f, TimeOffset t) { exporter.update_if_due(f, t); });
+
+    std::size_t in_flight = 0;
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        in_flight += packages_held(*it);
+    }
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        in_flight += it->get_sending_buffer().has_value();
+    }
+
+    const std::string response = scrape_tcp(exporter.port());
+    EXPECT_EQ(response.rfind("HTTP/1.0 200 OK", 0), 0u);
+    EXPECT_NE(response.find("\nnetsim_turn 12\n"), std::string::npos);
+    EXPECT_NE(response.find("\nnetsim_packages_in_flight " + std::to_string(in_flight) + "\n"), std::string::npos);
+    const std::string stock = "netsim_storehouse_stock{storehouse=\"1\"} " +
+                              std::to_string(factory.storehouse_cbegin()->size()) + "\n";
+    EXPECT_NE(response.find(stock), std::string::npos);
+    EXPECT_NE(response.find("netsim_worker_queue_length{worker=\"2\"}"), std::string::npos);
+    EXPECT_NE(response.find("netsim_memory_bytes{component=\"worker_queues\"}"), std::string::npos);
+}
+
+TEST(MetricsTest, MemoryGaugesRefreshOnlyAfterScrape) {
+    std::ifstream file("load_factory.txt");
+    Factory factory = load_factory_structure(file);
+    MetricsExporter exporter("tcp:0", factory);
+    const std::string empty_queues = "netsim_memory_bytes{component=\"worker_queues\"} " +
+                                     std::to_string(factory.memory_usage().worker_queues.bytes) + "\n";
+
+    // Bez zapytań szacunek pamięci zostaje z utworzenia eksportera
+    simulate(factory, 12, [&exporter](Factory& f, TimeOffset t) { exporter.update(f, t); });
+    ASSERT_GT(factory.memory_usage().worker_queues.objects, 0u);
+    EXPECT_NE(exporter.render().find(empty_queues), std::string::npos);
+
+    // Zapytanie zleca przeliczenie przy najbliższej aktualizacji
+    scrape_tcp(exporter.port());
+    exporter.update(factory, 12);
+    const std::string queues = "netsim_memory_bytes{component=\"worker_queues\"} " +
+                               std::to_string(factory.memory_usage().worker_queues.bytes) + "\n";
+    EXPECT_NE(exporter.render().find(queues), std::string::npos);
+}
+
+TEST(MetricsTest, IntervalOnlyRefreshesTurnInBetween) {
+    std::ifstream file("load_factory.txt");
+    Factory factory = load_factory_structure(file);
+    MetricsExporter exporter("unix:netsim_metrics_test.sock", factory, 5);
+    simulate(factory, 7, [&exporter](Factory& f, TimeOffset t) { exporter.update_if_due(f, t); });
+
+    std::string metrics = exporter.render();
+    EXPECT_NE(metrics.find("\nnetsim_turn 7\n"), std::string::npos);
+    EXPECT_NE(metrics.find("# TYPE netsim_worker_busy gauge\n"), std::string::npos);
+}
+
+// TESTY SZABLONOWEGO SIMULATE
+
+TEST(NotifierTest, NextReportTurn) {
+    IntervalReportNotifier every_five(5);
+    EXPECT_EQ(every_five.next_report_turn(1), 5);
+    EXPECT_EQ(every_five.next_report_turn(5), 5);
+    EXPECT_EQ(every_five.next_report_turn(6), 10);
+    EXPECT_EQ(IntervalReportNotifier(0).next_report_turn(1), NO_REPORT_TURN);
+
+    SpecificTurnsReportNotifier specific({2, 9});
+    EXPECT_EQ(specific.next_report_turn(1), 2);
+    EXPECT_EQ(specific.next_report_turn(3), 9);
+    EXPECT_EQ(specific.next_report_turn(10), NO_REPORT_TURN);
+
+    static_assert(is_report_notifier<IntervalReportNotifier>::value);
+    static_assert(is_report_notifier<SpecificTurnsReportNotifier>::value);
+    static_assert(!is_report_notifier<Factory>::value);
+}
+
+TEST(SimulateTest, NotifierOverloadMatchesFilteredCallback) {
+    const SpecificTurnsReportNotifier notifier({3, 7, 20});
+
+    std::ostringstream filtered;
+    {
+        std::istringstream iss(LINEAGE_STRUCTURE);
+        Factory factory = load_factory_structure(iss);
+        simulate(factory, 10, std::function<void(Factory&, TimeOffset)>([&](Factory& f, TimeOffset t) {
+            if (notifier.should_generate_report(t)) {
+                generate_simulation_report(f, filtered, t);
+            }
+        }));
+    }
+
+    std::istringstream iss(LINEAGE_STRUCTURE);
+    Factory factory = load_factory_structure(iss);
+    std::ostringstream sparse;
+    std::vector<Time> turns;
+    simulate(factory, 10, [&](Factory& f, TimeOffset t) {
+        turns.push_back(t);
+        generate_simulation_report(f, sparse, t);
+    }, notifier);
+
+    EXPECT_EQ(turns, (std::vector<Time>{3, 7}));
+    EXPECT_EQ(filtered.str(), sparse.str());
+}
+
+// TESTY REDUKCJI WARIANCJI
+
+namespace {
+
+const char* VARIANT_STRUCTURE =
+    "LOADING_RAMP id=1 delivery-interval=1\n"
+    "WORKER id=1 processing-time=%d queue-type=FIFO\n"
+    "WORKER id=2 processing-time=2 queue-type=FIFO\n"
+    "WORKER id=3 processing-time=3 queue-type=FIFO\n"
+    "STOREHOUSE id=1\n"
+    "LINK src=ramp-1 dest=worker-1\n"
+    "LINK src=ramp-1 dest=worker-2\n"
+    "LINK src=ramp-1 dest=worker-3\n"
+    "LINK src=worker-1 dest=store-1\n"
+    "LINK src=worker-1 dest=worker-3\n"
+    "LINK src=worker-2 dest=store-1\n"
+    "LINK src=worker-2 dest=worker-1\n"
+    "LINK src=worker-3 dest=store-1\n";
+
+FactoryBuilder variant(int processing_time) {
+    return [processing_time]() {
+        char text[1024];
+        std::snprintf(text, sizeof(text), VARIANT_STRUCTURE, processing_time);
+        std::istringstream iss(text);
+        return load_factory_structure(iss);
+    };
+}
+
+}
+
+TEST(VarianceReductionTest, CommonRandomNumbersNarrowComparison) {
+    ReplicationOptions options;
+    options.turns = 400;
+    options.warmup = 50;
+    options.replications = 20;
+
+    ReplicationEstimate crn = compare_variants(variant(1), variant(2), options);
+    options.common_random_numbers = false;
+    ReplicationEstimate independent = compare_variants(variant(1), variant(2), options);
+
+    EXPECT_EQ(crn.observations, 20u);
+    EXPECT_LT(crn.half_width, independent.half_width);
+    EXPECT_NEAR(crn.mean, independent.mean, crn.half_width + independent.half_width);
+}
+
+TEST(VarianceReductionTest, AntitheticPairsAndControlVariate) {
+    // Losuje tylko rampa: u <= 1/2 wysyła paczkę do robotnika 1, u > 1/2 do wolnego robotnika 2,
+    // więc kolejka robotnika 2 rośnie razem z sumą (u - 1/2) i maleje w odbitym strumieniu
+    FactoryBuilder correlated = []() {
+        std::istringstream iss(
+            "LOADING_RAMP id=1 delivery-interval=1\n"
+            "WORKER id=1 processing-time=1 queue-type=FIFO\n"
+            "WORKER id=2 processing-time=3 queue-type=FIFO\n"
+            "STOREHOUSE id=1\n"
+            "LINK src=ramp-1 dest=worker-1\n"
+            "LINK src=ramp-1 dest=worker-2\n"
+            "LINK src=worker-1 dest=store-1\n"
+            "LINK src=worker-2 dest=store-1\n");
+        return load_factory_structure(iss);
+    };
+    ReplicationOptions options;
+    options.target = {MetricKind::WORKER_QUEUE_LENGTH, 2};
+    options.turns = 300;
+    options.warmup = 30;
+    options.replications = 20;
+
+    ReplicationEstimate plain = run_replications(correlated, options);
+
+    // Te same 20 przebiegów w 10 parach daje węższy przedział niż 20 niezależnych
+    options.antithetic = true;
+    ReplicationEstimate paired = run_replications(correlated, options);
+    EXPECT_EQ(paired.observations, 10u);
+    EXPECT_LT(paired.half_width, 0.5 * plain.half_width);
+    EXPECT_NEAR(paired.mean, plain.mean, plain.half_width + paired.half_width);
+
+    // Korelacja z sumą losowań jest słabsza niż przy parach - estymata zysku z 20 przebiegów
+    // jest zbyt rozrzucona, porównanie na 60
+    options.antithetic = false;
+    options.replications = 60;
+    ReplicationEstimate baseline = run_replications(correlated, options);
+    options.control_variate = true;
+    ReplicationEstimate controlled = run_replications(correlated, options);
+    EXPECT_GT(controlled.variance_ratio, 1.2);
+    EXPECT_GT(controlled.control_coefficient, 0.0);
+    EXPECT_LT(controlled.half_width, 0.9 * baseline.half_width);
+    EXPECT_NEAR(controlled.mean, baseline.mean, baseline.half_width + controlled.half_width);
+}
+
+// TESTY SZACOWANIA PAMIĘCI
+
+TEST(MemoryUsageTest, TracksQueuedPackagesAndStructure) {
+    std::istringstream iss(LINEAGE_STRUCTURE);
+    Factory factory = load_factory_structure(iss);
+    MemoryUsage empty = factory.memory_usage();
+    EXPECT_EQ(empty.ramps.objects, 1u);
+    EXPECT_EQ(empty.workers.objects, 1u);
+    EXPECT_EQ(empty.storehouses.objects, 1u);
+    EXPECT_EQ(empty.receiver_preferences.objects, 2u);
+    EXPECT_EQ(empty.routing_generators.objects, 2u);   // rampa i robotnik
+    EXPECT_EQ(empty.routing_generators.bytes, 2 * sizeof(RoutingStream));
+    EXPECT_EQ(empty.worker_queues.objects, 0u);
+    EXPECT_GT(empty.total_bytes(), 0u);
+
+    // Rampa dostarcza co turę, robotnik przetwarza 2 tury - kolejka rośnie
+    simulate(factory, 10, [](Factory&, TimeOffset) {});
+    MemoryUsage after = factory.memory_usage();
+    const std::size_t queued = factory.worker_cbegin()->get_queue()->size();
+    EXPECT_EQ(after.worker_queues.objects, queued);
+    EXPECT_EQ(after.storehouse_stock.objects, factory.storehouse_cbegin()->size());
+    EXPECT_EQ(after.worker_queues.bytes - empty.worker_queues.bytes,
+              queued * (after.bytes_per_queued_package - (after.package_ids.bytes / after.package_ids.objects)));
+
+    std::ostringstream report;
+    generate_memory_report(after, report);
+    EXPECT_NE(report.str().find("  worker_queues: " + std::to_string(queued) + " objects"), std::string::npos);
+}
+
+// TESTY RÓŻNICOWE
+
+TEST(DifferentialTest, GeneratedStructuresAreConsistent) {
+    std::mt19937_64 rng(3);
+    for (int i = 0; i < 20; ++i) {
+        std::istringstream iss(generate_random_structure(rng));
+        EXPECT_TRUE(load_factory_structure(iss).is_consistent());
+    }
+}
+
+TEST(DifferentialTest, ReplayEngineMatchesReference) {
+    DifferentialOptions options;
+    options.cases = 10;
+    options.turns = 50;
+    EXPECT_FALSE(run_differential(replay_engine(), options).has_value());
+}
+
+TEST(DifferentialTest, BrokenEngineIsShrunk) {
+    // Praca przed przekazaniem paczek - paczka dociera do magazynu turę wcześniej
+    SimulationEngine broken = [](Factory& factory, TimeOffset d, std::uint64_t seed, const TurnObserver& observe) {
+        factory.seed_routing(seed);
+        for (Time t = 1; t <= d; ++t) {
+            factory.do_deliveries(t);
+            factory.do_work(t);
+            factory.do_package_passing();
+            observe(capture_snapshot(factory, t));
+        }
+    };
+    DifferentialOptions options;
+    options.cases = 5;
+    options.turns = 50;
+    auto mismatch = run_differential(broken, options);
+    ASSERT_TRUE(mismatch.has_value());
+    EXPECT_TRUE(mismatch->error.empty());
+
+    // Minimalny przykład: rampa, robotnik, magazyn i dwa łącza
+    std::istringstream iss(mismatch->structure);
+    Factory minimal = load_factory_structure(iss);
+    EXPECT_EQ(std::distance(minimal.ramp_cbegin(), minimal.ramp_cend()), 1);
+    EXPECT_EQ(std::distance(minimal.worker_cbegin(), minimal.worker_cend()), 1);
+    EXPECT_EQ(std::distance(minimal.storehouse_cbegin(), minimal.storehouse_cend()), 1);
+    EXPECT_EQ(minimal.worker_cbegin()->get_processing_duration(), 1);
+    EXPECT_TRUE(compare_engines(mismatch->structure, mismatch->seed, mismatch->turn, broken).has_value());
+
+    std::ostringstream report;
+    generate_mismatch_report(*mismatch, report);
+    EXPECT_NE(report.str().find("== DIFFERENTIAL MISMATCH =="), std::string::npos);
+}
+
+TEST(DifferentialTest, QueueOrderIsCompared) {
+    // Kolejka LIFO zamieniona na FIFO - długości kolejek i zapasy się zgadzają,
+    // różni się tylko kolejność paczek w kolejce
+    const std::string structure = "LOADING_RAMP id=1 delivery-interval=1\n"
+                                  "WORKER id=1 processing-time=3 queue-type=LIFO\n"
+                                  "STOREHOUSE id=1\n"
+                                  "LINK src=ramp-1 dest=worker-1\n"
+                                  "LINK src=worker-1 dest=store-1\n";
+    SimulationEngine fifo = [](Factory& factory, TimeOffset d, std::uint64_t seed, const TurnObserver& observe) {
+        std::stringstream ss;
+        save_factory_structure(factory, ss);
+        std::string text = ss.str();
+        text.replace(text.find("queue-type=LIFO"), 15, "queue-type=FIFO");
+        std::istringstream iss(text);
+        Factory changed = load_factory_structure(iss);
+        reference_engine(changed, d, seed, observe);
+    };
+    auto mismatch = compare_engines(structure, 1, 20, fifo);
+    ASSERT_TRUE(mismatch.has_value());
+    ASSERT_EQ(mismatch->expected.workers.size(), 1u);
+    EXPECT_EQ(mismatch->expected.workers[0].queue_length, mismatch->actual.workers[0].queue_length);
+    EXPECT_NE(mismatch->expected_queues[0], mismatch->actual_queues[0]);
+
+    std::ostringstream report;
+    generate_mismatch_report(*mismatch, report);
+    EXPECT_NE(report.str().find("queue order"), std::string::npos);
+
+    // Ten sam typ kolejki w obu silnikach - pełna zgodność, także ramp
+    EXPECT_FALSE(compare_engines(structure, 1, 20, reference_engine).has_value());
+}
+
+// TESTY GENERATORA SYMULATORA
+
+TEST(CodegenTest, EmitsTopologyTables) {
+    std::istringstream iss(LINEAGE_STRUCTURE);
+    Factory factory = load_factory_structure(iss);
+    std::ostringstream source;
+    generate_simulator_source(factory, source);
+    const std::string code = source.str();
+    EXPECT_NE(code.find("constexpr std::size_t WORKER_COUNT = 1;"), std::string::npos);
+    EXPECT_NE(code.find("constexpr WorkerSpec WORKERS[WORKER_COUNT + 1] = {\n    {1, 2, false, 0, 1, 1},"),
+              std::string::npos);
+    EXPECT_NE(code.find("{true, 0, 0x1p+0}"), std::string::npos);
+    EXPECT_NE(code.find("int main("), std::string::npos);
+
+    std::istringstream broken("LOADING_RAMP id=1 delivery-interval=1\n"
+                              "WORKER id=1 processing-time=1 queue-type=FIFO\n"
+                              "LINK src=ramp-1 dest=worker-1\n");
+    Factory inconsistent = load_factory_structure(broken);
+    EXPECT_THROW(generate_simulator_source(inconsistent, source), std::logic_error);
+}
+
+// TESTY TRYBU ZAGREGOWANEGO
+
+TEST(FluidTest, SinglePackageBatchesMatchSimulate) {
+    SimulationEngine fluid = [](Factory& factory, TimeOffset d, std::uint64_t seed, const TurnObserver& observe) {
+        FluidFactory aggregated(factory, FluidOptions{1, seed});
+        aggregated.run(d, [&observe](const FluidFactory& f, Time) { observe(f.snapshot()); });
+    };
+    DifferentialOptions options;
+    options.cases = 20;
+    options.turns = 100;
+    options.structure.queue_capacity_probability = 0.5;  // dużo blokad nadawców
+    auto mismatch = run_differential(fluid, options);
+    if (mismatch) {
+        generate_mismatch_report(*mismatch, std::cout);
+    }
+    EXPECT_FALSE(mismatch.has_value());
+}
+
+TEST(FluidTest, LargeBatchesConservePackages) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=1 processing-time=3 queue-type=FIFO queue-capacity=1500\n"
+        "WORKER id=2 processing-time=3 queue-type=LIFO\n"
+        "STOREHOUSE id=1\n"
+        "STOREHOUSE id=2\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=ramp-1 dest=worker-2\n"
+        "LINK src=worker-1 dest=store-1\n"
+        "LINK src=worker-1 dest=worker-2\n"
+        "LINK src=worker-2 dest=store-2\n");
+    Factory factory = load_factory_structure(iss);
+    FluidFactory fluid(factory, FluidOptions{1000, 3});
+    fluid.run(200, [](const FluidFactory& f, Time) {
+        std::uint64_t stock = 0;
+        for (const auto& s : f.storehouses()) {
+            stock += s.stock;
+        }
+        ASSERT_EQ(stock + f.in_flight(), f.delivered());
+    });
+
+    // Rampa dzieli partię mniej więcej po równo, a robotnik 1 przetwarza 1000 paczek co 3 tury -
+    // jego kolejka dochodzi do limitu i rampa zostaje zablokowana
+    const FluidWorker& first = fluid.workers()[0];
+    EXPECT_GT(first.started, 60u * 1000u);
+    EXPECT_LE(first.queued, 1500u);
+    EXPECT_GT(fluid.storehouses()[0].stock + fluid.storehouses()[1].stock, 0u);
+    EXPECT_GT(fluid.ramps()[0].blocked_turns, 0u);
+    EXPECT_LT(fluid.delivered(), 200u * 1000u);
+
+    std::ostringstream report;
+    generate_fluid_report(fluid, report);
+    EXPECT_NE(report.str().find("=== [ Turn: 200 ] === (batch 1000)"), std::string::npos);
+}
+
+// TESTY ZDARZEŃ RZADKICH
+
+TEST(RareEventTest, SplittingAgreesWithBruteForce) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=1 processing-time=2 queue-type=FIFO\n"
+        "WORKER id=2 processing-time=1 queue-type=FIFO\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=ramp-1 dest=worker-2\n"
+        "LINK src=worker-1 dest=store-1\n"
+        "LINK src=worker-2 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+
+    SplittingOptions options;
+    options.worker = 1;
+    options.threshold = 10;
+    options.horizon = 100;
+    options.effort = 100;
+    options.replications = 10;
+    RareEventEstimate split = estimate_overflow_probability(factory, options);
+    RareEventEstimate brute = estimate_overflow_brute_force(factory, options, 4000);
+
+    ASSERT_EQ(split.level_probabilities.size(), 4u);
+    EXPECT_GT(split.probability, 0.0);
+    EXPECT_LT(std::abs(split.probability - brute.probability), split.half_width + brute.half_width);
+    EXPECT_LT(split.simulated_turns, brute.simulated_turns);
+
+    options.levels = {5, 3};
+    EXPECT_THROW(estimate_overflow_probability(factory, options), std::invalid_argument);
+    options.levels.clear();
+    options.worker = 7;
+    EXPECT_THROW(estimate_overflow_probability(factory, options), std::invalid_argument);
+}
+
+// TESTY PAMIĘCI PODRĘCZNEJ WYNIKÓW
+
+TEST(ResultCacheTest, RoutingStreamIsFixedAcrossBuilds) {
+    // Klucz przebiegu zakłada, że te same (ziarno, strumień) dają te same losowania
+    // w każdym kompilatorze i bibliotece standardowej
+    RoutingStream stream(1, (static_cast<std::uint64_t>(ElementType::WORKER) << 32) | 7);
+    EXPECT_EQ(stream(), 0xf565119c3ea7395bULL);
+    EXPECT_EQ(stream(), 0x0768a42f50a23f21ULL);
+    EXPECT_EQ(stream(), 0x3f5bb24a4426dc06ULL);
+
+    ProbabilityGenerator pg = make_probability_generator(1, (static_cast<std::uint64_t>(ElementType::WORKER) << 32) | 7);
+    EXPECT_EQ(pg(), 0x1.eaca23387d4e7p-1);
+}
+
+TEST(ResultCacheTest, StructureHashIgnoresLinkOrder) {
+    const std::string nodes =
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=1 processing-time=2 queue-type=FIFO\n"
+        "WORKER id=2 processing-time=1 queue-type=LIFO\n"
+        "STOREHOUSE id=1\n"
+        "STOREHOUSE id=2\n";
+    std::istringstream forward(nodes +
+        "LINK src=ramp-1 dest=worker-1\nLINK src=ramp-1 dest=worker-2\nLINK src=ramp-1 dest=store-2\n"
+        "LINK src=worker-1 dest=store-1\nLINK src=worker-2 dest=store-1\nLINK src=worker-2 dest=store-2\n");
+    std::istringstream backward(nodes +
+        "LINK src=worker-2 dest=store-2\nLINK src=worker-2 dest=store-1\nLINK src=worker-1 dest=store-1\n"
+        "LINK src=ramp-1 dest=store-2\nLINK src=ramp-1 dest=worker-2\nLINK src=ramp-1 dest=worker-1\n");
+    Factory a = load_factory_structure(forward);
+    Factory b = load_factory_structure(backward);
+    EXPECT_EQ(structure_hash(a), structure_hash(b));
+
+    // Kolejność odbiorców nie zależy od adresów - te same decyzje routingu
+    RunParameters params;
+    params.seed = 5;
+    params.horizon = 30;
+    params.report_interval = 10;
+    EXPECT_EQ(run_uncached(a, params).reports, run_uncached(b, params).reports);
+
+    b.find_worker_by_id(2)->receiver_preferences_.remove_receiver(&*b.find_storehouse_by_id(2));
+    EXPECT_NE(structure_hash(a), structure_hash(b));
+    RunParameters other = params;
+    other.seed = 6;
+    EXPECT_NE(run_key(structure_hash(a), params), run_key(structure_hash(a), other));
+}
+
+TEST(ResultCacheTest, ServesRepeatedRunsFromDisk) {
+    const std::string directory = "result_cache_test";
+    std::filesystem::remove_all(directory);
+    std::ifstream file("load_factory.txt");
+    Factory factory = load_factory_structure(file);
+
+    RunParameters params;
+    params.seed = 3;
+    params.horizon = 20;
+    params.report_interval = 5;
+    params.report_turns = {1, 2};
+
+    ResultCache cache(directory);
+    CachedRun first = cache.run(factory, params);
+    EXPECT_FALSE(first.hit);
+    EXPECT_NE(first.reports.find("WORKER #1"), std::string::npos);
+    EXPECT_NE(first.metrics.find("turn,20\n"), std::string::npos);
+    ASSERT_TRUE(std::filesystem::exists(cache.path_for(first.key)));
+
+    // Nowa instancja (jak w kolejnym procesie) czyta wpis z dysku
+    ResultCache again(directory);
+    CachedRun second = again.run(factory, params);
+    EXPECT_TRUE(second.hit);
+    EXPECT_EQ(second.key, first.key);
+    EXPECT_EQ(second.reports, first.reports);
+    EXPECT_EQ(second.metrics, first.metrics);
+    EXPECT_EQ(again.hits(), 1u);
+
+    // Uszkodzony wpis to brak wpisu - przebieg jest powtarzany i wpis nadpisany
+    {
+        std::ofstream corrupt(cache.path_for(first.key), std::ios::trunc);
+        corrupt << "NSR 1 " << "garbage\n";
+    }
+    CachedRun third = again.run(factory, params);
+    EXPECT_FALSE(third.hit);
+    EXPECT_EQ(third.reports, first.reports);
+    EXPECT_TRUE(again.lookup(first.key).has_value());
+
+    // Żywe paczki w rejestrze globalnym nie zmieniają ID przebiegu - wynik nadal trafia na dysk
+    Package held;
+    params.seed = 4;
+    ResultCache busy(directory);
+    CachedRun fourth = busy.run(factory, params);
+    EXPECT_FALSE(fourth.hit);
+    EXPECT_TRUE(busy.lookup(fourth.key).has_value());
+    std::filesystem::remove_all(directory);
+}
+
+// TESTY SERWERA SYMULACJI
+
+TEST(DaemonTest, ServesConcurrentRunsOverSocket) {
+    std::ifstream file("load_factory.txt");
+    const std::string structure((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::istringstream iss(structure);
+    Factory factory = load_factory_structure(iss);
+
+    RunParameters params;
+    params.seed = 9;
+    params.horizon = 40;
+    params.report_turns = {10, 40};
+    const CachedRun expected = run_uncached(factory, params);
+
+    const std::string path = "netsimd_test.sock";
+    SimulationDaemon daemon(DaemonOptions{path, 4});
+    DaemonClient client(path);
+    EXPECT_EQ(client.load("plant", structure).size(), 16u);
+
+    // Każde połączenie w osobnym wątku puli, każdy przebieg na własnej fabryce
+    std::vector<std::string> reports(8), metrics(8);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < reports.size(); ++i) {
+        threads.emplace_back([&, i] {
+            DaemonClient c(path);
+            reports[i] = c.request("RUN plant turns=40 seed=9 at=10,40");
+            metrics[i] = c.request("RUN plant turns=40 seed=9 at=10,40 output=metrics");
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (std::size_t i = 0; i < reports.size(); ++i) {
+        EXPECT_EQ(reports[i], expected.reports);
+        EXPECT_EQ(metrics[i], expected.metrics);
+    }
+
+    EXPECT_NE(client.request("LIST").find("plant "), std::string::npos);
+    EXPECT_THROW(client.request("RUN other turns=5"), std::runtime_error);
+    EXPECT_THROW(client.request("RUN plant seed=1"), std::runtime_error);
+    EXPECT_THROW(client.load("broken", "LOADING_RAMP id=1 delivery-interval=1\n"
+                                       "WORKER id=1 processing-time=1 queue-type=FIFO\n"
+                                       "LINK src=ramp-1 dest=worker-1\n"),
+                 std::runtime_error);
+    EXPECT_NE(client.request("STATS").find("runs 16\n"), std::string::npos);
+    client.request("DROP plant");
+    EXPECT_EQ(client.request("LIST"), "");
+    daemon.stop();
+}
+
+TEST(DaemonTest, PipelinedRequestsAnsweredInOrderDespiteIdleConnection) {
+    std::ifstream file("load_factory.txt");
+    const std::string structure((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::istringstream iss(structure);
+    Factory factory = load_factory_structure(iss);
+
+    RunParameters params;
+    params.seed = 3;
+    params.horizon = 30;
+    params.report_turns = {30};
+    const CachedRun expected = run_uncached(factory, params);
+
+    const std::string path = "netsimd_pipeline_test.sock";
+    SimulationDaemon daemon(DaemonOptions{path, 1});
+
+    // Bezczynne połączenie nie może zająć jedynego wątku puli
+    int idle = connect_unix_socket(path);
+
+    // Wszystkie żądania wysłane naraz; po zamknięciu strony zapisu serwer zamyka
+    // połączenie dopiero po ostatniej odpowiedzi
+    int fd = connect_unix_socket(path);
+    ASSERT_TRUE(write_all(fd, "LOAD plant " + std::to_string(structure.size()) + "\n" + structure +
+                                  "RUN plant turns=30 seed=3 at=30\n"
+                                  "RUN other turns=5\n"
+                                  "RUN plant turns=30 seed=3 at=30 output=metrics\n"
+                                  "LIST\n"));
+    ::shutdown(fd, SHUT_WR);
+    std::string received;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = ::recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        received.append(chunk, static_cast<std::size_t>(n));
+    }
+    ::close(fd);
+
+    std::vector<std::string> responses;
+    std::size_t pos = 0;
+    while (pos < received.size()) {
+        std::size_t end = received.find('\n', pos);
+        ASSERT_NE(end, std::string::npos);
+        std::string header = received.substr(pos, end - pos);
+        pos = end + 1;
+        if (header.rfind("OK ", 0) == 0) {
+            std::size_t size = std::stoul(header.substr(3));
+            responses.push_back(received.substr(pos, size));
+            pos += size;
+        } else {
+            responses.push_back(header);
+        }
+    }
+    ASSERT_EQ(responses.size(), 5u);
+    EXPECT_EQ(responses[0].size(), 16u);
+    EXPECT_EQ(responses[1], expected.reports);
+    EXPECT_EQ(responses[2].rfind("ERR ", 0), 0u);
+    EXPECT_EQ(responses[3], expected.metrics);
+    EXPECT_NE(responses[4].find("plant "), std::string::npos);
+
+    DaemonClient client(path);
+    EXPECT_NE(client.request("STATS").find("runs 2\n"), std::string::npos);
+    ::close(idle);
+    daemon.stop();
+}
+
+TEST(DaemonTest, ClientThatDoesNotReadBlocksNoThread) {
+    std::ifstream file("load_factory.txt");
+    const std::string structure((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::istringstream iss(structure);
+    Factory factory = load_factory_structure(iss);
+
+    RunParameters params;
+    params.seed = 5;
+    params.horizon = 40;
+    params.report_interval = 1;
+    const std::string expected = run_uncached(factory, params).reports;
+
+    const std::string path = "netsimd_backpressure_test.sock";
+    SimulationDaemon daemon(DaemonOptions{path, 1});
+    DaemonClient client(path);
+    client.load("plant", structure);
+
+    // Odpowiedzi dużo większe niż bufor gniazda, klient na razie nic nie czyta
+    const std::size_t requests = 200;
+    std::string pipelined;
+    for (std::size_t i = 0; i < requests; ++i) {
+        pipelined += "RUN plant turns=40 seed=5 interval=1\n";
+    }
+    ASSERT_GT(requests * expected.size(), std::size_t{1} << 20);
+    int fd = connect_unix_socket(path);
+    ASSERT_TRUE(write_all(fd, pipelined));
+
+    // Jedyny wątek puli i pętla poll() nadal obsługują inne połączenia
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_NE(client.request("STATS").find("structures 1\n"), std::string::npos);
+
+    // Za długi wiersz - ERR i koniec połączenia
+    int flood = connect_unix_socket(path);
+    ASSERT_TRUE(write_all(flood, std::string(100000, 'x')));
+    std::string rejected;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = ::recv(flood, chunk, sizeof(chunk), 0)) > 0) {
+        rejected.append(chunk, static_cast<std::size_t>(n));
+    }
+    ::close(flood);
+    EXPECT_EQ(rejected, "ERR Request line too long\n");
+
+    // Po wznowieniu odbioru wszystkie odpowiedzi, w kolejności
+    ::shutdown(fd, SHUT_WR);
+    std::string received;
+    while ((n = ::recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        received.append(chunk, static_cast<std::size_t>(n));
+    }
+    ::close(fd);
+    const std::string response = "OK " + std::to_string(expected.size()) + "\n" + expected;
+    ASSERT_EQ(received.size(), requests * response.size());
+    for (std::size_t i = 0; i < requests; ++i) {
+        ASSERT_EQ(received.compare(i * response.size(), response.size(), response), 0) << "response " << i;
+    }
+    EXPECT_NE(client.request("STATS").find("runs " + std::to_string(requests) + "\n"), std::string::npos);
+    daemon.stop();
+}
+
+// TESTY REPLIKACJI W PASACH
+
+TEST(LaneTest, DeterministicStructureMatchesSimulateInEveryLane) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "LOADING_RAMP id=2 delivery-interval=3\n"
+        "WORKER id=1 processing-time=2 queue-type=FIFO queue-capacity=2\n"
+        "WORKER id=2 processing-time=1 queue-type=LIFO\n"
+        "WORKER id=3 processing-time=4 queue-type=FIFO queue-capacity=1\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=ramp-2 dest=worker-2\n"
+        "LINK src=worker-1 dest=worker-3\n"
+        "LINK src=worker-2 dest=worker-3\n"
+        "LINK src=worker-3 dest=store-1\n");
+    Factory factory = load_factory_structure(iss);
+    LaneFactory lanes(factory, 7);
+
+    // Jedyny odbiorca każdego nadawcy - losowanie nie ma wpływu, pasy muszą być identyczne z simulate()
+    std::uint32_t max_blocked = 0;
+    simulate(factory, 60, [&](Factory& f, TimeOffset t) {
+        lanes.step();
+        const FactorySnapshot expected = capture_snapshot(f, t);
+        for (std::size_t l = 0; l < LANE_WIDTH; ++l) {
+            const FactorySnapshot lane = lanes.snapshot(l);
+            ASSERT_EQ(lane.turn, expected.turn);
+            ASSERT_EQ(lane.workers, expected.workers);
+            ASSERT_EQ(lane.storehouses, expected.storehouses);
+            ASSERT_EQ(lane.ramps, expected.ramps);
+        }
+        max_blocked = std::max(max_blocked, expected.workers[0].blocked_turns);
+    });
+    EXPECT_GT(max_blocked, 0u);
+    EXPECT_GT(lanes.snapshot(0).ramps[0].blocked_turns, 0u);
+    EXPECT_THROW(lanes.snapshot(LANE_WIDTH), std::out_of_range);
+}
+
+TEST(LaneTest, RandomRoutingAgreesWithSimulateInDistribution) {
+    std::ifstream file("load_factory.txt");
+    Factory factory = load_factory_structure(file);
+    const TimeOffset turns = 100;
+
+    auto mean_and_variance = [](const std::vector<double>& xs) {
+        double mean = 0.0, variance = 0.0;
+        for (double x : xs) {
+            mean += x;
+        }
+        mean /= static_cast<double>(xs.size());
+        for (double x : xs) {
+            variance += (x - mean) * (x - mean);
+        }
+        return std::make_pair(mean, variance / static_cast<double>(xs.size() - 1));
+    };
+
+    std::vector<double> lane_stock;
+    for (const auto& snapshot : simulate_lane_replications(factory, turns, 250, 3)) {
+        lane_stock.push_back(snapshot.storehouses[0].stock);
+    }
+    ASSERT_EQ(lane_stock.size(), 250u);
+
+    std::vector<double> reference_stock;
+    for (std::uint64_t r = 1; r <= 100; ++r) {
+        std::ifstream again("load_factory.txt");
+        Factory f = load_factory_structure(again);
+        f.seed_routing(r);
+        simulate(f, turns, [](Factory&, TimeOffset) {});
+        reference_stock.push_back(static_cast<double>(f.storehouse_cbegin()->size()));
+    }
+
+    auto [lane_mean, lane_variance] = mean_and_variance(lane_stock);
+    auto [ref_mean, ref_variance] = mean_and_variance(reference_stock);
+    EXPECT_GT(lane_variance, 0.0);
+    EXPECT_LT(std::abs(lane_mean - ref_mean),
+              4.0 * std::sqrt(lane_variance / lane_stock.size() + ref_variance / reference_stock.size()));
+}